@@ -0,0 +1,97 @@
+#ifndef DUNE_FIELD_H
+#define DUNE_FIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// the desert as a height function: flat sand at the scene's ground level around the origin, rising
+// into transverse dunes further out. A dune has a long windward slope and a short, steep slip face
+// on the lee side; the ridges meander (the phase is warped by low-frequency noise) and their crest
+// height varies along them. Everything is value noise on a hashed lattice, so a field depends only
+// on its seed and any point can be evaluated on its own (Terrain bakes it into a heightmap, the
+// necropolis settles its pyramids onto it).
+// ------------------------------------------------------------------------------------------------
+struct DuneField
+{
+    float ground = -1.0f;           // height of the flat sand
+    float flatRadius = 60.0f;       // no dunes closer to the origin than this...
+    float duneRadius = 180.0f;      // ...full dunes from here on
+    float wavelength = 70.0f;       // crest to crest
+    float crestHeight = 10.0f;
+    float windwardFraction = 0.8f;  // of the wavelength; the slip face is the rest
+    uint32_t seed = 1;
+
+    float height(float x, float z) const
+    {
+        float r = std::sqrt(x * x + z * z);
+        float mask = smoothstep((r - flatRadius) / (duneRadius - flatRadius));
+        if (mask <= 0.0f)
+            return ground;
+
+        // wind along (0.94, 0.34): t counts wavelengths downwind
+        float warp = 1.5f * fbm(x * 0.004f, z * 0.004f, 3, seed);
+        float t = (x * 0.94f + z * 0.34f) / wavelength + warp;
+        float phase = t - std::floor(t);
+        float profile = phase < windwardFraction ? smoothstep(phase / windwardFraction)
+                                                 : smoothstep((1.0f - phase) / (1.0f - windwardFraction));
+        float crest = 0.5f + 0.5f * noise(x * 0.01f, z * 0.01f, seed + 1);
+        float swell = 4.0f * fbm(x * 0.002f, z * 0.002f, 2, seed + 2);
+        float ripples = 0.6f * noise(x * 0.05f, z * 0.05f, seed + 3);
+        return ground + mask * (crestHeight * crest * profile + swell + ripples);
+    }
+
+    // lowest point under a square footprint, so whatever stands there never floats
+    float footprintHeight(float x, float z, float halfWidth) const
+    {
+        float lowest = height(x, z);
+        for (int corner = 0; corner < 4; corner++)
+            lowest = std::min(lowest, height(x + (corner & 1 ? halfWidth : -halfWidth), z + (corner & 2 ? halfWidth : -halfWidth)));
+        return lowest;
+    }
+
+private:
+    static float smoothstep(float t)
+    {
+        t = std::min(std::max(t, 0.0f), 1.0f);
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    // [0, 1) at an integer lattice point
+    static float lattice(int32_t x, int32_t z, uint32_t seed)
+    {
+        uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)z * 0xd8163841u ^ seed * 0xcb1ab31fu;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        return (h >> 8) / 16777216.0f;
+    }
+
+    // smoothly interpolated value noise, [0, 1)
+    static float noise(float x, float z, uint32_t seed)
+    {
+        float fx = std::floor(x), fz = std::floor(z);
+        int32_t ix = (int32_t)fx, iz = (int32_t)fz;
+        float tx = smoothstep(x - fx), tz = smoothstep(z - fz);
+        float a = lattice(ix, iz, seed), b = lattice(ix + 1, iz, seed);
+        float c = lattice(ix, iz + 1, seed), d = lattice(ix + 1, iz + 1, seed);
+        return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * tz;
+    }
+
+    // octaves of noise, each twice the frequency and half the amplitude, [0, 1)
+    static float fbm(float x, float z, int octaves, uint32_t seed)
+    {
+        float sum = 0.0f, amplitude = 0.5f, total = 0.0f;
+        for (int i = 0; i < octaves; i++)
+        {
+            sum += amplitude * noise(x, z, seed + i * 17);
+            total += amplitude;
+            x *= 2.0f;
+            z *= 2.0f;
+            amplitude *= 0.5f;
+        }
+        return sum / total;
+    }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef FILE_UTIL_H
+#define FILE_UTIL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <direct.h>
+#include <psapi.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a, 64 bit; pass the previous result as seed to hash several pieces
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    uint64_t value = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        value ^= bytes[i];
+        value *= 1099511628211ull;
+    }
+    return value;
+}
+
+inline uint64_t hashString(const std::string& data)
+{
+    return hashBytes(data.data(), data.size());
+}
+
+// creates one directory level, does nothing if it already exists
+inline void makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// size and modification time of a file folded into one value, to notice edited sources
+inline bool fileStamp(const std::string& path, uint64_t& stamp)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    uint64_t size = (uint64_t)info.st_size;
+    uint64_t time = (uint64_t)info.st_mtime;
+    stamp = hashBytes(&time, sizeof(time), hashBytes(&size, sizeof(size)));
+    return true;
+}
+
+// the most memory the process has had resident so far (mapped file pages it touched included)
+inline size_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (size_t)counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// read-only view of a whole file through mmap / MapViewOfFile; the pages are only read from
+// disk when touched, and the file stays mapped until close() or destruction
+// ------------------------------------------------------------------------------------------
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view)
+            return false;
+        bytes = (const unsigned char*)view;
+        length = (size_t)fileSize.QuadPart;
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        struct stat info;
+        if (fstat(file, &info) != 0 || info.st_size == 0)
+        {
+            ::close(file);
+            return false;
+        }
+        void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (view == MAP_FAILED)
+            return false;
+        bytes = (const unsigned char*)view;
+        length = (size_t)info.st_size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+        if (!bytes)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+#else
+        munmap((void*)bytes, length);
+#endif
+        bytes = NULL;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes = NULL;
+    size_t length = 0;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// runs the simulation at a fixed rate whatever the frame rate: every frame adds its real time to
+// an accumulator and gets back how many whole steps fit, the remainder carries over. Rendering
+// then blends the last two simulation states by alpha(), the fraction of a step the accumulator
+// holds, so motion is smooth at any ratio of the two rates (at the cost of drawing up to one step
+// in the past).
+//
+// A frame longer than MAX_STEPS_PER_FRAME steps (a hitch, a debugger stop) runs only that many and
+// drops the rest, instead of having to catch up with ever more steps per frame.
+// ------------------------------------------------------------------------------------------------
+class FixedTimestep
+{
+public:
+    static const unsigned int MAX_STEPS_PER_FRAME = 8;
+
+    void init(double stepsPerSecond)
+    {
+        step = 1.0 / std::max(stepsPerSecond, 1.0);
+        accumulator = 0.0;
+    }
+
+    // adds a frame's real time in seconds, returns the number of steps to run now
+    unsigned int advance(double frameSeconds)
+    {
+        accumulator += std::max(frameSeconds, 0.0);
+        elapsed += std::max(frameSeconds, 0.0);
+        unsigned int count = (unsigned int)std::floor(accumulator / step);
+        if (count > MAX_STEPS_PER_FRAME)
+        {
+            droppedSteps += count - MAX_STEPS_PER_FRAME;
+            count = MAX_STEPS_PER_FRAME;
+            accumulator = std::fmod(accumulator, step);
+        }
+        else
+            accumulator -= count * step;
+        steps += count;
+        frames++;
+        return count;
+    }
+
+    double stepSeconds() const { return step; }
+
+    // how far between the previous and the current simulation state the frame is drawn, in [0, 1)
+    float alpha() const { return (float)std::min(accumulator / step, 1.0); }
+
+    void report(std::ostream& out) const
+    {
+        if (frames == 0 || elapsed <= 0.0)
+            return;
+        out << "simulation: " << 1.0 / step << " Hz, " << steps / elapsed << " steps/s, " << frames / elapsed << " frames/s ("
+            << (double)steps / frames << " steps per frame)";
+        if (droppedSteps > 0)
+            out << ", " << droppedSteps << " steps dropped";
+        out << std::endl;
+    }
+
+private:
+    double step = 1.0 / 120.0;
+    double accumulator = 0.0;
+
+    double elapsed = 0.0;
+    unsigned long long steps = 0;
+    unsigned long long frames = 0;
+    unsigned long long droppedSteps = 0;
+};
+
+#endif
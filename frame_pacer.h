@@ -0,0 +1,221 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+// seconds since construction on the monotonic clock, as a double: steady_clock counts integer
+// ticks and only the difference is converted, so it stays exact after days of running where a
+// float seconds counter is down to milliseconds after a few hours
+// ------------------------------------------------------------------------------------------------
+class FrameClock
+{
+public:
+    FrameClock() : start(std::chrono::steady_clock::now()) {}
+
+    double now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+// how buffer swaps wait for the display (glfwSwapInterval 0, 1 or -1); SWAP_DEFAULT leaves the
+// driver's setting alone
+enum SwapMode
+{
+    SWAP_DEFAULT,
+    SWAP_IMMEDIATE,
+    SWAP_VSYNC,
+    SWAP_ADAPTIVE       // vsync, but a late frame swaps at once (EXT_swap_control_tear)
+};
+
+// paces the render loop: beginFrame() measures the frame time on a FrameClock, endFrame() holds
+// the loop to the frame-rate cap. Each frame has a deadline one period after the last one (not
+// after the frame's own end, so rounding never adds up); the wait sleeps until just short of it
+// and spins the rest, with the margin learnt from how late the sleeps have woken so far. A loop
+// that falls more than a period behind starts counting again from now instead of rushing to
+// catch up.
+//
+// With render on demand, needsFrame() tells the loop whether anything can have changed on
+// screen: the caller says when the view or the scene moved, and a few frames are still drawn
+// after that so everything that converges over frames (level-of-detail hysteresis, last frame's
+// Hi-Z occluders, the terrain's streaming lookahead) settles. Otherwise the loop sleeps on the
+// event queue and calls resume() when it wakes, so the idle time never shows up as a frame delta.
+// ------------------------------------------------------------------------------------------------
+class FramePacer
+{
+public:
+    static const unsigned int SETTLE_FRAMES = 3;
+
+    // fpsCap 0 leaves the frame rate to the swap interval
+    void init(double fpsCap, bool renderOnDemand)
+    {
+        period = fpsCap > 0.0 ? 1.0 / fpsCap : 0.0;
+        onDemand = renderOnDemand;
+        settle = SETTLE_FRAMES;
+#ifdef _WIN32
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (!timer)
+            timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+#endif
+    }
+
+    // seconds since the previous frame began (0 for the first)
+    double beginFrame()
+    {
+        double now = clock.now();
+        double delta = frameBegin < 0.0 ? 0.0 : now - frameBegin;
+        frameBegin = now;
+        return delta;
+    }
+
+    // whether this frame has to be drawn; changed: the camera, viewport or scene moved since the last one
+    bool needsFrame(bool changed)
+    {
+        if (!onDemand)
+            return true;
+        if (changed)
+            settle = SETTLE_FRAMES;
+        if (settle == 0)
+        {
+            skipped++;
+            return false;
+        }
+        settle--;
+        return true;
+    }
+
+    // after the loop slept through an idle stretch: the next delta starts from here
+    void resume()
+    {
+        frameBegin = clock.now();
+        deadline = frameBegin;
+    }
+
+    // call after the swap: waits out the rest of the frame period
+    void endFrame()
+    {
+        rendered++;
+        double now = clock.now();
+        if (period > 0.0)
+        {
+            deadline = deadline <= 0.0 ? now + period : deadline + period;
+            if (deadline < now - period)
+            {
+                lateFrames++;
+                deadline = now;
+            }
+            else if (deadline < now)
+                lateFrames++;
+            else
+                waitUntil(deadline);
+        }
+        lastEnd = clock.now();
+        if (firstEnd < 0.0)
+            firstEnd = lastEnd;
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (rendered == 0)
+            return;
+        out << "frame pacing: ";
+        if (rendered > 1 && lastEnd > firstEnd)
+            out << (rendered - 1) / (lastEnd - firstEnd) << " fps achieved, ";
+        if (period > 0.0)
+            out << "cap " << 1.0 / period << " fps, " << lateFrames << " late frames, " << sleepTime * 1000.0 << " ms sleeping, "
+                << spinTime * 1000.0 << " ms spinning (margin " << spinMargin * 1000.0 << " ms)";
+        else
+            out << "uncapped";
+        if (onDemand)
+            out << ", on demand: " << rendered << " frames drawn, " << skipped << " skipped";
+        out << std::endl;
+    }
+
+    void destroy()
+    {
+#ifdef _WIN32
+        if (timer)
+            CloseHandle(timer);
+        timer = NULL;
+#endif
+    }
+
+private:
+    FrameClock clock;
+    double period = 0.0;
+    double frameBegin = -1.0;
+    double deadline = 0.0;
+    double firstEnd = -1.0;         // first and last frame ends, for the rate achieved
+    double lastEnd = 0.0;
+    double spinMargin = 0.002;      // sleeps stop this far short of the deadline
+    bool onDemand = false;
+    unsigned int settle = 0;
+
+    unsigned long long rendered = 0;
+    unsigned long long skipped = 0;
+    unsigned long long lateFrames = 0;
+    double sleepTime = 0.0;
+    double spinTime = 0.0;
+
+#ifdef _WIN32
+    HANDLE timer = NULL;
+#endif
+
+    void waitUntil(double target)
+    {
+        double sleepBegin = clock.now();
+        double remaining = target - sleepBegin - spinMargin;
+        if (remaining > 0.0)
+        {
+            sleepFor(remaining);
+            double woke = clock.now();
+            sleepTime += woke - sleepBegin;
+            // how late this sleep woke, kept as a slowly decaying maximum
+            double overshoot = std::max(woke - sleepBegin - remaining, 0.0);
+            spinMargin = std::min(std::max(std::max(spinMargin * 0.99, overshoot * 1.25), 0.0002), 0.004);
+        }
+        double spinBegin = clock.now();
+        while (clock.now() < target)
+            std::this_thread::yield();
+        spinTime += clock.now() - spinBegin;
+    }
+
+    void sleepFor(double seconds)
+    {
+#ifdef _WIN32
+        // Sleep() rounds to the scheduler tick, a high-resolution waitable timer doesn't
+        if (timer)
+        {
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG)(seconds * 1e7);
+            if (SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+            {
+                WaitForSingleObject(timer, INFINITE);
+                return;
+            }
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    }
+};
+
+#endif
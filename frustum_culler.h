@@ -0,0 +1,384 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include <glm/glm.hpp>
+
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+// world-space axis-aligned bounding box
+struct AABB
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+};
+
+// the six planes of a view frustum (left, right, bottom, top, near, far), normals pointing inwards
+// ------------------------------------------------------------------------------------------------
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // Gribb/Hartmann: each plane is the last row of projection * view plus or minus another row
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        Frustum frustum;
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        for (int i = 0; i < 3; i++)
+        {
+            frustum.planes[i * 2] = rows[3] + rows[i];
+            frustum.planes[i * 2 + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4& plane : frustum.planes)
+            plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+        return frustum;
+    }
+
+    // false only when the box is completely behind one of the planes
+    bool intersects(const AABB& box) const
+    {
+        glm::vec3 center = box.center(), extent = box.extent();
+        for (const glm::vec4& plane : planes)
+        {
+            glm::vec3 normal(plane);
+            if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+// 4-wide BVH over the bounding boxes of the scene objects, culled against a Frustum.
+//
+// Every node keeps the boxes of its (up to) four children side by side as center/extent arrays,
+// so one SSE pass over the six planes classifies all four children: outside, inside or crossing
+// a plane. Children that are completely inside hand over their whole subtree without further
+// tests (the objects of a subtree are contiguous), outside ones are dropped, only crossing ones
+// are descended into. Leaves hold up to 8 objects in the same layout and are tested 8 at a time
+// with AVX2 (two SSE passes otherwise). Without SSE2 the same code runs one box at a time.
+// ------------------------------------------------------------------------------------------------
+class BoundingVolumeHierarchy
+{
+public:
+    static const unsigned int LEAF_SIZE = 8;
+
+    // rebuilds the tree; the ids cull() returns are indices into boxes
+    void build(const std::vector<AABB>& boxes)
+    {
+        nodes.clear();
+        ids.resize(boxes.size());
+        std::iota(ids.begin(), ids.end(), 0u);
+        source = &boxes;
+        if (!boxes.empty())
+            buildNode(0, (uint32_t)boxes.size());
+        source = NULL;
+
+        // leaf order SoA, padded so full-width loads past the last object stay inside the arrays
+        size_t padded = boxes.size() + LEAF_SIZE;
+        for (std::vector<float>* array : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+            array->assign(padded, 0.0f);
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            glm::vec3 center = boxes[ids[i]].center(), extent = boxes[ids[i]].extent();
+            centerX[i] = center.x;
+            centerY[i] = center.y;
+            centerZ[i] = center.z;
+            extentX[i] = extent.x;
+            extentY[i] = extent.y;
+            extentZ[i] = extent.z;
+        }
+    }
+
+    // replaces visible with the ids of every box that is at least partly inside the frustum
+    void cull(const Frustum& frustum, std::vector<uint32_t>& visible)
+    {
+        auto start = std::chrono::steady_clock::now();
+        visible.clear();
+        nodesTested = 0;
+        boxesTested = 0;
+        if (!nodes.empty())
+        {
+            PlaneSet planes(frustum);
+            stack.clear();
+            stack.push_back(0);
+            while (!stack.empty())
+            {
+                const Node& node = nodes[stack.back()];
+                stack.pop_back();
+                nodesTested++;
+                uint32_t crossing;
+                uint32_t outside = classify4(planes, node.centerX, node.centerY, node.centerZ,
+                                             node.extentX, node.extentY, node.extentZ, crossing);
+                for (int k = 0; k < 4; k++)
+                {
+                    if (node.count[k] == 0 || (outside >> k) & 1)
+                        continue;
+                    if (!((crossing >> k) & 1))
+                        visible.insert(visible.end(), ids.begin() + node.first[k], ids.begin() + node.first[k] + node.count[k]);
+                    else if (node.child[k] >= 0)
+                        stack.push_back((uint32_t)node.child[k]);
+                    else
+                        cullLeaf(planes, node.first[k], node.count[k], visible);
+                }
+            }
+        }
+        std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+        lastMilliseconds = time.count();
+
+        frames++;
+        totalMilliseconds += lastMilliseconds;
+        maxMilliseconds = std::max(maxMilliseconds, lastMilliseconds);
+        totalVisible += visible.size();
+        totalNodesTested += nodesTested;
+        totalBoxesTested += boxesTested;
+    }
+
+    unsigned int objectCount() const { return (unsigned int)ids.size(); }
+    unsigned int nodeCount() const { return (unsigned int)nodes.size(); }
+    double lastCullMilliseconds() const { return lastMilliseconds; }
+
+    // per-frame averages over every cull() call
+    void report(std::ostream& out) const
+    {
+        if (frames == 0)
+            return;
+        double n = (double)frames;
+        double visible = totalVisible / n;
+        out << "culling: " << ids.size() << " objects in " << nodes.size() << " nodes, " << visible << " visible, "
+            << ids.size() - visible << " culled per frame, " << totalMilliseconds / n << " ms avg, " << maxMilliseconds
+            << " ms max (" << totalNodesTested / n << " nodes, " << totalBoxesTested / n << " leaf boxes tested, "
+            << (cpuHasAVX2() ? "avx2" : simdName()) << ")" << std::endl;
+    }
+
+private:
+    struct Node
+    {
+        float centerX[4], centerY[4], centerZ[4];
+        float extentX[4], extentY[4], extentZ[4];
+        int32_t child[4];       // inner node, -1 when the child is a leaf
+        uint32_t first[4];      // the child's objects: ids[first, first + count)
+        uint32_t count[4];      // 0 for an unused slot
+    };
+
+    // the planes split into broadcastable components, plus their absolute normals for the extent
+    struct PlaneSet
+    {
+        float normal[6][3];
+        float absNormal[6][3];
+        float distance[6];
+
+        explicit PlaneSet(const Frustum& frustum)
+        {
+            for (int p = 0; p < 6; p++)
+            {
+                for (int k = 0; k < 3; k++)
+                {
+                    normal[p][k] = frustum.planes[p][k];
+                    absNormal[p][k] = std::fabs(frustum.planes[p][k]);
+                }
+                distance[p] = frustum.planes[p].w;
+            }
+        }
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> ids;
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+    std::vector<uint32_t> stack;
+    const std::vector<AABB>* source = NULL;
+
+    unsigned int nodesTested = 0;
+    unsigned int boxesTested = 0;
+    double lastMilliseconds = 0.0;
+    unsigned long long frames = 0;
+    double totalMilliseconds = 0.0;
+    double maxMilliseconds = 0.0;
+    unsigned long long totalVisible = 0;
+    unsigned long long totalNodesTested = 0;
+    unsigned long long totalBoxesTested = 0;
+
+    static const char* simdName()
+    {
+#ifdef PYRAMID_SSE2
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    AABB bounds(uint32_t begin, uint32_t end) const
+    {
+        AABB box = (*source)[ids[begin]];
+        for (uint32_t i = begin + 1; i < end; i++)
+        {
+            box.min = glm::min(box.min, (*source)[ids[i]].min);
+            box.max = glm::max(box.max, (*source)[ids[i]].max);
+        }
+        return box;
+    }
+
+    // splits [begin, end) at the median centroid along the longest axis of the centroids
+    uint32_t split(uint32_t begin, uint32_t end)
+    {
+        glm::vec3 low = (*source)[ids[begin]].center(), high = low;
+        for (uint32_t i = begin + 1; i < end; i++)
+        {
+            low = glm::min(low, (*source)[ids[i]].center());
+            high = glm::max(high, (*source)[ids[i]].center());
+        }
+        glm::vec3 size = high - low;
+        int axis = size.x >= size.y && size.x >= size.z ? 0 : size.y >= size.z ? 1 : 2;
+        uint32_t middle = begin + (end - begin) / 2;
+        const std::vector<AABB>& boxes = *source;
+        std::nth_element(ids.begin() + begin, ids.begin() + middle, ids.begin() + end,
+                         [&boxes, axis](uint32_t a, uint32_t b) { return boxes[a].center()[axis] < boxes[b].center()[axis]; });
+        return middle;
+    }
+
+    // one node with up to four children: the range is halved, then the larger halves again
+    uint32_t buildNode(uint32_t begin, uint32_t end)
+    {
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+
+        uint32_t ranges[4][2] = { { begin, end } };
+        int parts = 1;
+        while (parts < 4)
+        {
+            int largest = 0;
+            for (int k = 1; k < parts; k++)
+                if (ranges[k][1] - ranges[k][0] > ranges[largest][1] - ranges[largest][0])
+                    largest = k;
+            if (ranges[largest][1] - ranges[largest][0] <= LEAF_SIZE)
+                break;
+            uint32_t middle = split(ranges[largest][0], ranges[largest][1]);
+            ranges[parts][0] = middle;
+            ranges[parts][1] = ranges[largest][1];
+            ranges[largest][1] = middle;
+            parts++;
+        }
+
+        for (int k = 0; k < 4; k++)
+        {
+            Node& node = nodes[index];
+            node.child[k] = -1;
+            node.first[k] = 0;
+            node.count[k] = 0;
+            node.centerX[k] = node.centerY[k] = node.centerZ[k] = 0.0f;
+            node.extentX[k] = node.extentY[k] = node.extentZ[k] = 0.0f;
+            if (k >= parts)
+                continue;
+            AABB box = bounds(ranges[k][0], ranges[k][1]);
+            glm::vec3 center = box.center(), extent = box.extent();
+            node.centerX[k] = center.x;
+            node.centerY[k] = center.y;
+            node.centerZ[k] = center.z;
+            node.extentX[k] = extent.x;
+            node.extentY[k] = extent.y;
+            node.extentZ[k] = extent.z;
+            node.first[k] = ranges[k][0];
+            node.count[k] = ranges[k][1] - ranges[k][0];
+            if (node.count[k] > LEAF_SIZE)
+            {
+                int32_t child = (int32_t)buildNode(ranges[k][0], ranges[k][1]);
+                nodes[index].child[k] = child; // buildNode may have moved the nodes
+            }
+        }
+        return index;
+    }
+
+    // tests 4 boxes against the planes: returns the mask of boxes outside of any plane, crossing
+    // gets the mask of boxes that straddle at least one plane
+    static uint32_t classify4(const PlaneSet& planes, const float* cx, const float* cy, const float* cz,
+                              const float* ex, const float* ey, const float* ez, uint32_t& crossing)
+    {
+#ifdef PYRAMID_SSE2
+        __m128 centerX = _mm_loadu_ps(cx), centerY = _mm_loadu_ps(cy), centerZ = _mm_loadu_ps(cz);
+        __m128 extentX = _mm_loadu_ps(ex), extentY = _mm_loadu_ps(ey), extentZ = _mm_loadu_ps(ez);
+        __m128 outside = _mm_setzero_ps(), straddle = _mm_setzero_ps();
+        const __m128 zero = _mm_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(planes.normal[p][0])),
+                                             _mm_mul_ps(centerY, _mm_set1_ps(planes.normal[p][1]))),
+                                  _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(planes.normal[p][2])), _mm_set1_ps(planes.distance[p])));
+            __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(planes.absNormal[p][0])),
+                                             _mm_mul_ps(extentY, _mm_set1_ps(planes.absNormal[p][1]))),
+                                  _mm_mul_ps(extentZ, _mm_set1_ps(planes.absNormal[p][2])));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            straddle = _mm_or_ps(straddle, _mm_cmplt_ps(_mm_sub_ps(d, r), zero));
+        }
+        crossing = (uint32_t)_mm_movemask_ps(straddle);
+        return (uint32_t)_mm_movemask_ps(outside);
+#else
+        uint32_t outside = 0;
+        crossing = 0;
+        for (int k = 0; k < 4; k++)
+            for (int p = 0; p < 6; p++)
+            {
+                float d = cx[k] * planes.normal[p][0] + cy[k] * planes.normal[p][1] + cz[k] * planes.normal[p][2] + planes.distance[p];
+                float r = ex[k] * planes.absNormal[p][0] + ey[k] * planes.absNormal[p][1] + ez[k] * planes.absNormal[p][2];
+                outside |= (d + r < 0.0f ? 1u : 0u) << k;
+                crossing |= (d - r < 0.0f ? 1u : 0u) << k;
+            }
+        return outside;
+#endif
+    }
+
+#ifdef PYRAMID_SSE2
+    // 8 boxes per plane test; returns the mask of boxes outside of any plane
+    PYRAMID_TARGET_AVX2 static uint32_t outside8AVX2(const PlaneSet& planes, const float* cx, const float* cy, const float* cz,
+                                                     const float* ex, const float* ey, const float* ez)
+    {
+        __m256 centerX = _mm256_loadu_ps(cx), centerY = _mm256_loadu_ps(cy), centerZ = _mm256_loadu_ps(cz);
+        __m256 extentX = _mm256_loadu_ps(ex), extentY = _mm256_loadu_ps(ey), extentZ = _mm256_loadu_ps(ez);
+        __m256 outside = _mm256_setzero_ps();
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(planes.normal[p][0])),
+                                                   _mm256_mul_ps(centerY, _mm256_set1_ps(planes.normal[p][1]))),
+                                     _mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(planes.normal[p][2])), _mm256_set1_ps(planes.distance[p])));
+            __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(extentX, _mm256_set1_ps(planes.absNormal[p][0])),
+                                                   _mm256_mul_ps(extentY, _mm256_set1_ps(planes.absNormal[p][1]))),
+                                     _mm256_mul_ps(extentZ, _mm256_set1_ps(planes.absNormal[p][2])));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        return (uint32_t)_mm256_movemask_ps(outside);
+    }
+#endif
+
+    void cullLeaf(const PlaneSet& planes, uint32_t first, uint32_t count, std::vector<uint32_t>& visible)
+    {
+        boxesTested += count;
+        uint32_t outside;
+#ifdef PYRAMID_SSE2
+        if (cpuHasAVX2())
+            outside = outside8AVX2(planes, &centerX[first], &centerY[first], &centerZ[first], &extentX[first], &extentY[first], &extentZ[first]);
+        else
+#endif
+        {
+            uint32_t crossing;
+            outside = classify4(planes, &centerX[first], &centerY[first], &centerZ[first], &extentX[first], &extentY[first], &extentZ[first], crossing);
+            if (count > 4)
+                outside |= classify4(planes, &centerX[first + 4], &centerY[first + 4], &centerZ[first + 4],
+                                     &extentX[first + 4], &extentY[first + 4], &extentZ[first + 4], crossing) << 4;
+        }
+        for (uint32_t k = 0; k < count; k++)
+            if (!((outside >> k) & 1))
+                visible.push_back(ids[first + k]);
+    }
+};
+
+#endif
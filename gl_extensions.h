@@ -0,0 +1,153 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// entry points and enums newer than the GL 3.3 core loader in glad.c; they are looked up at
+// runtime with the same loader glad used and are only called when the matching flag is set
+// ------------------------------------------------------------------------------------------
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (APIENTRYP PFN_glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFN_glProgramBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFN_glProgramParameteri)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFN_glDispatchCompute)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+typedef void (APIENTRYP PFN_glMemoryBarrier)(GLbitfield barriers);
+typedef void (APIENTRYP PFN_glMultiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+typedef void (APIENTRYP PFN_glBufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// one record of GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect (GL 4.3)
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+struct GLExtensions
+{
+    // GL 4.1 / GL_ARB_get_program_binary
+    bool programBinary = false;
+    PFN_glGetProgramBinary GetProgramBinary = NULL;
+    PFN_glProgramBinary ProgramBinary = NULL;
+    PFN_glProgramParameteri ProgramParameteri = NULL;
+
+    // GL_EXT_texture_compression_s3tc (BC1/BC3), enums only
+    bool textureCompressionS3TC = false;
+
+    // GL 4.3: compute shaders writing shader storage buffers, and draws read from a buffer
+    bool computeShader = false;
+    PFN_glDispatchCompute DispatchCompute = NULL;
+    PFN_glMemoryBarrier MemoryBarrier = NULL;
+    bool multiDrawIndirect = false;
+    PFN_glMultiDrawElementsIndirect MultiDrawElementsIndirect = NULL;
+
+    // GL 4.4 / GL_ARB_buffer_storage: immutable buffers that can stay mapped while the GPU reads them
+    bool bufferStorage = false;
+    PFN_glBufferStorage BufferStorage = NULL;
+};
+
+inline GLExtensions& glExt()
+{
+    static GLExtensions extensions;
+    return extensions;
+}
+
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline bool hasGLVersion(int major, int minor)
+{
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+// call once after gladLoadGLLoader, with the same loader
+inline void loadGLExtensions(GLADloadproc load)
+{
+    GLExtensions& ext = glExt();
+
+    if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        ext.GetProgramBinary = (PFN_glGetProgramBinary)load("glGetProgramBinary");
+        ext.ProgramBinary = (PFN_glProgramBinary)load("glProgramBinary");
+        ext.ProgramParameteri = (PFN_glProgramParameteri)load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ext.programBinary = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && formats > 0;
+    }
+
+    ext.textureCompressionS3TC = hasGLExtension("GL_EXT_texture_compression_s3tc");
+
+    // the extension equivalents would need their own enum names, the version check keeps it simple
+    if (hasGLVersion(4, 3))
+    {
+        ext.DispatchCompute = (PFN_glDispatchCompute)load("glDispatchCompute");
+        ext.MemoryBarrier = (PFN_glMemoryBarrier)load("glMemoryBarrier");
+        ext.computeShader = ext.DispatchCompute && ext.MemoryBarrier;
+        ext.MultiDrawElementsIndirect = (PFN_glMultiDrawElementsIndirect)load("glMultiDrawElementsIndirect");
+        ext.multiDrawIndirect = ext.MultiDrawElementsIndirect != NULL;
+    }
+
+    if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+    {
+        ext.BufferStorage = (PFN_glBufferStorage)load("glBufferStorage");
+        ext.bufferStorage = ext.BufferStorage != NULL;
+    }
+}
+
+#endif
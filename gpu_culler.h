@@ -0,0 +1,229 @@
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frustum_culler.h"
+#include "gl_extensions.h"
+#include "hiz_buffer.h"
+#include "instance_batch.h"
+#include "render_queue.h"
+#include "shader.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// frustum culling of an InstanceBatch on the GPU (GL 4.3). The instance boxes and the instances
+// stay in shader storage buffers; every frame a compute shader tests all of them and writes the
+// survivors into a visible-instance buffer plus the instanceCount of one indirect draw command
+// per mesh, which a single glMultiDrawElementsIndirect then consumes. The CPU never sees the
+// instances again, so it issues the same few calls whatever the number of instances.
+//
+// The visible buffer keeps the batch's layout (every mesh owns its range, starting at the
+// command's baseInstance), so one VAO over it serves every mesh.
+//
+// With a HiZBuffer the survivors of the frustum test are also tested for occlusion. The counts
+// are copied into a ring of STAT_SLOTS small buffers and read back STAT_SLOTS - 1 frames later,
+// like the GpuTimer queries, so the statistics never wait for the frame that produced them.
+// ------------------------------------------------------------------------------------------------
+class GpuCuller
+{
+public:
+    static const unsigned int GROUP_SIZE = 64;     // local_size_x of the compute shader
+    static const unsigned int STAT_SLOTS = 4;
+
+    // compute shaders and multi-draw indirect, i.e. a 4.3 context
+    static bool supported()
+    {
+        return glExt().computeShader && glExt().multiDrawIndirect;
+    }
+
+    // uploads the batch (after its build()); false when the compute shader doesn't link
+    bool init(const InstanceBatch& batch, const char* computePath)
+    {
+        std::string computeCode;
+        if (!Shader::readFile(computePath, computeCode))
+            return false;
+        unsigned int program = Shader::compileComputeProgram(computeCode);
+        if (!Shader::linked(program))
+        {
+            glDeleteProgram(program);
+            return false;
+        }
+        shader = Shader(program);
+
+        objectCount = batch.totalInstances();
+        std::vector<AABB> boxes = batch.instanceBounds();
+        std::vector<glm::vec4> bounds(boxes.size() * 2);
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            bounds[i * 2] = glm::vec4(boxes[i].center(), (float)batch.instanceMeshes()[i]);
+            bounds[i * 2 + 1] = glm::vec4(boxes[i].extent(), 0.0f);
+        }
+        // the template every frame starts from: the batch's commands with no instances yet, then
+        // the occluded counter
+        std::vector<DrawElementsIndirectCommand> commands(batch.meshCount());
+        for (unsigned int id = 0; id < batch.meshCount(); id++)
+        {
+            commands[id] = batch.indirectCommand(id);
+            commands[id].instanceCount = 0;
+        }
+        commandCount = (GLsizei)commands.size();
+        commandBytes = commands.size() * sizeof(DrawElementsIndirectCommand) + sizeof(GLuint);
+        std::vector<unsigned char> commandData(commandBytes, 0);
+        if (!commands.empty())
+            memcpy(commandData.data(), commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+
+        // SSBOs are plain buffer objects, they are created through the copy target like the EBOs
+        size_t instanceBytes = batch.instances().size() * sizeof(InstanceData);
+        boundsBuffer = createBuffer(bounds.size() * sizeof(glm::vec4), bounds.data(), GL_STATIC_DRAW);
+        instanceBuffer = createBuffer(instanceBytes, batch.instances().data(), GL_STATIC_DRAW);
+        visibleBuffer = createBuffer(instanceBytes, NULL, GL_DYNAMIC_COPY);
+        commandTemplate = createBuffer(commandBytes, commandData.data(), GL_STATIC_DRAW);
+        commandBuffer = createBuffer(commandBytes, NULL, GL_DYNAMIC_COPY);
+        for (unsigned int& slot : statSlots)
+            slot = createBuffer(commandBytes, NULL, GL_STREAM_READ);
+        VAO = batch.createVertexArray(visibleBuffer, 0);
+        return true;
+    }
+
+    // resets the commands, culls every instance and makes the results visible to the next draws.
+    // hiz (ready, built with viewProjection) adds the occlusion test
+    void cull(const Frustum& frustum, const glm::mat4& viewProjection, const HiZBuffer* hiz = NULL)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, commandTemplate);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandBytes);
+
+        bool occlusion = hiz && hiz->ready();
+        shader.use();
+        glUniform4fv(shader.location("planes"), 6, &frustum.planes[0][0]);
+        glUniform1ui(shader.location("objectCount"), objectCount);
+        glUniform1ui(shader.location("occludedCounter"), (GLuint)commandCount * 5);
+        shader.setBool("occlusion", occlusion);
+        shader.setMat4("viewProjection", viewProjection);
+        shader.setInt("hiz", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, occlusion ? hiz->depthTexture() : 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+        glExt().DispatchCompute((objectCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        glExt().MemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // this frame's counts go to the ring, the oldest slot comes back
+        unsigned int slot = frames % STAT_SLOTS;
+        slotOcclusion[slot] = occlusion;
+        glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, statSlots[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandBytes);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        frames++;
+        if (frames >= STAT_SLOTS)
+            readStats(frames % STAT_SLOTS);
+    }
+
+    // the geometry half of the queue item drawing every visible instance; the caller fills in
+    // pass, program and texture
+    DrawItem drawItem() const
+    {
+        DrawItem item;
+        item.VAO = VAO;
+        item.mode = GL_TRIANGLES;
+        item.indexType = GL_UNSIGNED_INT;
+        item.indirectBuffer = commandBuffer;
+        item.indirectCount = commandCount;
+        return item;
+    }
+
+    // true once cull() ran, so drawItem() draws something defined
+    bool culled() const { return frames > 0; }
+
+    // last frame read back (STAT_SLOTS - 1 frames old)
+    unsigned int lastVisible() const { return visibleCount; }
+    unsigned int lastOccluded() const { return occludedCount; }
+
+    // per-frame averages over the frames read back so far
+    void report(std::ostream& out) const
+    {
+        if (statFrames == 0)
+            return;
+        double n = (double)statFrames;
+        double visible = totalVisible / n;
+        double occluded = totalOccluded / n;
+        out << "gpu culling: " << objectCount << " instances, " << visible << " visible, "
+            << objectCount - visible - occluded << " outside the frustum, " << occluded << " occluded per frame";
+        if (occlusionFrames > 0)
+            out << " (" << totalOccluded / (double)occlusionFrames << " per Hi-Z frame)";
+        out << ", " << commandCount << " indirect draws per frame" << std::endl;
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        unsigned int buffers[] = { boundsBuffer, instanceBuffer, visibleBuffer, commandTemplate, commandBuffer };
+        glDeleteBuffers(5, buffers);
+        glDeleteBuffers(STAT_SLOTS, statSlots);
+        glDeleteProgram(shader.ID);
+        VAO = boundsBuffer = instanceBuffer = visibleBuffer = commandTemplate = commandBuffer = 0;
+        shader = Shader();
+    }
+
+private:
+    Shader shader;
+    unsigned int boundsBuffer = 0;
+    unsigned int instanceBuffer = 0;
+    unsigned int visibleBuffer = 0;
+    unsigned int commandTemplate = 0;
+    unsigned int commandBuffer = 0;
+    unsigned int statSlots[STAT_SLOTS] = {};
+    bool slotOcclusion[STAT_SLOTS] = {};
+    unsigned int VAO = 0;
+    unsigned int objectCount = 0;
+    GLsizei commandCount = 0;
+    size_t commandBytes = 0;
+    unsigned int frames = 0;
+
+    std::vector<GLuint> statData;
+    unsigned int visibleCount = 0;
+    unsigned int occludedCount = 0;
+    unsigned int statFrames = 0;
+    unsigned int occlusionFrames = 0;
+    double totalVisible = 0.0;
+    double totalOccluded = 0.0;
+
+    void readStats(unsigned int slot)
+    {
+        statData.resize(commandBytes / sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, statSlots[slot]);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, commandBytes, statData.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        visibleCount = 0;
+        for (GLsizei command = 0; command < commandCount; command++)
+            visibleCount += statData[command * 5 + 1];
+        occludedCount = statData[commandCount * 5];
+        statFrames++;
+        occlusionFrames += slotOcclusion[slot];
+        totalVisible += visibleCount;
+        totalOccluded += occludedCount;
+    }
+
+    static unsigned int createBuffer(size_t size, const void* data, GLenum usage)
+    {
+        unsigned int buffer = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer;
+    }
+};
+
+#endif
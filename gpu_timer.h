@@ -0,0 +1,229 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// per-pass GPU timing with GL_TIME_ELAPSED queries
+//
+// every pass owns one query per frame slot; the slots form a ring of FRAME_SLOTS frames so
+// results are read back a few frames late, and only once GL_QUERY_RESULT_AVAILABLE says they
+// are ready. A slot that is still pending when it comes around again is dropped instead of
+// waited on, so the timer never stalls the pipeline.
+// -------------------------------------------------------------------------------------------
+class GpuTimer
+{
+public:
+    static const unsigned int FRAME_SLOTS = 4;
+
+    void init(const std::vector<std::string>& names, unsigned int averageWindow = 64)
+    {
+        passNames = names;
+        window = averageWindow > 0 ? averageWindow : 1;
+        queries.assign(FRAME_SLOTS * passNames.size(), 0);
+        glGenQueries((GLsizei)queries.size(), queries.data());
+        for (unsigned int i = 0; i < FRAME_SLOTS; i++)
+        {
+            slots[i].pending = false;
+            slots[i].used.assign(passNames.size(), false);
+        }
+        history.assign(passNames.size() * window, 0.0);
+        sums.assign(passNames.size(), 0.0);
+        lastResult.assign(passNames.size(), 0.0);
+        samples = 0;
+        frame = 0;
+        current = 0;
+        activePass = -1;
+        dropped = 0;
+    }
+
+    void destroy()
+    {
+        if (!queries.empty())
+            glDeleteQueries((GLsizei)queries.size(), queries.data());
+        queries.clear();
+        if (csv.is_open())
+            csv.close();
+    }
+
+    // optional: one row per resolved frame with the time of every pass in milliseconds
+    bool openCsv(const std::string& path)
+    {
+        csv.open(path.c_str());
+        if (!csv.is_open())
+        {
+            std::cout << "GPU timer: failed to open " << path << std::endl;
+            return false;
+        }
+        csv << "frame";
+        for (const std::string& name : passNames)
+            csv << "," << name;
+        csv << "\n";
+        return true;
+    }
+
+    // reads back whatever finished since last time, then claims the next slot of the ring
+    void beginFrame()
+    {
+        if (!enabled())
+            return;
+        collect();
+        Slot& slot = slots[current];
+        if (slot.pending)
+        {
+            // the GPU is more than FRAME_SLOTS frames behind, give up on this one
+            dropped++;
+            slot.pending = false;
+        }
+        slot.frame = frame;
+        slot.used.assign(passNames.size(), false);
+    }
+
+    void begin(unsigned int pass)
+    {
+        if (!enabled())
+            return;
+        if (activePass >= 0)
+            end();
+        glBeginQuery(GL_TIME_ELAPSED, query(current, pass));
+        slots[current].used[pass] = true;
+        activePass = (int)pass;
+    }
+
+    void end()
+    {
+        if (activePass < 0)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        activePass = -1;
+    }
+
+    void endFrame()
+    {
+        if (!enabled())
+            return;
+        end();
+        slots[current].pending = true;
+        current = (current + 1) % FRAME_SLOTS;
+        frame++;
+    }
+
+    // a timer that was never init()ed ignores begin/end, so call sites don't need to check
+    bool enabled() const { return !queries.empty(); }
+
+    // rolling average over the last averageWindow resolved frames, in milliseconds
+    double average(unsigned int pass) const
+    {
+        unsigned int count = samples < window ? samples : window;
+        return count > 0 ? sums[pass] / count : 0.0;
+    }
+
+    // most recently resolved frame, in milliseconds
+    double latest(unsigned int pass) const { return lastResult[pass]; }
+
+    unsigned int passCount() const { return (unsigned int)passNames.size(); }
+    const std::string& passName(unsigned int pass) const { return passNames[pass]; }
+    unsigned int resolvedFrames() const { return samples; }
+    unsigned int droppedFrames() const { return dropped; }
+
+    void report(std::ostream& out) const
+    {
+        out << "GPU pass times (avg of last " << (samples < window ? samples : window) << " frames, ms):" << std::endl;
+        double total = 0.0;
+        for (unsigned int i = 0; i < passNames.size(); i++)
+        {
+            out << "  " << passNames[i] << ": " << average(i) << std::endl;
+            total += average(i);
+        }
+        out << "  total: " << total << std::endl;
+        if (dropped > 0)
+            out << "  dropped frames: " << dropped << std::endl;
+    }
+
+private:
+    struct Slot
+    {
+        bool pending = false;
+        unsigned int frame = 0;
+        std::vector<bool> used;
+    };
+
+    std::vector<std::string> passNames;
+    std::vector<unsigned int> queries;
+    Slot slots[FRAME_SLOTS];
+    unsigned int current = 0;
+    unsigned int frame = 0;
+    int activePass = -1;
+    unsigned int dropped = 0;
+
+    unsigned int window = 64;
+    unsigned int samples = 0;
+    std::vector<double> history;
+    std::vector<double> sums;
+    std::vector<double> lastResult;
+    std::ofstream csv;
+
+    unsigned int query(unsigned int slot, unsigned int pass) const
+    {
+        return queries[slot * passNames.size() + pass];
+    }
+
+    // resolve pending slots oldest first; stop at the first one that isn't ready yet
+    void collect()
+    {
+        for (unsigned int i = 0; i < FRAME_SLOTS; i++)
+        {
+            unsigned int index = (current + i) % FRAME_SLOTS;
+            Slot& slot = slots[index];
+            if (!slot.pending)
+                continue;
+            if (!resolve(index))
+                break;
+            slot.pending = false;
+        }
+    }
+
+    bool resolve(unsigned int index)
+    {
+        const Slot& slot = slots[index];
+        for (unsigned int pass = 0; pass < passNames.size(); pass++)
+        {
+            if (!slot.used[pass])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(query(index, pass), GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return false;
+        }
+
+        unsigned int position = samples % window;
+        if (csv.is_open())
+            csv << slot.frame;
+        for (unsigned int pass = 0; pass < passNames.size(); pass++)
+        {
+            double ms = 0.0;
+            if (slot.used[pass])
+            {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query(index, pass), GL_QUERY_RESULT, &elapsed);
+                ms = elapsed / 1000000.0;
+            }
+            double& old = history[pass * window + position];
+            sums[pass] += ms - (samples >= window ? old : 0.0);
+            old = ms;
+            lastResult[pass] = ms;
+            if (csv.is_open())
+                csv << "," << ms;
+        }
+        if (csv.is_open())
+            csv << "\n";
+        samples++;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef PYRAMID_HEADLESS
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// collects per-frame times (in milliseconds) and prints the summary line
+// ----------------------------------------------------------------------
+class FrameStats
+{
+public:
+    void add(double milliseconds)
+    {
+        samples.push_back(milliseconds);
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (samples.empty())
+        {
+            out << "no frames recorded" << std::endl;
+            return;
+        }
+
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double s : sorted)
+            total += s;
+        double avg = total / sorted.size();
+
+        out << "frames: " << sorted.size() << std::endl;
+        out << "frame time ms: min " << sorted.front()
+            << " avg " << avg
+            << " p50 " << percentile(sorted, 0.50)
+            << " p95 " << percentile(sorted, 0.95)
+            << " p99 " << percentile(sorted, 0.99) << std::endl;
+        out << "fps: " << (total > 0.0 ? 1000.0 * sorted.size() / total : 0.0) << std::endl;
+    }
+
+private:
+    std::vector<double> samples;
+
+    // nearest-rank percentile on an already sorted list
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        size_t rank = (size_t)(p * sorted.size() + 0.5);
+        rank = std::min(std::max(rank, (size_t)1), sorted.size());
+        return sorted[rank - 1];
+    }
+};
+
+// framebuffer object with color + depth renderbuffers, used as the render target when there is no window
+// ------------------------------------------------------------------------------------------------------
+class OffscreenTarget
+{
+public:
+    unsigned int FBO = 0;
+
+    bool create(unsigned int width, unsigned int height)
+    {
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (!complete)
+            std::cout << "Offscreen framebuffer is not complete" << std::endl;
+        glViewport(0, 0, width, height);
+        return complete;
+    }
+
+    void destroy()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(1, &colorRBO);
+        glDeleteRenderbuffers(1, &depthRBO);
+        glDeleteFramebuffers(1, &FBO);
+    }
+
+private:
+    unsigned int colorRBO = 0;
+    unsigned int depthRBO = 0;
+};
+
+#ifdef PYRAMID_HEADLESS
+// surfaceless EGL context (Mesa llvmpipe works fine here), no display server required
+// ---------------------------------------------------------------------------------
+class HeadlessContext
+{
+public:
+    bool create(int major, int minor)
+    {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+        {
+            std::cout << "Failed to initialize EGL display" << std::endl;
+            return false;
+        }
+
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            std::cout << "EGL_KHR_surfaceless_context is not supported" << std::endl;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cout << "Failed to bind the desktop OpenGL API" << std::endl;
+            return false;
+        }
+
+        // eglChooseConfig defaults to window surfaces, which the surfaceless platform doesn't have
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            std::cout << "No suitable EGL config" << std::endl;
+            return false;
+        }
+
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "Failed to create a GL " << major << "." << minor << " core EGL context" << std::endl;
+            return false;
+        }
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "Failed to make EGL context current" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void destroy()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+    }
+
+    static void* getProcAddress(const char* name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+
+private:
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+#endif
+
+#endif
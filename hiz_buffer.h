@@ -0,0 +1,149 @@
+#ifndef HIZ_BUFFER_H
+#define HIZ_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// hierarchical depth buffer for occlusion culling: a depth texture rendered between begin() and
+// end(), after which end() reduces it into a full mip chain where every texel holds the farthest
+// depth of the area it covers. A box whose nearest depth is behind that value is hidden.
+//
+// The depth is a texture of its own rather than the frame's depth buffer, which is a renderbuffer
+// (or the window's) and can't be sampled: the caller draws its occluders into it with the frame's
+// own camera, so the test needs no reprojection.
+// ------------------------------------------------------------------------------------------------
+class HiZBuffer
+{
+public:
+    // reduce is the 6.4.hiz program; the buffer is (re)allocated by resize()
+    void init(const Shader& reduceShader)
+    {
+        reduce = reduceShader;
+        glGenVertexArrays(1, &emptyVAO);
+    }
+
+    // reallocates the pyramid when the viewport size changed; the old contents are gone
+    void resize(unsigned int newWidth, unsigned int newHeight)
+    {
+        if (newWidth == width && newHeight == height)
+            return;
+        release();
+        width = std::max(newWidth, 1u);
+        height = std::max(newHeight, 1u);
+        levels = 1;
+        while ((std::max(width, height) >> levels) > 0)
+            levels++;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (unsigned int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_DEPTH_COMPONENT32F, levelWidth(level), levelHeight(level), 0,
+                         GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLint currentFramebuffer = 0;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFramebuffer);
+        framebuffers.assign(levels, 0);
+        glGenFramebuffers(levels, framebuffers.data());
+        for (unsigned int level = 0; level < levels; level++)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[level]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, level);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Hi-Z framebuffer level " << level << " is not complete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)currentFramebuffer);
+        valid = false;
+    }
+
+    // redirects depth-only drawing into level 0; the current framebuffer and viewport come back in end()
+    void begin()
+    {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, previousViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[0]);
+        glViewport(0, 0, width, height);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // builds the mip chain, one full-screen pass per level
+    void end()
+    {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_ALWAYS);
+        reduce.use();
+        glBindVertexArray(emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (unsigned int level = 1; level < levels; level++)
+        {
+            // only the source level is visible to the shader, so reading and writing never overlap
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[level]);
+            glViewport(0, 0, levelWidth(level), levelHeight(level));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LESS);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFramebuffer);
+        glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+        valid = true;
+    }
+
+    // false until the first end() after a resize
+    bool ready() const { return valid; }
+    unsigned int depthTexture() const { return texture; }
+    unsigned int levelCount() const { return levels; }
+    unsigned int levelWidth(unsigned int level) const { return std::max(width >> level, 1u); }
+    unsigned int levelHeight(unsigned int level) const { return std::max(height >> level, 1u); }
+
+    void destroy()
+    {
+        release();
+        glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+        width = height = 0;
+    }
+
+private:
+    Shader reduce;
+    unsigned int emptyVAO = 0;
+    unsigned int texture = 0;
+    std::vector<unsigned int> framebuffers;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int levels = 0;
+    bool valid = false;
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4] = { 0, 0, 0, 0 };
+
+    void release()
+    {
+        if (!framebuffers.empty())
+            glDeleteFramebuffers((GLsizei)framebuffers.size(), framebuffers.data());
+        framebuffers.clear();
+        glDeleteTextures(1, &texture);
+        texture = 0;
+        valid = false;
+    }
+};
+
+#endif
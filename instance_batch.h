@@ -0,0 +1,529 @@
+#ifndef INSTANCE_BATCH_H
+#define INSTANCE_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "frustum_culler.h"
+#include "gl_extensions.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// per-instance vertex attributes 3 and 4 of shaders/6.2.instanced.vs
+struct InstanceData
+{
+    glm::vec4 positionYaw;   // xyz: world position of the mesh origin, w: rotation about +Y in radians
+    glm::vec4 scaleLayer;    // xyz: scale, w: layer in the material texture array
+};
+
+// how InstanceBatch::uploadVisible picks a level of detail: the coarsest level whose error, seen at the
+// distance of the instance's bounding sphere, stays below maxError pixels
+struct LodSelection
+{
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float pixelsPerUnit = 1.0f;     // viewport height / (2 tan(fovy / 2)): pixels per world unit at distance 1
+    float maxError = 1.0f;
+    float hysteresis = 0.25f;       // going coarser needs the error this far below maxError, so nothing flickers at the edge
+};
+
+// canonical meshes drawn many times each with glDrawElementsInstancedBaseVertex: the meshes share
+// one float VBO and one index buffer, the instances one buffer of InstanceData grouped by mesh.
+// Every mesh has its own VAO whose instance attributes start at the mesh's first instance (GL 3.3
+// has no base instance), so each mesh is one draw call whatever its instance count.
+//
+// The instances stay on the CPU as well: uploadVisible() uploads only the instances that survived
+// culling, every level's back to back, into instanceVBO or a RingBuffer's current frame region, and
+// points the instance attributes of each VAO in use at its level's run. The upload is as large as
+// what is visible, not as the whole batch.
+//
+// A mesh may come with a chain of levels of detail over its vertices. Every level then has a VAO
+// of its own, and uploadVisible() sorts each visible instance into the level its projected error
+// allows, one draw per level used.
+//
+// build() uploads what addMesh()/addInstance() collected; load() uploads a batch built earlier (a
+// SceneFile's, straight from the mapping).
+// ------------------------------------------------------------------------------------------------
+class InstanceBatch
+{
+public:
+    static const unsigned int FLOATS_PER_VERTEX = 5;
+
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+    unsigned int instanceVBO = 0;
+
+    static const unsigned int MAX_LODS = 8;
+
+    // a mesh as a scene file stores it: its vertices, its levels' index ranges and its instances
+    struct MeshRecord
+    {
+        GLint baseVertex;
+        unsigned int vertexCount;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        unsigned int firstInstance;
+        unsigned int instanceCount;
+        unsigned int lodCount;
+        struct { unsigned int firstIndex; GLsizei indexCount; float error; } lods[MAX_LODS];
+    };
+
+    // copies a canonical mesh (5 floats per vertex, modelled around its origin) and returns its id;
+    // lods (from generateLodChain, level 0 first) replace the mesh's own indices when given
+    unsigned int addMesh(const IndexedMesh& mesh, const std::vector<MeshLod>& lods = std::vector<MeshLod>())
+    {
+        Mesh range;
+        range.baseVertex = (GLint)(vertices.size() / FLOATS_PER_VERTEX);
+        range.vertexCount = (unsigned int)mesh.vertexCount();
+        for (size_t v = 0; v < mesh.vertexCount(); v++)
+        {
+            const float* p = &mesh.vertices[v * mesh.floatsPerVertex];
+            glm::vec3 position(p[0], p[1], p[2]);
+            range.boundsMin = v == 0 ? position : glm::min(range.boundsMin, position);
+            range.boundsMax = v == 0 ? position : glm::max(range.boundsMax, position);
+            vertices.insert(vertices.end(), p, p + FLOATS_PER_VERTEX);
+        }
+        for (size_t level = 0; level < std::max(lods.size(), (size_t)1) && level < MAX_LODS; level++)
+        {
+            const std::vector<unsigned int>& levelIndices = lods.empty() ? mesh.indices : lods[level].indices;
+            Lod lod;
+            lod.firstIndex = (unsigned int)indices.size();
+            lod.indexCount = (GLsizei)levelIndices.size();
+            lod.error = lods.empty() ? 0.0f : lods[level].error;
+            indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+            range.lods.push_back(lod);
+        }
+        range.firstIndex = range.lods[0].firstIndex;
+        range.indexCount = range.lods[0].indexCount;
+        meshes.push_back(range);
+        return (unsigned int)meshes.size() - 1;
+    }
+
+    // call before build()
+    void addInstance(unsigned int mesh, const InstanceData& instance)
+    {
+        meshes[mesh].instances.push_back(instance);
+    }
+
+    // keepSources keeps the vertices and indices for sourceVertices() / sourceIndices() (to write a
+    // scene file)
+    void build(bool keepSources = false)
+    {
+        instanceData.clear();
+        instanceMesh.clear();
+        for (unsigned int id = 0; id < meshes.size(); id++)
+        {
+            Mesh& mesh = meshes[id];
+            mesh.firstInstance = (unsigned int)instanceData.size();
+            mesh.instanceCount = (unsigned int)mesh.instances.size();
+            instanceData.insert(instanceData.end(), mesh.instances.begin(), mesh.instances.end());
+            mesh.instances.clear();
+            mesh.instances.shrink_to_fit();
+        }
+        upload(vertices.data(), vertices.size(), indices.data(), indices.size(), instanceData.data());
+        if (!keepSources)
+            releaseSources();
+    }
+
+    // a batch built earlier: vertices, indices and instances go to glBufferData as they are (they
+    // may point into a mapped scene file); the instances are also copied, culling reads them
+    void load(const MeshRecord* records, size_t meshCount, const float* vertexData, size_t floatCount, const unsigned int* indexData,
+              size_t indexCount, const InstanceData* instances, size_t instanceCount)
+    {
+        meshes.assign(meshCount, Mesh());
+        for (size_t id = 0; id < meshCount; id++)
+        {
+            const MeshRecord& record = records[id];
+            Mesh& mesh = meshes[id];
+            mesh.baseVertex = record.baseVertex;
+            mesh.vertexCount = record.vertexCount;
+            mesh.boundsMin = record.boundsMin;
+            mesh.boundsMax = record.boundsMax;
+            mesh.firstInstance = record.firstInstance;
+            mesh.instanceCount = record.instanceCount;
+            for (unsigned int level = 0; level < record.lodCount && level < MAX_LODS; level++)
+            {
+                Lod lod;
+                lod.firstIndex = record.lods[level].firstIndex;
+                lod.indexCount = record.lods[level].indexCount;
+                lod.error = record.lods[level].error;
+                mesh.lods.push_back(lod);
+            }
+            mesh.firstIndex = mesh.lods[0].firstIndex;
+            mesh.indexCount = mesh.lods[0].indexCount;
+        }
+        instanceData.assign(instances, instances + instanceCount);
+        upload(vertexData, floatCount, indexData, indexCount, instances);
+    }
+
+    // the mesh table as load() takes it
+    std::vector<MeshRecord> meshRecords() const
+    {
+        std::vector<MeshRecord> records(meshes.size());
+        for (size_t id = 0; id < meshes.size(); id++)
+        {
+            const Mesh& mesh = meshes[id];
+            MeshRecord& record = records[id];
+            record.baseVertex = mesh.baseVertex;
+            record.vertexCount = mesh.vertexCount;
+            record.boundsMin = mesh.boundsMin;
+            record.boundsMax = mesh.boundsMax;
+            record.firstInstance = mesh.firstInstance;
+            record.instanceCount = mesh.instanceCount;
+            record.lodCount = (unsigned int)mesh.lods.size();
+            for (size_t level = 0; level < mesh.lods.size(); level++)
+            {
+                record.lods[level].firstIndex = mesh.lods[level].firstIndex;
+                record.lods[level].indexCount = mesh.lods[level].indexCount;
+                record.lods[level].error = mesh.lods[level].error;
+            }
+        }
+        return records;
+    }
+
+    // what build(true) uploaded, until releaseSources()
+    const std::vector<float>& sourceVertices() const { return vertices; }
+    const std::vector<unsigned int>& sourceIndices() const { return indices; }
+
+    void releaseSources()
+    {
+        vertices.clear();
+        vertices.shrink_to_fit();
+        indices.clear();
+        indices.shrink_to_fit();
+    }
+
+    // the geometry half of a queue item drawing the visible instances of one mesh at one level; the
+    // caller fills in pass, program and texture. Levels nobody uses give an item with instanceCount 0.
+    DrawItem drawItem(unsigned int id, unsigned int level = 0) const
+    {
+        const Mesh& mesh = meshes[id];
+        const Lod& lod = mesh.lods[level];
+        DrawItem item;
+        item.VAO = lod.VAO;
+        item.center = mesh.center;
+        item.mode = GL_TRIANGLES;
+        item.indexType = GL_UNSIGNED_INT;
+        item.count = lod.indexCount;
+        item.indexOffset = (const void*)(lod.firstIndex * sizeof(unsigned int));
+        item.baseVertex = mesh.baseVertex;
+        item.instanceCount = (GLsizei)lod.visibleCount;
+        return item;
+    }
+
+    // a VAO over the batch's geometry whose instance attributes read InstanceData from
+    // instanceBuffer at instanceOffset; the caller owns it. build() makes one per mesh.
+    unsigned int createVertexArray(unsigned int instanceBuffer, size_t instanceOffset) const
+    {
+        unsigned int VAO = 0;
+        glGenVertexArrays(1, &VAO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)instanceOffset);
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(instanceOffset + sizeof(glm::vec4)));
+        glVertexAttribDivisor(4, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return VAO;
+    }
+
+    // every instance of one mesh (level 0) as an indirect draw command, with baseInstance at the
+    // mesh's range of instances() (for a VAO from createVertexArray with offset 0)
+    DrawElementsIndirectCommand indirectCommand(unsigned int id) const
+    {
+        const Mesh& mesh = meshes[id];
+        DrawElementsIndirectCommand command;
+        command.count = (GLuint)mesh.indexCount;
+        command.instanceCount = mesh.instanceCount;
+        command.firstIndex = mesh.firstIndex;
+        command.baseVertex = mesh.baseVertex;
+        command.baseInstance = mesh.firstInstance;
+        return command;
+    }
+
+    // world-space bounds of every instance, in instance order (the order uploadVisible expects):
+    // the mesh bounds scaled, then rotated about Y
+    std::vector<AABB> instanceBounds() const
+    {
+        std::vector<AABB> boxes(instanceData.size());
+        for (size_t i = 0; i < instanceData.size(); i++)
+        {
+            const Mesh& mesh = meshes[instanceMesh[i]];
+            const InstanceData& instance = instanceData[i];
+            glm::vec3 scale(instance.scaleLayer);
+            glm::vec3 center = (mesh.boundsMin + mesh.boundsMax) * 0.5f * scale;
+            glm::vec3 extent = (mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+            float s = std::sin(instance.positionYaw.w), c = std::cos(instance.positionYaw.w);
+            glm::vec3 worldCenter = glm::vec3(c * center.x + s * center.z, center.y, c * center.z - s * center.x) + glm::vec3(instance.positionYaw);
+            glm::vec3 worldExtent(std::fabs(c) * extent.x + std::fabs(s) * extent.z, extent.y, std::fabs(s) * extent.x + std::fabs(c) * extent.z);
+            boxes[i].min = worldCenter - worldExtent;
+            boxes[i].max = worldCenter + worldExtent;
+        }
+        return boxes;
+    }
+
+    // keeps only the listed instances for the next draws; ids at or above firstId are instance
+    // indices + firstId, smaller ids (other objects culled in the same pass) are skipped. Without a
+    // selection every instance is drawn at level 0. With a ring the instances go into its current
+    // frame region (into instanceVBO when they don't fit).
+    void uploadVisible(const std::vector<uint32_t>& visible, uint32_t firstId = 0, const LodSelection* selection = NULL, RingBuffer* ring = NULL)
+    {
+        for (Mesh& mesh : meshes)
+        {
+            mesh.visibleCount = 0;
+            for (Lod& lod : mesh.lods)
+                lod.visibleCount = 0;
+        }
+        // every visible instance's level, counted per level
+        visibleInstances.clear();
+        visibleLevels.clear();
+        for (uint32_t id : visible)
+        {
+            if (id < firstId)
+                continue;
+            uint32_t instance = id - firstId;
+            Mesh& mesh = meshes[instanceMesh[instance]];
+            unsigned int level = selection ? selectLod(instance, mesh, *selection) : 0;
+            Lod& lod = mesh.lods[level];
+            lod.visibleCount++;
+            mesh.visibleCount++;
+            visibleInstances.push_back(instance);
+            visibleLevels.push_back((uint8_t)level);
+            lodTriangles += (unsigned long long)lod.indexCount / 3;
+            fullTriangles += (unsigned long long)mesh.lods[0].indexCount / 3;
+            levelInstances[level]++;
+        }
+        lodFrames++;
+        if (visibleInstances.empty())
+            return;
+
+        // packed level by level
+        unsigned int packed = 0;
+        for (Mesh& mesh : meshes)
+            for (Lod& lod : mesh.lods)
+            {
+                lod.firstVisible = packed;
+                packed += lod.visibleCount;
+                lod.visibleCount = 0;
+            }
+        visibleData.resize(visibleInstances.size());
+        for (size_t i = 0; i < visibleInstances.size(); i++)
+        {
+            Lod& lod = meshes[instanceMesh[visibleInstances[i]]].lods[visibleLevels[i]];
+            visibleData[lod.firstVisible + lod.visibleCount++] = instanceData[visibleInstances[i]];
+        }
+
+        GLsizeiptr bytes = (GLsizeiptr)(visibleData.size() * sizeof(InstanceData));
+        GLintptr offset = 0;
+        void* target = ring ? ring->map(bytes, offset) : NULL;
+        unsigned int buffer = target ? ring->buffer : instanceVBO;
+        if (target)
+        {
+            memcpy(target, visibleData.data(), bytes);
+            ring->unmap();
+        }
+        else
+        {
+            offset = 0;
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, bytes, visibleData.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        for (Mesh& mesh : meshes)
+            for (Lod& lod : mesh.lods)
+                if (lod.visibleCount > 0)
+                    pointInstances(lod.VAO, buffer, offset + lod.firstVisible * sizeof(InstanceData));
+    }
+
+    // triangles uploadVisible() submitted per frame against what level 0 everywhere would have cost
+    void reportLod(std::ostream& out) const
+    {
+        if (lodFrames == 0)
+            return;
+        out << "instance LOD: " << lodTriangles / lodFrames << " triangles per frame, " << fullTriangles / lodFrames << " without LOD ("
+            << (fullTriangles ? 100.0 * lodTriangles / fullTriangles : 100.0) << "%), instances per level";
+        unsigned int levels = 0;
+        for (const Mesh& mesh : meshes)
+            levels = std::max(levels, (unsigned int)mesh.lods.size());
+        for (unsigned int level = 0; level < levels; level++)
+            out << (level ? " / " : " ") << (double)levelInstances[level] / lodFrames;
+        out << std::endl;
+    }
+
+    void destroy()
+    {
+        for (Mesh& mesh : meshes)
+            for (Lod& lod : mesh.lods)
+            {
+                glDeleteVertexArrays(1, &lod.VAO);
+                lod.VAO = 0;
+            }
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &instanceVBO);
+        VBO = EBO = instanceVBO = 0;
+    }
+
+    unsigned int meshCount() const { return (unsigned int)meshes.size(); }
+    unsigned int instanceCount(unsigned int id) const { return meshes[id].instanceCount; }
+    unsigned int visibleCount(unsigned int id) const { return meshes[id].visibleCount; }
+    unsigned int visibleCount(unsigned int id, unsigned int level) const { return meshes[id].lods[level].visibleCount; }
+    unsigned int lodCount(unsigned int id) const { return (unsigned int)meshes[id].lods.size(); }
+    float lodError(unsigned int id, unsigned int level) const { return meshes[id].lods[level].error; }
+    unsigned int lodTriangleCount(unsigned int id, unsigned int level) const { return (unsigned int)meshes[id].lods[level].indexCount / 3; }
+    unsigned int totalInstances() const { return totalInstanceCount; }
+
+    // every instance grouped by mesh, and the mesh id of each
+    const std::vector<InstanceData>& instances() const { return instanceData; }
+    const std::vector<uint16_t>& instanceMeshes() const { return instanceMesh; }
+
+    // triangles submitted per frame when every instance is drawn
+    size_t totalTriangles() const
+    {
+        size_t triangles = 0;
+        for (const Mesh& mesh : meshes)
+            triangles += (size_t)mesh.indexCount / 3 * mesh.instanceCount;
+        return triangles;
+    }
+
+    // local-space bounds of a canonical mesh
+    glm::vec3 boundsMin(unsigned int id) const { return meshes[id].boundsMin; }
+    glm::vec3 boundsMax(unsigned int id) const { return meshes[id].boundsMax; }
+
+private:
+    struct Lod
+    {
+        unsigned int firstIndex = 0;
+        GLsizei indexCount = 0;
+        float error = 0.0f;
+        unsigned int firstVisible = 0;  // its run in the last uploadVisible()
+        unsigned int visibleCount = 0;
+        unsigned int VAO = 0;
+    };
+
+    struct Mesh
+    {
+        GLint baseVertex = 0;
+        unsigned int vertexCount = 0;
+        unsigned int firstIndex = 0;    // level 0
+        GLsizei indexCount = 0;
+        std::vector<Lod> lods;
+        glm::vec3 boundsMin = glm::vec3(0.0f);
+        glm::vec3 boundsMax = glm::vec3(0.0f);
+        std::vector<InstanceData> instances;    // until build()
+        unsigned int firstInstance = 0;
+        unsigned int instanceCount = 0;
+        unsigned int visibleCount = 0;
+        glm::vec3 center = glm::vec3(0.0f);
+    };
+
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Mesh> meshes;
+    std::vector<InstanceData> instanceData;     // grouped by mesh
+    std::vector<uint16_t> instanceMesh;
+    std::vector<uint32_t> visibleInstances;    // uploadVisible() scratch: the visible instances, their levels,
+    std::vector<uint8_t> visibleLevels;         // and their data packed level by level
+    std::vector<InstanceData> visibleData;
+    std::vector<uint8_t> instanceLod;           // level each instance was drawn at last
+    std::vector<glm::vec4> instanceSpheres;     // world-space bounding spheres
+    unsigned int totalInstanceCount = 0;
+
+    unsigned int lodFrames = 0;
+    unsigned long long lodTriangles = 0;
+    unsigned long long fullTriangles = 0;
+    unsigned long long levelInstances[MAX_LODS] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    // instance slots, bounding spheres and the GL objects, for meshes whose instance ranges are set
+    // (instances as instanceData, uploaded from initialInstances)
+    void upload(const float* vertexData, size_t floatCount, const unsigned int* indexData, size_t indexCount, const InstanceData* initialInstances)
+    {
+        instanceMesh.clear();
+        for (unsigned int id = 0; id < meshes.size(); id++)
+        {
+            Mesh& mesh = meshes[id];
+            mesh.visibleCount = mesh.instanceCount;
+            for (Lod& lod : mesh.lods)
+            {
+                lod.firstVisible = mesh.firstInstance;
+                lod.visibleCount = 0;
+            }
+            mesh.lods[0].visibleCount = mesh.instanceCount;
+            mesh.center = glm::vec3(0.0f);
+            for (unsigned int i = 0; i < mesh.instanceCount; i++)
+                mesh.center += glm::vec3(instanceData[mesh.firstInstance + i].positionYaw) / (float)mesh.instanceCount;
+            instanceMesh.insert(instanceMesh.end(), mesh.instanceCount, (uint16_t)id);
+        }
+        totalInstanceCount = (unsigned int)instanceData.size();
+        instanceLod.assign(totalInstanceCount, 0);
+        instanceSpheres.clear();
+        for (const AABB& box : instanceBounds())
+            instanceSpheres.push_back(glm::vec4(box.center(), glm::length(box.extent())));
+
+        glGenBuffers(1, &VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, floatCount * sizeof(float), vertexData, GL_STATIC_DRAW);
+        // everything starts out visible at level 0, in instance order
+        glGenBuffers(1, &instanceVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, totalInstanceCount * sizeof(InstanceData), initialInstances, GL_STREAM_DRAW);
+        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        for (Mesh& mesh : meshes)
+            for (Lod& lod : mesh.lods)
+                lod.VAO = createVertexArray(instanceVBO, lod.firstVisible * sizeof(InstanceData));
+    }
+
+    // re-points attributes 3 and 4 of a VAO from createVertexArray
+    static void pointInstances(unsigned int VAO, unsigned int buffer, size_t offset)
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offset);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offset + sizeof(glm::vec4)));
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // starts from the level used last time: finer while the error shows, coarser only once the next
+    // level is clearly below the limit
+    unsigned int selectLod(uint32_t instance, const Mesh& mesh, const LodSelection& selection)
+    {
+        const glm::vec4& sphere = instanceSpheres[instance];
+        const InstanceData& data = instanceData[instance];
+        float scale = std::max(std::max(data.scaleLayer.x, data.scaleLayer.y), data.scaleLayer.z);
+        float distance = std::max(glm::length(glm::vec3(sphere) - selection.cameraPosition) - sphere.w, 1e-3f);
+        float pixelsPerError = scale * selection.pixelsPerUnit / distance;
+        unsigned int level = std::min((unsigned int)instanceLod[instance], (unsigned int)mesh.lods.size() - 1);
+        while (level > 0 && mesh.lods[level].error * pixelsPerError > selection.maxError)
+            level--;
+        while (level + 1 < mesh.lods.size() && mesh.lods[level + 1].error * pixelsPerError < selection.maxError * (1.0f - selection.hysteresis))
+            level++;
+        instanceLod[instance] = (uint8_t)level;
+        return level;
+    }
+};
+
+#endif
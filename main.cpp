@@ -5,12 +5,40 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <learnopengl/shader_m.h>
-#include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
-#include <learnopengl/model.h>
 
+#include "fixed_timestep.h"
+#include "frame_pacer.h"
+#include "frustum_culler.h"
+#include "gl_extensions.h"
+#include "gpu_culler.h"
+#include "gpu_timer.h"
+#include "headless.h"
+#include "instance_batch.h"
+#include "masked_occlusion.h"
+#include "mesh_generator.h"
+#include "mesh_simplifier.h"
+#include "mip_generator.h"
+#include "necropolis.h"
+#include "options.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "scene_file.h"
+#include "shader.h"
+#include "shader_cache.h"
+#include "uniform_buffer.h"
+#include "static_batch.h"
+#include "terrain.h"
+#include "texture_cooker.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
@@ -19,12 +47,13 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-unsigned int loadTexture(std::string path);
-unsigned int loadCubemap(vector<std::string> faces);
+void simulate(float stepSeconds);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+unsigned int viewportWidth = SCR_WIDTH;
+unsigned int viewportHeight = SCR_HEIGHT;
 
 // camera
 Camera camera(glm::vec3(0.0f, 5.0f, 40.0f));
@@ -32,159 +61,189 @@ float lastX = (float)SCR_WIDTH / 2.0;
 float lastY = (float)SCR_HEIGHT / 2.0;
 bool firstMouse = true;
 
-// timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+// simulation: stepped at a fixed rate (--sim-rate) and drawn between the last two steps; the
+// camera's orientation follows the mouse directly
+struct SimulationState
+{
+    glm::vec3 cameraPosition;
+};
+SimulationState previousState;
+SimulationState currentState;
+bool movementHeld[4] = { false, false, false, false };  // per Camera_Movement, set by processInput
+
+// render passes, in the order they are drawn (also the GPU timer slots)
+enum RenderPass
+{
+    PASS_PYRAMID,
+    PASS_GROUND,
+    PASS_FORT,
+    PASS_STREETS,
+    PASS_SKYBOX
+};
+
+// materials of the static scene batch, each one is drawn with a single multi-draw
+enum Material
+{
+    MATERIAL_PYRAMID,
+    MATERIAL_GROUND,
+    MATERIAL_FORT,
+    MATERIAL_STREETS,
+    MATERIAL_COUNT
+};
 
 
 
-int main()
+int main(int argc, char* argv[])
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    auto startupBegin = std::chrono::steady_clock::now();
+    AppOptions options = parseAppOptions(argc, argv);
+    GLFWwindow* window = NULL;
+    GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+
+#ifdef PYRAMID_HEADLESS
+    // headless: surfaceless EGL context, the scene is rendered into an FBO
+    // --------------------------------------------------------------------
+    HeadlessContext headlessContext;
+    if (options.headless)
+    {
+        // --gpu-culling asks for 4.3 first and settles for the usual 3.3 core context
+        bool created = options.gpuCulling && headlessContext.create(4, 3);
+        if (!created)
+        {
+            headlessContext.destroy();
+            created = headlessContext.create(3, 3);
+        }
+        if (!created)
+        {
+            headlessContext.destroy();
+            return -1;
+        }
+        loader = (GLADloadproc)HeadlessContext::getProcAddress;
+        viewportWidth = options.width;
+        viewportHeight = options.height;
+    }
+#else
+    if (options.headless)
+    {
+        std::cout << "Headless mode is not available in this build (define PYRAMID_HEADLESS)" << std::endl;
+        return -1;
+    }
+#endif
+
+    if (!options.headless)
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Giza Pyramid", NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+        // glfw window creation
+        // --------------------
+        // --gpu-culling asks for 4.3 first and settles for the usual 3.3 core context
+        if (options.gpuCulling)
+        {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Giza Pyramid", NULL, NULL);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        }
+        if (window == NULL)
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Giza Pyramid", NULL, NULL);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // --vsync: adaptive needs EXT_swap_control_tear, without it a late frame waits for the next refresh
+        if (options.swapMode == SWAP_ADAPTIVE && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+            && !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+        {
+            std::cout << "Adaptive vsync is not supported, using vsync" << std::endl;
+            options.swapMode = SWAP_VSYNC;
+        }
+        if (options.swapMode != SWAP_DEFAULT)
+            glfwSwapInterval(options.swapMode == SWAP_IMMEDIATE ? 0 : options.swapMode == SWAP_VSYNC ? 1 : -1);
+    }
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    if (!gladLoadGLLoader(loader))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtensions(loader);
+    if (options.gpuCulling && !GpuCuller::supported())
+    {
+        std::cout << "GPU culling needs a GL 4.3 context, culling on the CPU instead" << std::endl;
+        options.gpuCulling = false;
+    }
 
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
-
-    // build and compile shaders
-    // -------------------------
-    Shader shader("shaders/6.1.cubemaps.vs", "shaders/6.1.cubemaps.fs");
-    Shader skyboxShader("shaders/6.1.skybox.vs", "shaders/6.1.skybox.fs");
-    Shader groundShader("shaders/6.1.cubemaps.vs", "shaders/6.1.cubemaps.fs");
-    Shader fortShader("shaders/6.1.cubemaps.vs", "shaders/6.1.cubemaps.fs");
-    Shader streetsShader("shaders/6.1.cubemaps.vs", "shaders/6.1.cubemaps.fs");
+    // the skybox mips are filtered per face, filtering across face edges hides the seams
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    // build and compile shaders (identical programs are shared, linked binaries come from disk on a warm start)
+    // ---------------------------------------------------------------------------------------------------------
+    auto shaderBegin = std::chrono::steady_clock::now();
+    ShaderCache shaderCache;
+    shaderCache.init(options.shaderCacheDirectory);
+    Shader shader = shaderCache.load("shaders/6.1.cubemaps.vs", "shaders/6.1.cubemaps.fs");
+    Shader skyboxShader = shaderCache.load("shaders/6.1.skybox.vs", "shaders/6.1.skybox.fs");
+    Shader instancedShader = shaderCache.load("shaders/6.2.instanced.vs", "shaders/6.1.cubemaps.fs");
+    Shader terrainShader;
+    if (options.terrain)
+        terrainShader = shaderCache.load("shaders/6.5.terrain.vs", "shaders/6.5.terrain.fs");
+    std::chrono::duration<double, std::milli> shaderTime = std::chrono::steady_clock::now() - shaderBegin;
+    shaderCache.report(std::cout, shaderTime.count());
 
     // build and compile our shader zprogram
     // ------------------------------------
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
-    float cubeVertices[] = {
-        // positions          // texture Coords
-        // belakang
-        -5.0f, -1.0f, -5.0f,      0.0f,   0.0f,
-        5.0f, -1.0f, -5.0f,      20.0f,  0.0f,
-        0.0f,   5.0f,  0.0f,       10.0f,  20.0f,
-
-
-        // depan
-       -5.0f, -1.0f,  5.0f,      0.0f,   0.0f,
-        5.0f, -1.0f,  5.0f,      20.0f,  0.0f,
-        0.0f,   5.0f,  0.0f,       10.0f,  20.0f,
-
-        // kiri
-      -5.0f, -1.0f, -5.0f,       20.0f,  0.0f,
-      -5.0f, -1.0f,  5.0f,       0.0f,   0.0f,
-       0.0f,   5.0f,  0.0f,        10.0f,  20.0f,
-
-        // kanan
-       5.0f, -1.0f, -5.0f,       20.0f,  0.0f,
-       5.0f, -1.0f,  5.0f,       0.0f,   0.0f,
-       0.0f,  5.0f,  0.0f,         10.0f,  20.0f,
-
-        // bawah
-      -5.0f, -1.0f, -5.0f,       0.0f,   20.0f,
-       5.0f, -1.0f, -5.0f,       20.0f,   20.0f,
-       5.0f, -1.0f,  5.0f,       20.0f,   0.0f,
-       5.0f, -1.0f,  5.0f,       20.0f,   0.0f,
-      -5.0f, -1.0f,  5.0f,       0.0f,   0.0f,
-      -5.0f, -1.0f, -5.0f,       0.0f,   20.0f,
-
-        // belakang
-        -13.0f, -1.0f, 4.0f,      0.0f,   0.0f,
-        -7.0f, -1.0f, 4.0f,      20.0f,  0.0f,
-        -10.0f,   3.0f,  7.0f,       10.0f,  20.0f,
-
-
-        // depan
-       -13.0f, -1.0f,  10.0f,      0.0f,   0.0f,
-        -7.0f, -1.0f,  10.0f,      20.0f,  0.0f,
-        -10.0f,   3.0f,  7.0f,       10.0f,  20.0f,
-
-        // kiri
-      -13.0f, -1.0f, 4.0f,       20.0f,  0.0f,
-      -13.0f, -1.0f,  10.0f,       0.0f,   0.0f,
-       -10.0f,   3.0f,  7.0f,        10.0f,  20.0f,
-
-        // kanan
-       -7.0f, -1.0f, 4.0f,       20.0f,  0.0f,
-       -7.0f, -1.0f,  10.0f,       0.0f,   0.0f,
-       -10.0f,  3.0f,  7.0f,         10.0f,  20.0f,
-
-        // bawah
-      -13.0f, -1.0f, 4.0f,       0.0f,   20.0f,
-       -7.0f, -1.0f, 4.0f,       20.0f,   20.0f,
-       -7.0f, -1.0f,  10.0f,       20.0f,   0.0f,
-       -7.0f, -1.0f,  10.0f,       20.0f,   0.0f,
-      -13.0f, -1.0f,  10.0f,       0.0f,   0.0f,
-      -13.0f, -1.0f, 4.0f,       0.0f,   20.0f,
-
-
-       // belakang
-        7.0f, -1.0f, -8.0f,      0.0f,   0.0f,
-        13.0f, -1.0f, -8.0f,      20.0f,  0.0f,
-        10.0f,   3.0f,  -5.0f,       10.0f,  20.0f,
-
-
-        // depan
-       7.0f, -1.0f,  -2.0f,      0.0f,   0.0f,
-        13.0f, -1.0f,  -2.0f,      20.0f,  0.0f,
-        10.0f,   3.0f,  -5.0f,       10.0f,  20.0f,
-
-        // kiri
-      7.0f, -1.0f, -8.0f,       20.0f,  0.0f,
-      7.0f, -1.0f,  -2.0f,       0.0f,   0.0f,
-       10.0f,   3.0f,  -5.0f,        10.0f,  20.0f,
-
-        // kanan
-       13.0f, -1.0f, -8.0f,       20.0f,  0.0f,
-       13.0f, -1.0f,  -2.0f,       0.0f,   0.0f,
-       10.0f,  3.0f,  -5.0f,         10.0f,  20.0f,
-
-        // bawah
-      7.0f, -1.0f, -8.0f,       0.0f,   20.0f,
-       13.0f, -1.0f, -8.0f,       20.0f,   20.0f,
-       13.0f, -1.0f,  -2.0f,       20.0f,   0.0f,
-       13.0f, -1.0f,  -2.0f,       20.0f,   0.0f,
-      7.0f, -1.0f,  -2.0f,       0.0f,   0.0f,
-      7.0f, -1.0f, -8.0f,       0.0f,   20.0f,
-
-
-    };
+    // scene geometry comes from the generator at compile time; only --pyramid-steps builds a mesh
+    // at startup. Unit pyramid and mastaba (base -1..1 on y = 0, top at y = 1) are placed by instances.
+    constexpr SteppedPyramidShape PYRAMID_SHAPE = { 1.0f, 1.0f, 24, 20.0f };
+    constexpr PyramidShape MASTABA_SHAPE = { 1.0f, 1.0f, 0.7f, 8.0f };
+    constexpr GroundTileShape GROUND_SHAPE = { -100.0f, -100.0f, 100.0f, 100.0f, -1.0f, 1.0f / 200.0f, 1 };
+    constexpr GroundTileShape STREETS_SHAPE = { -14.0f, -14.0f, 14.0f, 14.5f, -0.9f, 1.0f / 28.0f, 1 };
+    // benteng: walls 1 high and 0.5 thick around +-14, the gate 4 wide facing +z
+    constexpr WallRingShape FORT_SHAPE = { 14.0f, 0.5f, 1.0f, -1.0f, 4.0f, 1.0f };
+    static constexpr auto steppedPyramidVertices = generateMeshArray<vertexCount(PYRAMID_SHAPE)>(PYRAMID_SHAPE);
+    static constexpr auto mastabaVertices = generateMeshArray<vertexCount(MASTABA_SHAPE)>(MASTABA_SHAPE);
+    static constexpr auto groundVertices = generateMeshArray<vertexCount(GROUND_SHAPE)>(GROUND_SHAPE);
+    static constexpr auto streetsVertices = generateMeshArray<vertexCount(STREETS_SHAPE)>(STREETS_SHAPE);
+    static constexpr auto fortVertices = generateMeshArray<vertexCount(FORT_SHAPE)>(FORT_SHAPE);
+    const float* pyramidVertices = steppedPyramidVertices.data();
+    size_t pyramidFloatCount = steppedPyramidVertices.size();
+    std::vector<float> customPyramidVertices;
+    if (options.pyramidSteps != PYRAMID_SHAPE.steps)
+    {
+        SteppedPyramidShape shape = PYRAMID_SHAPE;
+        shape.steps = options.pyramidSteps;
+        customPyramidVertices = generateMesh(shape);
+        pyramidVertices = customPyramidVertices.data();
+        pyramidFloatCount = customPyramidVertices.size();
+    }
 
     // vertex untuk skybox
     float skyboxVertices[] = {
@@ -232,281 +291,280 @@ int main()
          1.0f, -1.0f,  1.0f
     };
 
-    // vertex untuk terrain
-    float groundVertices[] = {
 
-        // ground
-        -100.0f, -1.0f, -100.0f,  0.0f, 1.0f,
-         100.0f, -1.0f, -100.0f,  1.0f, 1.0f,
-         100.0f, -1.0f,  100.0f,  1.0f, 0.0f,
-         100.0f, -1.0f,  100.0f,  1.0f, 0.0f,
-        -100.0f, -1.0f,  100.0f,  0.0f, 0.0f,
-        -100.0f, -1.0f, -100.0f,  0.0f, 1.0f,
+    // every material is one layer of a texture array (the layer is the material id, see StaticBatch),
+    // so the whole opaque scene samples one binding
+    std::vector<std::string> materialLayers(MATERIAL_COUNT);
+    materialLayers[MATERIAL_PYRAMID] = "resources/textures/texturepyramid.jpeg";
+    materialLayers[MATERIAL_GROUND] = "resources/textures/sand2.jpg";
+    materialLayers[MATERIAL_FORT] = "resources/textures/wall2.jpg";
+    materialLayers[MATERIAL_STREETS] = "resources/textures/sand.jpg";
 
-    };
+    // the desert around the scene: flat sand under it, dunes further out (drawn by the terrain, the
+    // necropolis stands on it)
+    DuneField dunes;
 
-    // vertex street
-    float streetsVertices[] = {
+    const unsigned int PYRAMID_MESH = 0, MASTABA_MESH = 1;
+    const InstanceData scenePyramids[] = {
+        { glm::vec4(0.0f, -1.0f, 0.0f, 0.0f), glm::vec4(5.0f, 6.0f, 5.0f, MATERIAL_PYRAMID) },
+        { glm::vec4(-10.0f, -1.0f, 7.0f, 0.0f), glm::vec4(3.0f, 4.0f, 3.0f, MATERIAL_PYRAMID) },
+        { glm::vec4(10.0f, -1.0f, -5.0f, 0.0f), glm::vec4(3.0f, 4.0f, 3.0f, MATERIAL_PYRAMID) },
+    };
 
-        // ground
-        -14.0f, -0.9f, 14.5f, 0.0f, 0.0f,
-        14.0f, -0.9f, 14.5f, 1.0f, 1.0f,
-        -14.0f, -0.9f, -14.0f, 0.0f, 1.0f,
-        14.0f, -0.9f, 14.5f, 1.0f, 1.0f,
-        -14.0f, -0.9f, -14.0f, 0.0f, 1.0f,
-        14.0, -0.9f,-14.0f, 1.0f, 0.0f
-        //2.0f, -0.9f, 5.2f, 1.0f, 1.0f,
-        //-2.0f, -0.9f, 14.0f, 0.0f, 0.0f,
-        //-2.0f, -0.9f, 5.2f, 1.0f, 0.0f,
+    // the built scene (encoded static batch, instanced meshes with their levels of detail, the
+    // instances, sky and occluders) is written to the scene cache and mapped straight into the GL
+    // buffers on the next start; the stamp covers everything it is built from, the code included
+    // through SCENE_BUILDER_VERSION: bump it whenever mesh processing, the LOD chain, the scatter or
+    // the encoding change what gets built
+    // -------------------------------------------------------------------------------------------
+    auto sceneBegin = std::chrono::steady_clock::now();
+    const uint32_t SCENE_BUILDER_VERSION = 1;
+    uint64_t sceneStamp = hashBytes(&SCENE_BUILDER_VERSION, sizeof(SCENE_BUILDER_VERSION));
+    sceneStamp = hashBytes(&options.vertexFormat, sizeof(options.vertexFormat), sceneStamp);
+    sceneStamp = hashBytes(pyramidVertices, pyramidFloatCount * sizeof(float), sceneStamp);
+    sceneStamp = hashBytes(mastabaVertices.data(), mastabaVertices.size() * sizeof(float), sceneStamp);
+    sceneStamp = hashBytes(groundVertices.data(), groundVertices.size() * sizeof(float), sceneStamp);
+    sceneStamp = hashBytes(streetsVertices.data(), streetsVertices.size() * sizeof(float), sceneStamp);
+    sceneStamp = hashBytes(fortVertices.data(), fortVertices.size() * sizeof(float), sceneStamp);
+    sceneStamp = hashBytes(skyboxVertices, sizeof(skyboxVertices), sceneStamp);
+    sceneStamp = hashBytes(scenePyramids, sizeof(scenePyramids), sceneStamp);
+    sceneStamp = hashBytes(&dunes, sizeof(dunes), sceneStamp);
+    uint32_t sceneSwitches[] = { options.necropolis, options.lod, options.terrain };
+    sceneStamp = hashBytes(sceneSwitches, sizeof(sceneSwitches), sceneStamp);
+    for (const std::string& layer : materialLayers)
+        sceneStamp = hashBytes(layer.data(), layer.size() + 1, sceneStamp);
+    std::string scenePath;
+    if (!options.sceneFile.empty())
+        scenePath = options.sceneFile;
+    else if (!options.sceneCacheDirectory.empty())
+    {
+        makeDirectory(options.sceneCacheDirectory);
+        char sceneName[32];
+        snprintf(sceneName, sizeof(sceneName), "%016llx.pysc", (unsigned long long)sceneStamp);
+        scenePath = options.sceneCacheDirectory + "/" + sceneName;
+    }
 
-    };
+    StaticBatch staticBatch;
+    InstanceBatch instanceBatch;
+    std::vector<std::string> staticMeshNames;
+    std::vector<glm::vec3> occluderTriangles;   // world space, for --cpu-occlusion
+    const float* skyVertices = skyboxVertices;
+    size_t skyFloatCount = sizeof(skyboxVertices) / sizeof(float);
+    SceneFile sceneFile;
+    bool sceneMapped;
+    if (!options.sceneFile.empty())
+    {
+        // --scene: the file is drawn whatever it was built from, as long as it is sound
+        sceneMapped = sceneFile.open(scenePath);
+        if (!sceneMapped)
+        {
+            std::cout << "Scene: " << scenePath << " is missing, damaged or from an incompatible build" << std::endl;
+            return -1;
+        }
+    }
+    else
+        sceneMapped = !scenePath.empty() && sceneFile.open(scenePath, sceneStamp);
+    if (sceneMapped)
+    {
+        sceneFile.loadStaticBatch(staticBatch);
+        sceneFile.loadInstanceBatch(instanceBatch);
+        for (unsigned int id = 0; id < staticBatch.meshCount(); id++)
+            staticMeshNames.push_back(sceneFile.staticMeshName(id));
+        materialLayers = sceneFile.materials();
+        skyVertices = sceneFile.records<float>(SCENE_SKY_VERTICES);
+        skyFloatCount = sceneFile.count<float>(SCENE_SKY_VERTICES);
+        const glm::vec3* occluders = sceneFile.records<glm::vec3>(SCENE_OCCLUDERS);
+        occluderTriangles.assign(occluders, occluders + sceneFile.count<glm::vec3>(SCENE_OCCLUDERS));
+    }
+    else
+    {
+        // static scene: weld + reorder every triangle list into an indexed mesh, then pack them all
+        // into one shared VBO/EBO; vertex counts come from the generator
+        IndexedMesh fortMesh;   // kept as a --cpu-occlusion occluder
+        struct StaticMeshSource { const char* name; const float* vertices; size_t floatCount; Material material; };
+        std::vector<StaticMeshSource> staticMeshes = {
+            { "fort", fortVertices.data(), fortVertices.size(), MATERIAL_FORT },
+            { "streets", streetsVertices.data(), streetsVertices.size(), MATERIAL_STREETS },
+        };
+        // the terrain replaces the flat ground quad
+        if (!options.terrain)
+            staticMeshes.insert(staticMeshes.begin(), { "ground", groundVertices.data(), groundVertices.size(), MATERIAL_GROUND });
+        for (const StaticMeshSource& source : staticMeshes)
+        {
+            MeshStats stats;
+            size_t vertexCount = source.floatCount / StaticBatch::FLOATS_PER_VERTEX;
+            IndexedMesh mesh = processMesh(source.vertices, vertexCount, StaticBatch::FLOATS_PER_VERTEX, &stats);
+            printMeshStats(source.name, stats);
+            if (options.quantizationReport)
+                printQuantizationReport(source.name, source.vertices, vertexCount, StaticBatch::FLOATS_PER_VERTEX);
+            staticBatch.addMesh(mesh, source.material, options.vertexFormat);
+            staticMeshNames.push_back(source.name);
+            if (source.material == MATERIAL_FORT)
+                fortMesh = mesh;
+        }
+        staticBatch.build(!scenePath.empty());
+
+        // pyramids and mastabas: one canonical mesh each with its chain of levels of detail, drawn
+        // instanced (the three scene pyramids plus the --necropolis stress field)
+        IndexedMesh pyramidMesh;
+        struct InstancedMeshSource { const char* name; const float* vertices; size_t floatCount; };
+        const InstancedMeshSource instancedMeshes[] = {
+            { "pyramid", pyramidVertices, pyramidFloatCount },
+            { "mastaba", mastabaVertices.data(), mastabaVertices.size() },
+        };
+        for (const InstancedMeshSource& source : instancedMeshes)
+        {
+            MeshStats stats;
+            IndexedMesh mesh = processMesh(source.vertices, source.floatCount / InstanceBatch::FLOATS_PER_VERTEX, InstanceBatch::FLOATS_PER_VERTEX, &stats);
+            printMeshStats(source.name, stats);
+            std::vector<MeshLod> lods;
+            if (options.lod)
+            {
+                lods = generateLodChain(mesh, 5);
+                std::cout << "mesh " << source.name << " LODs:";
+                for (const MeshLod& lod : lods)
+                    std::cout << " " << lod.indices.size() / 3 << " (error " << lod.error << ")";
+                std::cout << std::endl;
+            }
+            instanceBatch.addMesh(mesh, lods);
+            if (source.vertices == pyramidVertices)
+                pyramidMesh = mesh;
+        }
+        for (const InstanceData& instance : scenePyramids)
+            instanceBatch.addInstance(PYRAMID_MESH, instance);
+        if (options.necropolis > 0)
+            scatterNecropolis(instanceBatch, PYRAMID_MESH, MASTABA_MESH, options.necropolis, (float)MATERIAL_PYRAMID, (float)MATERIAL_FORT,
+                              options.terrain ? &dunes : NULL);
+        instanceBatch.build(!scenePath.empty());
+
+        // the occluders of --cpu-occlusion: the scene pyramids and the fort walls
+        for (const InstanceData& instance : scenePyramids)
+        {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(instance.positionYaw));
+            model = glm::rotate(model, instance.positionYaw.w, glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(instance.scaleLayer));
+            MaskedOcclusionCuller::appendOccluderTriangles(pyramidMesh, model, occluderTriangles);
+        }
+        MaskedOcclusionCuller::appendOccluderTriangles(fortMesh, glm::mat4(1.0f), occluderTriangles);
 
-    // vertex untuk benteng
-    float fortVertices[] = {
-
-        // ====== FRONT =========
-        //front-right
-        //sudut kiri bwah
-        2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        // sudut kiri atas
-        2.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        //sudut kanan atas
-        2.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-
-        //sudut kiri bawah
-        2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        //sudut kanan atas
-        2.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        //sudut kanan bawah
-        2.0f, -1.0f, 14.5f, 1.0f, 0.0f,
-
-        2.0f, -1.0f, 14.5f, 0.0f, 0.0f,
-        2.0f, 0.0f, 14.5f, 0.0f, 1.0f,
-        14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        14.0f, -1.0f, 14.5f, 1.0f, 0.0f,
-        2.0f, -1.0f, 14.5f, 0.0f, 0.0f,
-
-        2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        2.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, 14.0f, 1.0f, 1.0f,
-        14.0f, 0.0f, 14.0f, 1.0f, 1.0f,
-        14.0f, -1.0f, 14.0f, 1.0f, 0.0f,
-        2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-
-        14.0f, -1.0f, 14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, 14.0f, 1.0f, 1.0f,
-        14.0f, 0.0f, 14.5f, 1.0f, 0.0f,
-        14.0f, -1.0f, 14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, 14.5f, 0.0f, 0.0f,
-        14.0f, -1.0f, 14.5f, 1.0f, 0.0f,
-
-        14.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        2.0f, 0.0f, 14.0f, 0.0f, 0.0f,
-        2.0f, 0.0f, 14.0f, 0.0f, 0.0f,
-        14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        2.0f, 0.0f, 14.5f, 1.0f, 0.0f,
-
-        // front-left
-
-
-        //sudut kiri bwah
-        -2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        // sudut kiri atas
-        -2.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        //sudut kanan atas
-        -2.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-
-        //sudut kiri bawah
-        -2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        //sudut kanan atas
-        -2.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        //sudut kanan bawah
-        -2.0f, -1.0f, 14.5f, 1.0f, 0.0f,
-
-        -2.0f, -1.0f, 14.5f, 0.0f, 0.0f,
-        -2.0f, 0.0f, 14.5f, 0.0f, 1.0f,
-        -14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        -14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        -14.0f, -1.0f, 14.5f, 1.0f, 0.0f,
-        -2.0f, -1.0f, 14.5f, 0.0f, 0.0f,
-
-        -2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        -2.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        -14.0f, 0.0f, 14.0f, 1.0f, 1.0f,
-        -14.0f, 0.0f, 14.0f, 1.0f, 1.0f,
-        -14.0f, -1.0f, 14.0f, 1.0f, 0.0f,
-        -2.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-
-        -14.0f, -1.0f, 14.0f, 0.0f, 1.0f,
-        -14.0f, 0.0f, 14.0f, 1.0f, 1.0f,
-        -14.0f, 0.0f, 14.5f, 1.0f, 0.0f,
-        -14.0f, -1.0f, 14.0f, 0.0f, 1.0f,
-        -14.0f, 0.0f, 14.5f, 0.0f, 0.0f,
-        -14.0f, -1.0f, 14.5f, 1.0f, 0.0f,
-
-        -14.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        -14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        -2.0f, 0.0f, 14.0f, 0.0f, 0.0f,
-        -2.0f, 0.0f, 14.0f, 0.0f, 0.0f,
-        -14.0f, 0.0f, 14.5f, 1.0f, 1.0f,
-        -2.0f, 0.0f, 14.5f, 1.0f, 0.0f,
-
-        // ====== RIGHT =========
-        14.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        13.5f, 0.0f, 14.0f, 0.0f, 0.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        13.5f, 0.0f, 14.0f, 0.0f, 0.0f,
-        13.5f, 0.0f, -14.0f, 1.0f, 0.0f,
-
-        13.5f, 0.0f, 14.0f, 0.0f, 1.0f,
-        13.5f, -1.0f, 14.0f, 0.0f, 0.0f,
-        13.5f, 0.0f, -14.0f, 1.0f, 1.0f,
-        13.5f, -1.0f, 14.0f, 0.0f, 0.0f,
-        13.5f, 0.0f, -14.0f, 1.0f, 1.0f,
-        13.5f, -1.0f, -14.0f, 1.0f, 0.0f,
-
-        14.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        14.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        14.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        14.0f, -1.0f, -14.0f, 1.0f, 0.0f,
-
-        // ====== LEFT =========
-        -14.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        -13.5f, 0.0f, 14.0f, 0.0f, 0.0f,
-        -14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        -14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        -13.5f, 0.0f, 14.0f, 0.0f, 0.0f,
-        -13.5f, 0.0f, -14.0f, 1.0f, 0.0f,
-
-        -13.5f, 0.0f, 14.0f, 0.0f, 1.0f,
-        -13.5f, -1.0f, 14.0f, 0.0f, 0.0f,
-        -13.5f, 0.0f, -14.0f, 1.0f, 1.0f,
-        -13.5f, -1.0f, 14.0f, 0.0f, 0.0f,
-        -13.5f, 0.0f, -14.0f, 1.0f, 1.0f,
-        -13.5f, -1.0f, -14.0f, 1.0f, 0.0f,
-
-        -14.0f, 0.0f, 14.0f, 0.0f, 1.0f,
-        -14.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        -14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        -14.0f, -1.0f, 14.0f, 0.0f, 0.0f,
-        -14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        -14.0f, -1.0f, -14.0f, 1.0f, 0.0f,
-
-        // ====== BACK =========
-        //sudut kiri bwah
-        -14.0f, -1.0f, -14.0f, 0.0f, 0.0f,
-        // sudut kiri atas
-        -14.0f, 0.0f, -14.0f, 0.0f, 1.0f,
-        //sudut kanan atas
-        -14.0f, 0.0f, -14.5f, 1.0f, 1.0f,
-
-        //sudut kiri bawah
-        -14.0f, -1.0f, -14.0f, 0.0f, 0.0f,
-        //sudut kanan atas
-        -14.0f, 0.0f, -14.5f, 1.0f, 1.0f,
-        //sudut kanan bawah
-        -14.0f, -1.0f, -14.5f, 1.0f, 0.0f,
-
-        -14.0f, -1.0f, -14.5f, 0.0f, 0.0f,
-        -14.0f, 0.0f, -14.5f, 0.0f, 1.0f,
-        14.0f, 0.0f, -14.5f, 1.0f, 1.0f,
-        14.0f, 0.0f, -14.5f, 1.0f, 1.0f,
-        14.0f, -1.0f, -14.5f, 1.0f, 0.0f,
-        -14.0f, -1.0f, -14.5f, 0.0f, 0.0f,
-
-        -14.0f, -1.0f, -14.0f, 0.0f, 0.0f,
-        -14.0f, 0.0f, -14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        14.0f, -1.0f, -14.0f, 1.0f, 0.0f,
-        -14.0f, -1.0f, -14.0f, 0.0f, 0.0f,
-
-        14.0f, -1.0f, -14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, -14.0f, 1.0f, 1.0f,
-        14.0f, 0.0f, -14.5f, 1.0f, 0.0f,
-        14.0f, -1.0f, -14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, -14.5f, 0.0f, 0.0f,
-        14.0f, -1.0f, -14.5f, 1.0f, 0.0f,
-
-        14.0f, 0.0f, -14.0f, 0.0f, 1.0f,
-        14.0f, 0.0f, -14.5f, 1.0f, 1.0f,
-        -14.0f, 0.0f, -14.0f, 0.0f, 0.0f,
-        -14.0f, 0.0f, -14.0f, 0.0f, 0.0f,
-        14.0f, 0.0f, -14.5f, 1.0f, 1.0f,
-        -14.0f, 0.0f, -14.5f, 1.0f, 0.0f,
-    };
+        if (!scenePath.empty())
+        {
+            SceneContents contents;
+            contents.materials = materialLayers;
+            contents.staticBatch = &staticBatch;
+            contents.staticMeshNames = staticMeshNames;
+            contents.instanceBatch = &instanceBatch;
+            contents.skyVertices = skyboxVertices;
+            contents.skyFloatCount = sizeof(skyboxVertices) / sizeof(float);
+            contents.occluders = occluderTriangles;
+            if (!SceneFile::write(scenePath, sceneStamp, contents))
+                std::cout << "Scene cache: failed to write " << scenePath << std::endl;
+            staticBatch.releaseEncoded();
+            instanceBatch.releaseSources();
+        }
+    }
+    std::chrono::duration<double, std::milli> sceneTime = std::chrono::steady_clock::now() - sceneBegin;
+    std::cout << "scene: " << (sceneMapped ? "mapped " + scenePath : std::string(scenePath.empty() ? "built" : "built, written to " + scenePath))
+              << " in " << sceneTime.count() << " ms" << std::endl;
+    for (unsigned int id = 0; id < staticBatch.meshCount(); id++)
+    {
+        const MeshRange& mesh = staticBatch.mesh(id);
+        std::cout << "mesh " << staticMeshNames[id] << ": " << staticBatch.meshFormat(id).name()
+                  << " (" << staticBatch.meshFormat(id).stride() << " bytes/vertex), max error position " << mesh.error.position
+                  << " texcoord " << mesh.error.texCoord << std::endl;
+    }
+    std::cout << "instances: " << instanceBatch.totalInstances() << " (" << instanceBatch.totalTriangles() << " triangles)" << std::endl;
 
+    // --gpu-culling: the instances are culled by a compute shader and drawn indirectly
+    // -------------------------------------------------------------------------------
+    GpuCuller gpuCuller;
+    if (options.gpuCulling && !gpuCuller.init(instanceBatch, "shaders/6.3.cull.cs"))
+    {
+        std::cout << "GPU culling shader failed, culling on the CPU instead" << std::endl;
+        options.gpuCulling = false;
+    }
+    HiZBuffer hiz;
+    Shader occluderShader, instancedOccluderShader;
+    if (options.gpuCulling && options.hizCulling)
+    {
+        Shader hizShader = shaderCache.load("shaders/6.4.hiz.vs", "shaders/6.4.hiz.fs");
+        hizShader.use();
+        hizShader.setInt("depth", 0);
+        hiz.init(hizShader);
+        occluderShader = shaderCache.load("shaders/6.1.cubemaps.vs", "shaders/6.4.depth.fs");
+        occluderShader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+        occluderShader.bindUniformBlock("Draw", UBO_BINDING_DRAW);
+        instancedOccluderShader = shaderCache.load("shaders/6.2.instanced.vs", "shaders/6.4.depth.fs");
+        instancedOccluderShader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    }
 
-    // cube VAO
-    unsigned int cubeVAO, cubeVBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), &cubeVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    // fort VAO
-    unsigned int fortVAO, fortVBO;
-    glGenVertexArrays(1, &fortVAO);
-    glGenBuffers(1, &fortVBO);
-    glBindVertexArray(fortVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, fortVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(fortVertices), &fortVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    // ground VAO
-    unsigned int groundVAO, groundVBO;
-    glGenVertexArrays(1, &groundVAO);
-    glGenBuffers(1, &groundVBO);
-    glBindVertexArray(groundVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, groundVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(groundVertices), &groundVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    // streets VAO
-    unsigned int streetsVAO, streetsVBO;
-    glGenVertexArrays(1, &streetsVAO);
-    glGenBuffers(1, &streetsVBO);
-    glBindVertexArray(streetsVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, streetsVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(streetsVertices), &streetsVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    // one BVH over every object for frustum culling: the static meshes are ids 0..meshCount-1,
+    // the instances follow (unless the GPU culls them)
+    // ------------------------------------------------------------------------------------------
+    std::vector<AABB> objectBounds(staticBatch.meshCount());
+    for (unsigned int id = 0; id < staticBatch.meshCount(); id++)
+    {
+        objectBounds[id].min = staticBatch.mesh(id).boundsMin;
+        objectBounds[id].max = staticBatch.mesh(id).boundsMax;
+    }
+    if (!options.gpuCulling)
+    {
+        std::vector<AABB> instanceBounds = instanceBatch.instanceBounds();
+        objectBounds.insert(objectBounds.end(), instanceBounds.begin(), instanceBounds.end());
+    }
+    const uint32_t firstInstanceObject = staticBatch.meshCount();
+    BoundingVolumeHierarchy bvh;
+    bvh.build(objectBounds);
+    std::vector<uint32_t> visibleObjects;
+    std::vector<char> staticVisible(staticBatch.meshCount(), 1);
+
+    // --cpu-occlusion: the scene pyramids and the fort walls are rasterized on the CPU every frame and
+    // hide the frustum-visible instances behind them, on a worker thread of their own (never queued
+    // behind the texture and terrain jobs of the shared pool) while this one submits
+    // ------------------------------------------------------------------------------------------------
+    const float nearPlane = 0.1f;
+    MaskedOcclusionCuller occlusionCuller;
+    ThreadPool occlusionWorker;
+    if (options.cpuOcclusion && (options.gpuCulling || !options.culling))
+    {
+        std::cout << "CPU occlusion culling needs CPU frustum culling, ignoring --cpu-occlusion" << std::endl;
+        options.cpuOcclusion = false;
+    }
+    if (options.cpuOcclusion || options.occlusionBenchmark)
+    {
+        const unsigned int OCCLUSION_WIDTH = 320;
+        occlusionCuller.init(&objectBounds, nearPlane);
+        occlusionCuller.resize(OCCLUSION_WIDTH, OCCLUSION_WIDTH * viewportHeight / viewportWidth);
+        occlusionCuller.addOccluderTriangles(occluderTriangles.data(), occluderTriangles.size());
+    }
+    if (options.cpuOcclusion)
+        occlusionWorker.start(1);
 
     // skybox VAO
     unsigned int skyboxVAO, skyboxVBO;
+    const GLsizei skyboxVertexCount = (GLsizei)(skyFloatCount / 3);
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
     glBindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, skyFloatCount * sizeof(float), skyVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
-    // load textures
-    // -------------
-    unsigned int cubeTexture = loadTexture("resources/textures/texturepyramid.jpeg");
-    unsigned int groundTexture = loadTexture("resources/textures/sand2.jpg");
-    unsigned int fortTexture = loadTexture("resources/textures/wall2.jpg");
-    unsigned int streetsTexture = loadTexture("resources/textures/sand.jpg");
-    vector<std::string> faces
+    // everything GL needed from the scene file is in its buffers now
+    sceneFile.close();
+
+    // load textures: decoded (or mapped from the compressed cache) on the worker pool,
+    // placeholders until they are uploaded
+    // ----------------------------------------------------------------------------------
+    ThreadPool workerPool;
+    workerPool.start();
+    TextureCache textureCache;
+    textureCache.init(options.textureCacheDirectory);
+    TextureStreamer textureStreamer;
+    textureStreamer.init(workerPool, &textureCache);
+    const unsigned int MATERIAL_TEXTURE_SIZE = 1024;
+    unsigned int materialTexture = textureStreamer.loadTextureArray(materialLayers, MATERIAL_TEXTURE_SIZE, MATERIAL_TEXTURE_SIZE);
+    std::vector<std::string> faces
     {
         "resources/textures/skybox2/nx.jpg",
         "resources/textures/skybox2/px.jpg",
@@ -516,128 +574,419 @@ int main()
         "resources/textures/skybox2/pz.jpg",
 
     };
-    unsigned int cubemapTexture = loadCubemap(faces);
+    unsigned int cubemapTexture = textureStreamer.loadCubemap(faces);
+
+    // dune terrain: the field baked once into a tile store on disk (on the worker pool), streamed
+    // around the camera and drawn with CDLOD
+    // ---------------------------------------------------------------------------------------------
+    Terrain terrain;
+    if (options.terrain && !terrain.init(dunes, options.terrainSize, options.terrainCacheDirectory, (size_t)(options.terrainBudget * 1024.0f * 1024.0f),
+                                         (float)MATERIAL_GROUND, (float)MATERIAL_STREETS, 1.0f / 16.0f, &workerPool))
+        return -1;
+    if (options.mipBenchmark)
+        benchmarkMipGeneration(faces, workerPool, std::cout);
+    if (options.occlusionBenchmark)
+    {
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)viewportWidth / (float)viewportHeight, nearPlane, 100.0f);
+        benchmarkOcclusion(occlusionCuller, projection * camera.GetViewMatrix(), objectBounds, firstInstanceObject, workerPool, std::cout);
+    }
+
+    const RenderPass materialPasses[MATERIAL_COUNT] = { PASS_PYRAMID, PASS_GROUND, PASS_FORT, PASS_STREETS };
 
     // shader configuration
     // --------------------
     shader.use();
-    shader.setInt("texture1", 0);
-
-    skyboxShader.use();
-    skyboxShader.setInt("skybox", 0);
-
-    groundShader.use();
-    groundShader.setInt("texture2", 0);
+    shader.setInt("materials", 0);
+    shader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+    shader.bindUniformBlock("Draw", UBO_BINDING_DRAW);
 
-    fortShader.use();
-    fortShader.setInt("texture3", 0);
+    instancedShader.use();
+    instancedShader.setInt("materials", 0);
+    instancedShader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
 
-    streetsShader.use();
-    streetsShader.setInt("texture4", 0);
+    if (options.terrain)
+    {
+        terrainShader.use();
+        terrainShader.setInt("materials", 0);
+        terrainShader.setInt("heights", Terrain::HEIGHT_UNIT);
+        terrainShader.setInt("splat", Terrain::SPLAT_UNIT);
+        terrainShader.setInt("pageTable", Terrain::PAGE_UNIT);
+        terrainShader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+        terrainShader.bindUniformBlock("Terrain", UBO_BINDING_TERRAIN);
+    }
 
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    skyboxShader.use();
+    skyboxShader.setInt("skybox", 0);
+    skyboxShader.bindUniformBlock("Camera", UBO_BINDING_CAMERA);
+
+    // camera matrices shared by every program, uploaded once per frame
+    // -----------------------------------------------------------------
+    UniformBuffer cameraBuffer;
+    cameraBuffer.create(sizeof(CameraBlock), UBO_BINDING_CAMERA);
+
+    // everything else written every frame (the camera block too) is sub-allocated from one fenced
+    // ring; a region fits the blocks, every instance and a generous number of terrain patches, and
+    // grows if a frame ever needs more
+    // ------------------------------------------------------------------------------------------
+    RingBuffer frameRing;
+    RingBuffer* ring = NULL;
+    if (options.ringFrames > 0)
     {
-        // per-frame time logic
-        // --------------------
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        GLsizeiptr regionBytes = sizeof(CameraBlock) + sizeof(TerrainBlock) + instanceBatch.totalInstances() * sizeof(InstanceData)
+                               + 4096 * sizeof(glm::vec4) + 4 * 256;
+        frameRing.create(regionBytes, options.ringFrames);
+        ring = &frameRing;
+    }
 
-        // input
-        // -----
-        processInput(window);
+    // per-pass GPU timings (--gpu-timers), read back a few frames late so they never stall
+    // -------------------------------------------------------------------------------------
+    GpuTimer gpuTimer;
+    if (options.gpuTimers)
+    {
+        gpuTimer.init({ "pyramid", "ground", "fort", "streets", "skybox" });
+        if (!options.gpuTimersCsv.empty())
+            gpuTimer.openCsv(options.gpuTimersCsv);
+    }
 
-        // render
-        // ------
+    // draws one frame of the scene into the currently bound framebuffer: every draw goes through
+    // the render queue, which sorts by state and depth and merges meshes sharing a material
+    // ------------------------------------------------------------------------------------------
+    RenderQueue renderQueue;
+    std::vector<DrawItem> opaqueItems;
+    RenderQueue occluderQueue;      // --hiz-culling depth pass
+    GpuTimer occluderTimer;         // never initialised, the occluder pass isn't timed
+    // objects are culled at farPlane, the terrain goes on to the horizon
+    const float farPlane = 100.0f;
+    const float drawDistance = options.terrain ? std::max(terrain.viewDistance(), farPlane) : farPlane;
+    bool firstFrame = true;
+    bool texturesLoaded = false;
+    auto renderScene = [&]()
+    {
+        if (!texturesLoaded && textureStreamer.update() == 0)
+        {
+            texturesLoaded = true;
+            std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - startupBegin;
+            std::cout << "fully loaded: " << loadTime.count() << " ms" << std::endl;
+        }
+        gpuTimer.beginFrame();
+        if (ring)
+            ring->beginFrame();
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // draw scene as normal
-        shader.use();
-        glm::mat4 model = glm::mat4(1.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        shader.setMat4("model", model);
-        shader.setMat4("view", view);
-        shader.setMat4("projection", projection);
-
-        // render piramid
-        glBindVertexArray(cubeVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, cubeTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 162);
-        glBindVertexArray(0);
+        CameraBlock cameraBlock;
+        cameraBlock.view = camera.GetViewMatrix();
+        cameraBlock.projection = glm::perspective(glm::radians(camera.Zoom), (float)viewportWidth / (float)viewportHeight, nearPlane, drawDistance);
+        if (!ring || !ring->bindUniform(UBO_BINDING_CAMERA, &cameraBlock, sizeof(cameraBlock)))
+        {
+            glBindBufferBase(GL_UNIFORM_BUFFER, UBO_BINDING_CAMERA, cameraBuffer.UBO);
+            cameraBuffer.update(&cameraBlock, sizeof(cameraBlock));
+        }
 
-        // render ground
-        groundShader.use();
+        renderQueue.begin(camera.Position, camera.Front, drawDistance);
+
+        glm::mat4 viewProjection = cameraBlock.projection * cameraBlock.view;
+        glm::mat4 objectProjection = glm::perspective(glm::radians(camera.Zoom), (float)viewportWidth / (float)viewportHeight, nearPlane, farPlane);
+        Frustum frustum = Frustum::fromMatrix(objectProjection * cameraBlock.view);
+        LodSelection lodSelection;
+        lodSelection.cameraPosition = camera.Position;
+        lodSelection.pixelsPerUnit = (float)viewportHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+        lodSelection.maxError = options.lodError;
+        const LodSelection* lod = options.lod ? &lodSelection : NULL;
+        if (options.culling)
+        {
+            bvh.cull(frustum, visibleObjects);
+            std::fill(staticVisible.begin(), staticVisible.end(), 0);
+            for (uint32_t id : visibleObjects)
+                if (id < firstInstanceObject)
+                    staticVisible[id] = 1;
+            // the occlusion job hands the instances back before they are drawn
+            if (options.cpuOcclusion)
+                occlusionCuller.cullAsync(occlusionWorker, viewProjection, visibleObjects, firstInstanceObject);
+            else if (!options.gpuCulling)
+                instanceBatch.uploadVisible(visibleObjects, firstInstanceObject, lod, ring);
+        }
+        else if (lod && !options.gpuCulling)
+        {
+            // nothing culled, but every instance still gets its level of detail
+            if (visibleObjects.empty())
+                for (uint32_t id = 0; id < firstInstanceObject + instanceBatch.totalInstances(); id++)
+                    visibleObjects.push_back(id);
+            instanceBatch.uploadVisible(visibleObjects, firstInstanceObject, lod, ring);
+        }
 
-        groundShader.setMat4("model", model);
-        groundShader.setMat4("view", view);
-        groundShader.setMat4("projection", projection);
+        // ground, wall and streets
+        opaqueItems.clear();
+        for (unsigned int id = 0; id < staticBatch.meshCount(); id++)
+        {
+            if (!staticVisible[id])
+                continue;
+            unsigned int material = staticBatch.mesh(id).material;
+            DrawItem item = staticBatch.drawItem(id);
+            item.pass = QUEUE_PASS_OPAQUE;
+            item.program = shader.ID;
+            item.textureTarget = GL_TEXTURE_2D_ARRAY;
+            item.texture = materialTexture;
+            // per-material timings need a draw per material; without them the queue merges them all
+            item.timerPass = gpuTimer.enabled() ? materialPasses[material] : -1;
+            opaqueItems.push_back(item);
+        }
 
-        glBindVertexArray(groundVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, groundTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(1);
+        // the terrain and the skybox don't need the instances, so they are queued (the queue sorts
+        // everything in execute()) while the occlusion job still runs; the terrain is never a Hi-Z
+        // occluder (its patches change every frame), so it stays out of opaqueItems
+        if (options.terrain)
+        {
+            terrain.update(camera.Position, Frustum::fromMatrix(viewProjection), ring);
+            if (terrain.patchCount() > 0)
+            {
+                DrawItem item = terrain.drawItem();
+                item.pass = QUEUE_PASS_OPAQUE;
+                item.program = terrainShader.ID;
+                item.textureTarget = GL_TEXTURE_2D_ARRAY;
+                item.texture = materialTexture;
+                item.timerPass = gpuTimer.enabled() ? PASS_GROUND : -1;
+                renderQueue.submit(item);
+            }
+        }
 
-        // render wall
-        fortShader.use();
+        // menggambar skybox (sorted after every opaque item)
+        DrawItem skybox;
+        skybox.pass = QUEUE_PASS_SKYBOX;
+        skybox.program = skyboxShader.ID;
+        skybox.textureTarget = GL_TEXTURE_CUBE_MAP;
+        skybox.texture = cubemapTexture;
+        skybox.VAO = skyboxVAO;
+        skybox.timerPass = PASS_SKYBOX;
+        skybox.count = skyboxVertexCount;
+        renderQueue.submit(skybox);
+
+        // piramid and mastaba instances: one indirect multi-draw after GPU culling (level 0 only), else a
+        // draw per mesh and level of detail
+        if (options.cpuOcclusion)
+        {
+            occlusionCuller.wait(visibleObjects);
+            instanceBatch.uploadVisible(visibleObjects, firstInstanceObject, lod, ring);
+        }
+        size_t firstInstanceItem = opaqueItems.size();
+        if (options.gpuCulling)
+            opaqueItems.push_back(gpuCuller.drawItem());
+        else
+            for (unsigned int id = 0; id < instanceBatch.meshCount(); id++)
+                for (unsigned int level = 0; level < instanceBatch.lodCount(id); level++)
+                    if (instanceBatch.visibleCount(id, level) > 0)
+                        opaqueItems.push_back(instanceBatch.drawItem(id, level));
+        for (size_t i = firstInstanceItem; i < opaqueItems.size(); i++)
+        {
+            DrawItem& item = opaqueItems[i];
+            item.pass = QUEUE_PASS_OPAQUE;
+            item.program = instancedShader.ID;
+            item.textureTarget = GL_TEXTURE_2D_ARRAY;
+            item.texture = materialTexture;
+            item.timerPass = gpuTimer.enabled() ? PASS_PYRAMID : -1;
+        }
+
+        if (options.gpuCulling)
+        {
+            // --hiz-culling: the occluders are the static meshes in view and the instances that were
+            // visible last frame (the indirect item still holds them until cull()), drawn with this
+            // frame's camera into the Hi-Z buffer
+            if (options.hizCulling)
+            {
+                hiz.resize(viewportWidth, viewportHeight);
+                occluderQueue.begin(camera.Position, camera.Front, farPlane);
+                for (size_t i = 0; i < opaqueItems.size(); i++)
+                {
+                    if (i >= firstInstanceItem && !gpuCuller.culled())
+                        continue;
+                    DrawItem item = opaqueItems[i];
+                    item.program = i < firstInstanceItem ? occluderShader.ID : instancedOccluderShader.ID;
+                    item.texture = 0;
+                    item.timerPass = -1;
+                    occluderQueue.submit(item);
+                }
+                hiz.begin();
+                occluderQueue.execute(occluderTimer);
+                hiz.end();
+            }
+            gpuCuller.cull(frustum, viewProjection, options.hizCulling ? &hiz : NULL);
+        }
+        for (const DrawItem& item : opaqueItems)
+            renderQueue.submit(item);
 
-        fortShader.setMat4("model", model);
-        fortShader.setMat4("view", view);
-        fortShader.setMat4("projection", projection);
 
-        glBindVertexArray(fortVAO);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, fortTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 240);
-        glBindVertexArray(1);
+        renderQueue.execute(gpuTimer);
+        if (ring)
+            ring->endFrame();
+        gpuTimer.endFrame();
+    };
 
-        // render streets
-        streetsShader.use();
+    // reports the first frame once it has actually finished on the GPU
+    auto firstFrameDone = [&]()
+    {
+        if (!firstFrame)
+            return;
+        firstFrame = false;
+        glFinish();
+        std::chrono::duration<double, std::milli> firstFrameTime = std::chrono::steady_clock::now() - startupBegin;
+        std::cout << "first frame: " << firstFrameTime.count() << " ms" << std::endl;
+    };
 
-        streetsShader.setMat4("model", model);
-        streetsShader.setMat4("view", view);
-        streetsShader.setMat4("projection", projection);
+    // frame pacing (--fps-cap), and with --on-demand whether anything on screen can have changed since
+    // the last frame drawn: the view, or a scene still loading textures or terrain tiles
+    // --------------------------------------------------------------------------------------------------
+    FramePacer pacer;
+    pacer.init(options.fpsCap, options.renderOnDemand);
+    FixedTimestep simulation;
+    simulation.init(options.simulationRate);
+    currentState.cameraPosition = camera.Position;
+    previousState = currentState;
+    // runs the steps this frame's time allows, then places the camera between the last two
+    auto advanceSimulation = [&](double frameSeconds)
+    {
+        unsigned int steps = simulation.advance(frameSeconds);
+        for (unsigned int step = 0; step < steps; step++)
+            simulate((float)simulation.stepSeconds());
+        camera.Position = glm::mix(previousState.cameraPosition, currentState.cameraPosition, simulation.alpha());
+    };
+    glm::vec3 drawnPosition(0.0f), drawnFront(0.0f);
+    float drawnZoom = 0.0f;
+    unsigned int drawnWidth = 0, drawnHeight = 0;
+    auto sceneChanged = [&]()
+    {
+        bool changed = camera.Position != drawnPosition || camera.Front != drawnFront || camera.Zoom != drawnZoom || viewportWidth != drawnWidth
+                    || viewportHeight != drawnHeight || !texturesLoaded || (options.terrain && terrain.streaming());
+        drawnPosition = camera.Position;
+        drawnFront = camera.Front;
+        drawnZoom = camera.Zoom;
+        drawnWidth = viewportWidth;
+        drawnHeight = viewportHeight;
+        return changed;
+    };
 
-        glBindVertexArray(streetsVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, streetsTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 180);
-        glBindVertexArray(1);
-
-
-        // menggambar skybox
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    std::chrono::duration<double, std::milli> startupTime = std::chrono::steady_clock::now() - startupBegin;
+    std::cout << "startup: " << startupTime.count() << " ms, peak RSS " << peakResidentBytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    if (options.headless)
+    {
+        // benchmark: fixed number of frames at a fixed camera, glFinish so every sample covers the GPU work
+        // ---------------------------------------------------------------------------------------------
+        OffscreenTarget target;
+        if (!target.create(options.width, options.height))
+            return -1;
+
+        FrameStats stats;
+        for (unsigned int i = 0; i < options.warmupFrames + options.frames; i++)
+        {
+            // measured frames always see the final textures
+            if (i == options.warmupFrames)
+            {
+                textureStreamer.finish();
+                if (options.terrain)
+                    terrain.finishStreaming(camera.Position);
+            }
+            advanceSimulation(pacer.beginFrame());
+            if (!pacer.needsFrame(sceneChanged() || i == options.warmupFrames))
+                continue;
+            auto frameStart = std::chrono::steady_clock::now();
+            renderScene();
+            firstFrameDone();
+            glFinish();
+            std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStart;
+            if (i >= options.warmupFrames)
+                stats.add(frameTime.count());
+            pacer.endFrame();
+        }
+        std::cout << "headless benchmark " << options.width << "x" << options.height << std::endl;
+        stats.report(std::cout);
+        target.destroy();
+    }
+    else
+    {
+        // render loop
+        // -----------
+        while (!glfwWindowShouldClose(window))
+        {
+            // per-frame time logic
+            // --------------------
+            double frameSeconds = pacer.beginFrame();
+
+            // input, then as many fixed simulation steps as the frame's time allows
+            // ---------------------------------------------------------------------
+            processInput(window);
+            advanceSimulation(frameSeconds);
+
+            // --on-demand: nothing changed, so sleep on the event queue instead of drawing the same frame;
+            // a held movement key counts as a change, as the first frame after waking is far too short
+            // for a simulation step to move the camera
+            // ------------------------------------------------------------------------------------------
+            bool moving = movementHeld[FORWARD] || movementHeld[BACKWARD] || movementHeld[LEFT] || movementHeld[RIGHT];
+            if (!pacer.needsFrame(sceneChanged() || moving))
+            {
+                glfwWaitEventsTimeout(0.25);
+                pacer.resume();
+                continue;
+            }
+
+            // render
+            // ------
+            renderScene();
+            firstFrameDone();
+
+            // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+            // -------------------------------------------------------------------------------
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+
+            // --fps-cap: sleep, then spin, until the frame's deadline
+            // -------------------------------------------------------
+            pacer.endFrame();
+        }
+    }
+
+    textureStreamer.report(std::cout);
+    renderQueue.report(std::cout);
+    bvh.report(std::cout);
+    occlusionCuller.report(std::cout);
+    instanceBatch.reportLod(std::cout);
+    terrain.report(std::cout);
+    frameRing.report(std::cout);
+    pacer.report(std::cout);
+    simulation.report(std::cout);
+    if (options.gpuCulling)
+    {
+        gpuCuller.report(std::cout);
+        gpuCuller.destroy();
+        hiz.destroy();
+    }
+    if (gpuTimer.enabled())
+    {
+        gpuTimer.report(std::cout);
+        gpuTimer.destroy();
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
     // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &cubeVAO);
+    textureStreamer.destroy();
+    workerPool.stop();
+    occlusionWorker.stop();
+    staticBatch.destroy();
+    instanceBatch.destroy();
+    terrain.destroy();
+    cameraBuffer.destroy();
+    if (ring)
+        frameRing.destroy();
+    shaderCache.destroy();
+    pacer.destroy();
     glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &cubeVBO);
     glDeleteBuffers(1, &skyboxVBO);
 
-    glfwTerminate();
+#ifdef PYRAMID_HEADLESS
+    headlessContext.destroy();
+#endif
+    if (!options.headless)
+        glfwTerminate();
     return 0;
 }
 
@@ -648,14 +997,26 @@ void processInput(GLFWwindow *window)
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+    // movement is applied by the simulation steps, not per frame
+    movementHeld[FORWARD] = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    movementHeld[BACKWARD] = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    movementHeld[LEFT] = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    movementHeld[RIGHT] = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+}
+
+// one fixed simulation step: the camera moves for the keys held (along where it looks now); animated
+// objects and particles step here too, with their state in SimulationState
+// ---------------------------------------------------------------------------------------------------
+void simulate(float stepSeconds)
+{
+    previousState = currentState;
+    glm::vec3 drawnPosition = camera.Position;
+    camera.Position = currentState.cameraPosition;
+    for (int direction = FORWARD; direction <= RIGHT; direction++)
+        if (movementHeld[direction])
+            camera.ProcessKeyboard((Camera_Movement)direction, stepSeconds);
+    currentState.cameraPosition = camera.Position;
+    camera.Position = drawnPosition;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -665,6 +1026,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    if (width > 0 && height > 0)
+    {
+        viewportWidth = (unsigned int)width;
+        viewportHeight = (unsigned int)height;
+    }
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -693,74 +1059,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(yoffset);
 }
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-
-unsigned int loadTexture(std::string path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
-unsigned int loadCubemap(vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        //unsigned char *data = stbi_load("resources/textures/texturepyramid.jpeg", &width, &height, &nrChannels, 0);
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
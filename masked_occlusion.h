@@ -0,0 +1,565 @@
+#ifndef MASKED_OCCLUSION_H
+#define MASKED_OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include "frustum_culler.h"
+#include "mesh_optimizer.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// CPU occlusion culling after Intel's Masked Occlusion Culling (Hasselgren, Andersson and
+// Akenine-Moller, 2016): a few big occluder meshes are rasterized into a small coarse depth buffer
+// and the boxes that survived frustum culling are tested against it in the same frame, so unlike
+// the Hi-Z path there is no GPU readback to wait for.
+//
+// The buffer is made of 32x8 pixel tiles without per-pixel depth. A tile holds one coverage bit per
+// pixel (a 32-bit mask per row, the eight rows fill one AVX2 register) and two depths: zMin0, a
+// bound for the whole tile, and zMin1, the farthest depth of the working layer, i.e. of the
+// triangles merged into the mask so far. Depth is 1/w, larger is nearer. Once the mask is full the
+// working layer becomes the tile bound (when it is nearer) and starts over. Triangles are
+// rasterized a tile at a time, eight rows at once: every edge gives one x intercept per row and the
+// intercepts become row masks with variable shifts.
+//
+// A box is hidden when in every tile its screen rectangle touches it is behind zMin0, or all of its
+// pixels are in the mask and it is behind zMin1. The buffer only ever claims less than the real
+// occluders cover: a triangle's depth in a tile is the farthest its plane gets over the tile,
+// triangles crossing the near plane are left out and boxes crossing it are visible.
+//
+// The AVX2 kernels and the scalar ones build the same buffer and give the same answers.
+// ---------------------------------------------------------------------------------------------------
+class MaskedOcclusionCuller
+{
+public:
+    static const int TILE_WIDTH = 32;
+    static const int TILE_HEIGHT = 8;
+
+    // boxes are the object bounds the culled ids index (kept by pointer); nearPlane is the camera's,
+    // geometry in front of it is clipped by GL and can't hide anything
+    void init(const std::vector<AABB>* objectBoxes, float nearPlane)
+    {
+        boxes = objectBoxes;
+        nearW = nearPlane;
+        avx2 = cpuHasAVX2();
+    }
+
+    // the triangles of mesh placed by model (e.g. an instance transform), kept in world space
+    void addOccluder(const IndexedMesh& mesh, const glm::mat4& model)
+    {
+        appendOccluderTriangles(mesh, model, occluderVertices);
+    }
+
+    // triangles already in world space, three corners each (appendOccluderTriangles' output)
+    void addOccluderTriangles(const glm::vec3* corners, size_t count)
+    {
+        occluderVertices.insert(occluderVertices.end(), corners, corners + count);
+    }
+
+    // the corners of mesh's triangles placed by model, in world space
+    static void appendOccluderTriangles(const IndexedMesh& mesh, const glm::mat4& model, std::vector<glm::vec3>& corners)
+    {
+        for (unsigned int index : mesh.indices)
+        {
+            const float* v = &mesh.vertices[(size_t)index * mesh.floatsPerVertex];
+            corners.push_back(glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f)));
+        }
+    }
+
+    // the buffer resolution, rounded up to whole tiles; the old contents are gone
+    void resize(unsigned int newWidth, unsigned int newHeight)
+    {
+        tilesX = std::max((int)(newWidth + TILE_WIDTH - 1) / TILE_WIDTH, 1);
+        tilesY = std::max((int)(newHeight + TILE_HEIGHT - 1) / TILE_HEIGHT, 1);
+        width = tilesX * TILE_WIDTH;
+        height = tilesY * TILE_HEIGHT;
+        tiles.assign(tilesX * tilesY, Tile());
+    }
+
+    // the benchmark switches kernels; ignored on CPUs without AVX2
+    void useAVX2(bool enable) { avx2 = enable && cpuHasAVX2(); }
+    bool usingAVX2() const { return avx2; }
+    unsigned int occluderTriangles() const { return (unsigned int)(occluderVertices.size() / 3); }
+    int bufferWidth() const { return width; }
+    int bufferHeight() const { return height; }
+
+    // clears the buffer and rasterizes every occluder seen through viewProjection
+    void renderOccluders(const glm::mat4& viewProjection)
+    {
+        clipFromWorld = viewProjection;
+        for (Tile& tile : tiles)
+            tile = Tile();
+        for (size_t i = 0; i + 2 < occluderVertices.size(); i += 3)
+            rasterizeTriangle(&occluderVertices[i]);
+    }
+
+    // false when the box is hidden behind the occluders of the last renderOccluders()
+    bool testBox(const AABB& box) const
+    {
+        float minX, maxX, minY, maxY, zBox;
+#ifdef PYRAMID_SSE2
+        bool inFront = avx2 ? projectBoxAVX2(box, minX, maxX, minY, maxY, zBox) : projectBox(box, minX, maxX, minY, maxY, zBox);
+#else
+        bool inFront = projectBox(box, minX, maxX, minY, maxY, zBox);
+#endif
+        if (!inFront)
+            return true;
+        // off the buffer entirely: that is for the frustum culler to decide
+        int px0 = std::max((int)std::floor(minX), 0), px1 = std::min((int)std::floor(maxX), width - 1);
+        int py0 = std::max((int)std::floor(minY), 0), py1 = std::min((int)std::floor(maxY), height - 1);
+        if (px0 > px1 || py0 > py1)
+            return true;
+
+        for (int ty = py0 / TILE_HEIGHT; ty <= py1 / TILE_HEIGHT; ty++)
+        {
+            for (int tx = px0 / TILE_WIDTH; tx <= px1 / TILE_WIDTH; tx++)
+            {
+                const Tile& tile = tiles[ty * tilesX + tx];
+                if (zBox < tile.zMin0)
+                    continue;
+                if (!(zBox < tile.zMin1))
+                    return true;
+                int tileX = tx * TILE_WIDTH, tileY = ty * TILE_HEIGHT;
+                int first = std::max(px0 - tileX, 0), last = std::min(px1 - tileX, TILE_WIDTH - 1);
+                uint32_t columns = (0xffffffffu << first) & (0xffffffffu >> (TILE_WIDTH - 1 - last));
+#ifdef PYRAMID_SSE2
+                bool covered = avx2 ? coversRectAVX2(tile, columns, py0 - tileY, py1 - tileY) : coversRect(tile, columns, py0 - tileY, py1 - tileY);
+#else
+                bool covered = coversRect(tile, columns, py0 - tileY, py1 - tileY);
+#endif
+                if (!covered)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // renders the occluders, then tests the candidates: ids below firstTested pass untested, the
+    // others are kept when testBox() says so; visible gets the survivors in the same order
+    void cull(const glm::mat4& viewProjection, const std::vector<uint32_t>& candidates, uint32_t firstTested, std::vector<uint32_t>& visible)
+    {
+        typedef std::chrono::steady_clock Clock;
+        auto start = Clock::now();
+        renderOccluders(viewProjection);
+        auto rendered = Clock::now();
+
+        visible.clear();
+        unsigned int tested = 0;
+        for (uint32_t id : candidates)
+        {
+            if (id >= firstTested)
+            {
+                tested++;
+                if (!testBox((*boxes)[id]))
+                    continue;
+            }
+            visible.push_back(id);
+        }
+        std::chrono::duration<double, std::milli> renderTime = rendered - start, testTime = Clock::now() - rendered;
+        frames++;
+        totalRenderMs += renderTime.count();
+        totalTestMs += testTime.count();
+        totalTested += tested;
+        totalOccluded += (unsigned int)(candidates.size() - visible.size());
+    }
+
+    // runs cull() as a job on pool; everything here belongs to the job until wait(), the caller's
+    // candidate list is copied so it can go on using it
+    void cullAsync(ThreadPool& pool, const glm::mat4& viewProjection, const std::vector<uint32_t>& candidates, uint32_t firstTested)
+    {
+        pendingCandidates = candidates;
+        std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+        pending = done->get_future();
+        pool.submit([this, viewProjection, firstTested, done]()
+        {
+            cull(viewProjection, pendingCandidates, firstTested, pendingVisible);
+            done->set_value();
+        });
+    }
+
+    // blocks until the job from cullAsync() is done and hands over its result
+    void wait(std::vector<uint32_t>& visible)
+    {
+        if (!pending.valid())
+            return;
+        auto start = std::chrono::steady_clock::now();
+        pending.get();
+        std::chrono::duration<double, std::milli> waitTime = std::chrono::steady_clock::now() - start;
+        totalWaitMs += waitTime.count();
+        visible.swap(pendingVisible);
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (frames == 0)
+            return;
+        out << "cpu occlusion (" << (avx2 ? "avx2" : "scalar") << ", " << occluderTriangles() << " occluder triangles, "
+            << width << "x" << height << "): raster " << totalRenderMs / frames << " ms, test " << totalTestMs / frames
+            << " ms for " << totalTested / frames << " boxes, " << totalOccluded / frames << " occluded, main thread waited "
+            << totalWaitMs / frames << " ms avg" << std::endl;
+    }
+
+private:
+    // zMin0 starts infinitely far (1/w = 0), the empty working layer has no depth yet
+    struct Tile
+    {
+        uint32_t mask[TILE_HEIGHT] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        float zMin0 = 0.0f;
+        float zMin1 = FLT_MAX;
+    };
+
+    // one triangle in buffer space: the edges bounding each row from the left and from the right as
+    // x = slope * y + offset, the rows allowed by horizontal edges and the plane of 1/w
+    struct TriangleSetup
+    {
+        float leftSlope[3], leftOffset[3], rightSlope[3], rightOffset[3];
+        int leftEdges = 0, rightEdges = 0;
+        float yMin = -FLT_MAX, yMax = FLT_MAX;
+        float minX, maxX, minY, maxY;
+        float zA, zB, zC, zMin;
+    };
+
+    const std::vector<AABB>* boxes = NULL;
+    float nearW = 0.1f;
+    bool avx2 = false;
+    std::vector<glm::vec3> occluderVertices;
+    std::vector<Tile> tiles;
+    int tilesX = 0, tilesY = 0, width = 0, height = 0;
+    glm::mat4 clipFromWorld = glm::mat4(1.0f);
+
+    std::future<void> pending;
+    std::vector<uint32_t> pendingCandidates;
+    std::vector<uint32_t> pendingVisible;
+
+    unsigned int frames = 0;
+    double totalRenderMs = 0.0;
+    double totalTestMs = 0.0;
+    double totalWaitMs = 0.0;
+    unsigned long long totalTested = 0;
+    unsigned long long totalOccluded = 0;
+
+    // pixel centres of the rows of a tile, relative to its first row
+    static const float* rowCenters()
+    {
+        static const float centers[TILE_HEIGHT] = { 0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f };
+        return centers;
+    }
+
+    void rasterizeTriangle(const glm::vec3* vertices)
+    {
+        float x[3], y[3], z[3];
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 clip = clipFromWorld * glm::vec4(vertices[i], 1.0f);
+            if (clip.w < nearW)
+                return;
+            z[i] = 1.0f / clip.w;
+            x[i] = (clip.x * z[i] * 0.5f + 0.5f) * (float)width;
+            y[i] = (clip.y * z[i] * 0.5f + 0.5f) * (float)height;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (!(std::fabs(area) > 0.0f))
+            return;
+
+        TriangleSetup setup;
+        setup.minX = std::min(std::min(x[0], x[1]), x[2]);
+        setup.maxX = std::max(std::max(x[0], x[1]), x[2]);
+        setup.minY = std::min(std::min(y[0], y[1]), y[2]);
+        setup.maxY = std::max(std::max(y[0], y[1]), y[2]);
+        int px0 = std::max((int)std::floor(setup.minX), 0), px1 = std::min((int)std::floor(setup.maxX), width - 1);
+        int py0 = std::max((int)std::floor(setup.minY), 0), py1 = std::min((int)std::floor(setup.maxY), height - 1);
+        if (px0 > px1 || py0 > py1)
+            return;
+
+        // edge functions a * x + b * y + c, oriented to be >= 0 inside whatever the winding
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        for (int i = 0; i < 3; i++)
+        {
+            int j = (i + 1) % 3;
+            float a = (y[i] - y[j]) * sign, b = (x[j] - x[i]) * sign, c = (x[i] * y[j] - x[j] * y[i]) * sign;
+            if (a > 0.0f)
+            {
+                setup.leftSlope[setup.leftEdges] = -b / a;
+                setup.leftOffset[setup.leftEdges++] = -c / a;
+            }
+            else if (a < 0.0f)
+            {
+                setup.rightSlope[setup.rightEdges] = -b / a;
+                setup.rightOffset[setup.rightEdges++] = -c / a;
+            }
+            else if (b > 0.0f)
+                setup.yMin = std::max(setup.yMin, -c / b);
+            else if (b < 0.0f)
+                setup.yMax = std::min(setup.yMax, -c / b);
+        }
+        setup.zA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+        setup.zB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+        setup.zC = z[0] - setup.zA * x[0] - setup.zB * y[0];
+        setup.zMin = std::min(std::min(z[0], z[1]), z[2]);
+
+        for (int ty = py0 / TILE_HEIGHT; ty <= py1 / TILE_HEIGHT; ty++)
+        {
+            for (int tx = px0 / TILE_WIDTH; tx <= px1 / TILE_WIDTH; tx++)
+            {
+                Tile& tile = tiles[ty * tilesX + tx];
+                int tileX = tx * TILE_WIDTH, tileY = ty * TILE_HEIGHT;
+                // the farthest the plane gets over the part of the tile inside the triangle's bounds
+                float x0 = std::max((float)tileX, setup.minX), x1 = std::min((float)(tileX + TILE_WIDTH), setup.maxX);
+                float y0 = std::max((float)tileY, setup.minY), y1 = std::min((float)(tileY + TILE_HEIGHT), setup.maxY);
+                float zTile = setup.zC + std::min(setup.zA * x0, setup.zA * x1) + std::min(setup.zB * y0, setup.zB * y1);
+                zTile = std::max(zTile, setup.zMin);
+                if (zTile <= tile.zMin0)
+                    continue;
+#ifdef PYRAMID_SSE2
+                if (avx2)
+                    mergeTileAVX2(tile, setup, tileX, tileY, zTile);
+                else
+                    mergeTile(tile, setup, tileX, tileY, zTile);
+#else
+                mergeTile(tile, setup, tileX, tileY, zTile);
+#endif
+            }
+        }
+    }
+
+    // covered pixels of one row: centres from ceil(left - 0.5) to floor(right - 0.5), clamped to the tile
+    static uint32_t rowMask(float left, float right, float tileX)
+    {
+        float start = std::ceil(std::min(std::max(left - 0.5f - tileX, 0.0f), 32.0f));
+        float end = std::floor(std::min(std::max(right - 0.5f - tileX, -1.0f), 31.0f)) + 1.0f;
+        int first = (int)start, count = (int)end;
+        uint32_t fromFirst = first >= 32 ? 0u : 0xffffffffu << first;
+        uint32_t toEnd = count <= 0 ? 0u : 0xffffffffu >> (32 - count);
+        return fromFirst & toEnd;
+    }
+
+    void mergeTile(Tile& tile, const TriangleSetup& setup, int tileX, int tileY, float zTile) const
+    {
+        uint32_t coverage[TILE_HEIGHT];
+        uint32_t any = 0;
+        for (int row = 0; row < TILE_HEIGHT; row++)
+        {
+            float rowY = (float)tileY + rowCenters()[row];
+            float left = -1e30f, right = 1e30f;
+            for (int i = 0; i < setup.leftEdges; i++)
+                left = std::max(left, setup.leftSlope[i] * rowY + setup.leftOffset[i]);
+            for (int i = 0; i < setup.rightEdges; i++)
+                right = std::min(right, setup.rightSlope[i] * rowY + setup.rightOffset[i]);
+            if (!(rowY >= setup.yMin && rowY <= setup.yMax))
+                right = -1e30f;
+            coverage[row] = rowMask(left, right, (float)tileX);
+            any |= coverage[row];
+        }
+        if (any == 0)
+            return;
+
+        uint32_t full = 0xffffffffu;
+        for (int row = 0; row < TILE_HEIGHT; row++)
+        {
+            tile.mask[row] |= coverage[row];
+            full &= tile.mask[row];
+        }
+        tile.zMin1 = std::min(tile.zMin1, zTile);
+        if (full == 0xffffffffu)
+            resetLayer(tile);
+    }
+
+    // the full working layer now bounds the whole tile
+    static void resetLayer(Tile& tile)
+    {
+        tile.zMin0 = std::max(tile.zMin0, tile.zMin1);
+        tile.zMin1 = FLT_MAX;
+        for (int row = 0; row < TILE_HEIGHT; row++)
+            tile.mask[row] = 0;
+    }
+
+    // the eight corners in buffer space; false when one of them is in front of the near plane
+    bool projectBox(const AABB& box, float& minX, float& maxX, float& minY, float& maxY, float& zBox) const
+    {
+        minX = minY = FLT_MAX;
+        maxX = maxY = -FLT_MAX;
+        zBox = 0.0f;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float cx = corner & 1 ? box.max.x : box.min.x;
+            float cy = corner & 2 ? box.max.y : box.min.y;
+            float cz = corner & 4 ? box.max.z : box.min.z;
+            float w = clipFromWorld[0][3] * cx + clipFromWorld[1][3] * cy + clipFromWorld[2][3] * cz + clipFromWorld[3][3];
+            if (w < nearW)
+                return false;
+            float invW = 1.0f / w;
+            float sx = ((clipFromWorld[0][0] * cx + clipFromWorld[1][0] * cy + clipFromWorld[2][0] * cz + clipFromWorld[3][0]) * invW * 0.5f + 0.5f) * (float)width;
+            float sy = ((clipFromWorld[0][1] * cx + clipFromWorld[1][1] * cy + clipFromWorld[2][1] * cz + clipFromWorld[3][1]) * invW * 0.5f + 0.5f) * (float)height;
+            minX = std::min(minX, sx);
+            maxX = std::max(maxX, sx);
+            minY = std::min(minY, sy);
+            maxY = std::max(maxY, sy);
+            zBox = std::max(zBox, invW);
+        }
+        return true;
+    }
+
+    // rows first to last of the tile (clamped) all hold the columns
+    static bool coversRect(const Tile& tile, uint32_t columns, int first, int last)
+    {
+        for (int row = std::max(first, 0); row <= std::min(last, TILE_HEIGHT - 1); row++)
+            if ((columns & ~tile.mask[row]) != 0)
+                return false;
+        return true;
+    }
+
+#ifdef PYRAMID_SSE2
+    // mergeTile() with the eight rows in the lanes of one register
+    PYRAMID_TARGET_AVX2 void mergeTileAVX2(Tile& tile, const TriangleSetup& setup, int tileX, int tileY, float zTile) const
+    {
+        __m256 rowY = _mm256_add_ps(_mm256_set1_ps((float)tileY), _mm256_loadu_ps(rowCenters()));
+        __m256 left = _mm256_set1_ps(-1e30f), right = _mm256_set1_ps(1e30f);
+        for (int i = 0; i < setup.leftEdges; i++)
+            left = _mm256_max_ps(left, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(setup.leftSlope[i]), rowY), _mm256_set1_ps(setup.leftOffset[i])));
+        for (int i = 0; i < setup.rightEdges; i++)
+            right = _mm256_min_ps(right, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(setup.rightSlope[i]), rowY), _mm256_set1_ps(setup.rightOffset[i])));
+        __m256 inside = _mm256_and_ps(_mm256_cmp_ps(rowY, _mm256_set1_ps(setup.yMin), _CMP_GE_OQ),
+                                      _mm256_cmp_ps(rowY, _mm256_set1_ps(setup.yMax), _CMP_LE_OQ));
+        right = _mm256_blendv_ps(_mm256_set1_ps(-1e30f), right, inside);
+
+        __m256 half = _mm256_set1_ps(0.5f), x = _mm256_set1_ps((float)tileX);
+        __m256 start = _mm256_ceil_ps(_mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(left, half), x), _mm256_setzero_ps()), _mm256_set1_ps(32.0f)));
+        __m256 end = _mm256_add_ps(_mm256_floor_ps(_mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_sub_ps(right, half), x), _mm256_set1_ps(-1.0f)), _mm256_set1_ps(31.0f))),
+                                   _mm256_set1_ps(1.0f));
+        // shifts by 32 or more give 0, which is exactly the empty row
+        __m256i ones = _mm256_set1_epi32(-1);
+        __m256i coverage = _mm256_and_si256(_mm256_sllv_epi32(ones, _mm256_cvttps_epi32(start)),
+                                            _mm256_srlv_epi32(ones, _mm256_sub_epi32(_mm256_set1_epi32(32), _mm256_cvttps_epi32(end))));
+        if (_mm256_testz_si256(coverage, coverage))
+            return;
+
+        __m256i mask = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)tile.mask), coverage);
+        _mm256_storeu_si256((__m256i*)tile.mask, mask);
+        tile.zMin1 = std::min(tile.zMin1, zTile);
+        if (_mm256_testc_si256(mask, ones))
+            resetLayer(tile);
+    }
+
+    // projectBox() with the eight corners in the lanes of one register
+    PYRAMID_TARGET_AVX2 bool projectBoxAVX2(const AABB& box, float& minX, float& maxX, float& minY, float& maxY, float& zBox) const
+    {
+        __m256 cx = _mm256_setr_ps(box.min.x, box.max.x, box.min.x, box.max.x, box.min.x, box.max.x, box.min.x, box.max.x);
+        __m256 cy = _mm256_setr_ps(box.min.y, box.min.y, box.max.y, box.max.y, box.min.y, box.min.y, box.max.y, box.max.y);
+        __m256 cz = _mm256_setr_ps(box.min.z, box.min.z, box.min.z, box.min.z, box.max.z, box.max.z, box.max.z, box.max.z);
+        __m256 clip[4];
+        for (int i = 0; i < 4; i++)
+            clip[i] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(clipFromWorld[0][i]), cx), _mm256_mul_ps(_mm256_set1_ps(clipFromWorld[1][i]), cy)),
+                                                  _mm256_mul_ps(_mm256_set1_ps(clipFromWorld[2][i]), cz)), _mm256_set1_ps(clipFromWorld[3][i]));
+        __m256 w = clip[3];
+        if (_mm256_movemask_ps(_mm256_cmp_ps(w, _mm256_set1_ps(nearW), _CMP_LT_OQ)) != 0)
+            return false;
+        __m256 invW = _mm256_div_ps(_mm256_set1_ps(1.0f), w);
+        __m256 half = _mm256_set1_ps(0.5f);
+        __m256 sx = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clip[0], invW), half), half), _mm256_set1_ps((float)width));
+        __m256 sy = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(clip[1], invW), half), half), _mm256_set1_ps((float)height));
+
+        float lanes[3][8];
+        _mm256_storeu_ps(lanes[0], sx);
+        _mm256_storeu_ps(lanes[1], sy);
+        _mm256_storeu_ps(lanes[2], invW);
+        minX = maxX = lanes[0][0];
+        minY = maxY = lanes[1][0];
+        zBox = lanes[2][0];
+        for (int corner = 1; corner < 8; corner++)
+        {
+            minX = std::min(minX, lanes[0][corner]);
+            maxX = std::max(maxX, lanes[0][corner]);
+            minY = std::min(minY, lanes[1][corner]);
+            maxY = std::max(maxY, lanes[1][corner]);
+            zBox = std::max(zBox, lanes[2][corner]);
+        }
+        return true;
+    }
+
+    // coversRect() with the eight rows in the lanes of one register
+    PYRAMID_TARGET_AVX2 static bool coversRectAVX2(const Tile& tile, uint32_t columns, int first, int last)
+    {
+        __m256i rows = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i inside = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(first), rows),
+                                             _mm256_andnot_si256(_mm256_cmpgt_epi32(rows, _mm256_set1_epi32(last)), _mm256_set1_epi32(-1)));
+        __m256i rect = _mm256_and_si256(inside, _mm256_set1_epi32((int)columns));
+        return _mm256_testc_si256(_mm256_loadu_si256((const __m256i*)tile.mask), rect) != 0;
+    }
+#endif
+};
+
+// --occlusion-benchmark: rasterizes the occluders and tests every box of the culler (ids from
+// firstTested on) from one camera with each kernel this CPU has, checks they agree and prints the
+// times per frame and per box
+// ---------------------------------------------------------------------------------------------------
+inline void benchmarkOcclusion(MaskedOcclusionCuller& culler, const glm::mat4& viewProjection, const std::vector<AABB>& boxes,
+                               uint32_t firstTested, ThreadPool& pool, std::ostream& out)
+{
+    pool.wait(); // texture loads would share the cores with the timed runs
+    const int RUNS = 3;
+    const int RASTER_REPEATS = 20;
+    typedef std::chrono::steady_clock Clock;
+    auto best = [&](const std::function<void()>& work)
+    {
+        double fastest = 0.0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            auto start = Clock::now();
+            work();
+            std::chrono::duration<double, std::milli> time = Clock::now() - start;
+            fastest = run == 0 ? time.count() : std::min(fastest, time.count());
+        }
+        return fastest;
+    };
+
+    size_t tested = boxes.size() > firstTested ? boxes.size() - firstTested : 0;
+    out << "occlusion benchmark: " << culler.occluderTriangles() << " occluder triangles into " << culler.bufferWidth() << "x"
+        << culler.bufferHeight() << ", " << tested << " boxes, best of " << RUNS << std::endl;
+    bool wasAVX2 = culler.usingAVX2();
+    std::vector<char> reference;
+    double scalarRaster = 0.0, scalarTest = 0.0;
+    for (int kernel = 0; kernel < 2; kernel++)
+    {
+        bool avx2 = kernel == 1;
+        if (avx2 && !cpuHasAVX2())
+            continue;
+        culler.useAVX2(avx2);
+        double raster = best([&]()
+        {
+            for (int i = 0; i < RASTER_REPEATS; i++)
+                culler.renderOccluders(viewProjection);
+        }) / RASTER_REPEATS;
+        std::vector<char> visible(tested);
+        double test = best([&]()
+        {
+            for (size_t i = 0; i < tested; i++)
+                visible[i] = culler.testBox(boxes[firstTested + i]);
+        });
+        size_t occluded = (size_t)std::count(visible.begin(), visible.end(), 0);
+        out << "  " << (avx2 ? "avx2  " : "scalar") << ": raster " << raster << " ms, test " << test << " ms ("
+            << (tested ? test * 1e6 / tested : 0.0) << " ns/box), " << occluded << " occluded";
+        if (avx2)
+            out << ", x" << scalarRaster / raster << " raster, x" << scalarTest / test << " test"
+                << (visible == reference ? ", same results" : ", RESULTS DIFFER");
+        else
+        {
+            reference = visible;
+            scalarRaster = raster;
+            scalarTest = test;
+        }
+        out << std::endl;
+    }
+    culler.useAVX2(wasAVX2);
+}
+
+#endif
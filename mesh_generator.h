@@ -0,0 +1,298 @@
+#ifndef MESH_GENERATOR_H
+#define MESH_GENERATOR_H
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+// procedural scene geometry: pyramids (pointed or truncated), stepped pyramids, walled enclosures
+// with a gate and ground tiles. Every shape is a flat triangle list of 5 floats per vertex
+// (position, texcoord) wound counter-clockwise seen from outside.
+//
+// Each shape is written once, by a constexpr writeMesh() over a writer: ArrayMeshWriter fills a
+// std::array during compilation, so a fixed scene is in the binary and costs no startup work,
+// VectorMeshWriter fills a std::vector for shapes only known at runtime. vertexCount() is constexpr
+// as well, so array sizes and draw counts always come from the generator:
+//
+//     constexpr PyramidShape MASTABA = { 1.0f, 1.0f, 0.7f, 8.0f };
+//     static constexpr auto mastaba = generateMeshArray<vertexCount(MASTABA)>(MASTABA);
+//     std::vector<float> pyramid = generateMesh(PyramidShape());
+// ------------------------------------------------------------------------------------------------
+
+// square pyramid standing on y = 0 around the origin; a top ratio above 0 cuts it flat at that
+// fraction of the base (a mastaba), the texture repeats uvTiling times across a face
+struct PyramidShape
+{
+    float halfWidth = 1.0f;
+    float height = 1.0f;
+    float topRatio = 0.0f;
+    float uvTiling = 20.0f;
+};
+
+// square pyramid of steps, each a riser and a tread going around the square; the last tread
+// closes at the top
+struct SteppedPyramidShape
+{
+    float halfWidth = 1.0f;
+    float height = 1.0f;
+    unsigned int steps = 24;
+    float uvTiling = 20.0f;
+};
+
+// square enclosure of walls around the origin: the inner faces of the front (+z) and back walls
+// lie at +-halfSize, the side walls stand inside them. The front wall has a gate in its middle
+// (none when gateWidth is 0). The texture repeats uvTiling times per world unit.
+struct WallRingShape
+{
+    float halfSize = 14.0f;
+    float thickness = 0.5f;
+    float height = 1.0f;
+    float baseY = 0.0f;
+    float gateWidth = 4.0f;
+    float uvTiling = 1.0f;
+};
+
+// flat rectangle at height y facing up, divisions x divisions quads; the texture repeats uvTiling
+// times per world unit
+struct GroundTileShape
+{
+    float minX = -1.0f;
+    float minZ = -1.0f;
+    float maxX = 1.0f;
+    float maxZ = 1.0f;
+    float y = 0.0f;
+    float uvTiling = 1.0f;
+    unsigned int divisions = 1;
+};
+
+// writes into a std::array of exactly VertexCount vertices, usable in constant expressions
+template <size_t VertexCount>
+struct ArrayMeshWriter
+{
+    std::array<float, VertexCount * 5> floats = {};
+    size_t count = 0;
+
+    constexpr void vertex(float x, float y, float z, float u, float v)
+    {
+        floats[count * 5] = x;
+        floats[count * 5 + 1] = y;
+        floats[count * 5 + 2] = z;
+        floats[count * 5 + 3] = u;
+        floats[count * 5 + 4] = v;
+        count++;
+    }
+};
+
+struct VectorMeshWriter
+{
+    std::vector<float> floats;
+    size_t count = 0;
+
+    void vertex(float x, float y, float z, float u, float v)
+    {
+        floats.insert(floats.end(), { x, y, z, u, v });
+        count++;
+    }
+};
+
+// one vertex before it is written
+struct MeshCorner
+{
+    float x, y, z, u, v;
+};
+
+namespace mesh_generator_detail
+{
+    template <typename Writer>
+    constexpr void triangle(Writer& out, const MeshCorner& a, const MeshCorner& b, const MeshCorner& c)
+    {
+        out.vertex(a.x, a.y, a.z, a.u, a.v);
+        out.vertex(b.x, b.y, b.z, b.u, b.v);
+        out.vertex(c.x, c.y, c.z, c.u, c.v);
+    }
+
+    // a, b, c, d counter-clockwise
+    template <typename Writer>
+    constexpr void quad(Writer& out, const MeshCorner& a, const MeshCorner& b, const MeshCorner& c, const MeshCorner& d)
+    {
+        triangle(out, a, b, c);
+        triangle(out, a, c, d);
+    }
+
+    // a point of the +z face of a square shape (t across the face, r out from the centre) turned
+    // about +Y by a quarter turn; exact quarter turns keep the edges neighbouring faces share
+    // identical, + 0.0f turns -0 into 0 so they weld
+    constexpr MeshCorner faceCorner(int quarterTurns, float t, float y, float r, float u, float v)
+    {
+        const float cosines[4] = { 1.0f, 0.0f, -1.0f, 0.0f };
+        const float sines[4] = { 0.0f, 1.0f, 0.0f, -1.0f };
+        float c = cosines[quarterTurns], s = sines[quarterTurns];
+        return MeshCorner{ c * t + s * r + 0.0f, y, c * r - s * t + 0.0f, u, v };
+    }
+
+    // the square base of a pyramid, facing down
+    template <typename Writer>
+    constexpr void base(Writer& out, float halfWidth, float uvTiling)
+    {
+        quad(out, MeshCorner{ -halfWidth, 0.0f, -halfWidth, 0.0f, uvTiling }, MeshCorner{ halfWidth, 0.0f, -halfWidth, uvTiling, uvTiling },
+             MeshCorner{ halfWidth, 0.0f, halfWidth, uvTiling, 0.0f }, MeshCorner{ -halfWidth, 0.0f, halfWidth, 0.0f, 0.0f });
+    }
+
+    // axis-aligned box without its bottom face, texture mapped per world unit
+    template <typename Writer>
+    constexpr void box(Writer& out, float x0, float y0, float z0, float x1, float y1, float z1, float uvTiling)
+    {
+        float h = (y1 - y0) * uvTiling;
+        // +z, -z, +x, -x, top
+        quad(out, MeshCorner{ x0, y0, z1, x0 * uvTiling, 0.0f }, MeshCorner{ x1, y0, z1, x1 * uvTiling, 0.0f },
+             MeshCorner{ x1, y1, z1, x1 * uvTiling, h }, MeshCorner{ x0, y1, z1, x0 * uvTiling, h });
+        quad(out, MeshCorner{ x1, y0, z0, -x1 * uvTiling, 0.0f }, MeshCorner{ x0, y0, z0, -x0 * uvTiling, 0.0f },
+             MeshCorner{ x0, y1, z0, -x0 * uvTiling, h }, MeshCorner{ x1, y1, z0, -x1 * uvTiling, h });
+        quad(out, MeshCorner{ x1, y0, z1, -z1 * uvTiling, 0.0f }, MeshCorner{ x1, y0, z0, -z0 * uvTiling, 0.0f },
+             MeshCorner{ x1, y1, z0, -z0 * uvTiling, h }, MeshCorner{ x1, y1, z1, -z1 * uvTiling, h });
+        quad(out, MeshCorner{ x0, y0, z0, z0 * uvTiling, 0.0f }, MeshCorner{ x0, y0, z1, z1 * uvTiling, 0.0f },
+             MeshCorner{ x0, y1, z1, z1 * uvTiling, h }, MeshCorner{ x0, y1, z0, z0 * uvTiling, h });
+        quad(out, MeshCorner{ x0, y1, z1, x0 * uvTiling, -z1 * uvTiling }, MeshCorner{ x1, y1, z1, x1 * uvTiling, -z1 * uvTiling },
+             MeshCorner{ x1, y1, z0, x1 * uvTiling, -z0 * uvTiling }, MeshCorner{ x0, y1, z0, x0 * uvTiling, -z0 * uvTiling });
+    }
+}
+
+// pyramids
+// --------
+constexpr size_t vertexCount(const PyramidShape& shape)
+{
+    return shape.topRatio > 0.0f ? 4 * 6 + 6 + 6 : 4 * 3 + 6;
+}
+
+template <typename Writer>
+constexpr void writeMesh(Writer& out, const PyramidShape& shape)
+{
+    using namespace mesh_generator_detail;
+    float w = shape.halfWidth, top = shape.halfWidth * shape.topRatio, h = shape.height;
+    float uBottom0 = 0.0f, uBottom1 = shape.uvTiling, vTop = shape.uvTiling * 0.5f;
+    float uTop0 = (1.0f - shape.topRatio) * 0.5f * shape.uvTiling, uTop1 = (1.0f + shape.topRatio) * 0.5f * shape.uvTiling;
+    for (int side = 0; side < 4; side++)
+    {
+        MeshCorner b0 = faceCorner(side, -w, 0.0f, w, uBottom0, 0.0f);
+        MeshCorner b1 = faceCorner(side, w, 0.0f, w, uBottom1, 0.0f);
+        if (shape.topRatio > 0.0f)
+            quad(out, b0, b1, faceCorner(side, top, h, top, uTop1, vTop), faceCorner(side, -top, h, top, uTop0, vTop));
+        else
+            triangle(out, b0, b1, faceCorner(side, 0.0f, h, 0.0f, shape.uvTiling * 0.5f, vTop));
+    }
+    if (shape.topRatio > 0.0f)
+        quad(out, MeshCorner{ -top, h, top, uTop0, uTop0 }, MeshCorner{ top, h, top, uTop1, uTop0 },
+             MeshCorner{ top, h, -top, uTop1, uTop1 }, MeshCorner{ -top, h, -top, uTop0, uTop1 });
+    base(out, w, shape.uvTiling);
+}
+
+// stepped pyramids
+// ----------------
+constexpr size_t vertexCount(const SteppedPyramidShape& shape)
+{
+    // two profile segments per step, a quad each except the triangle closing the top, on 4 faces
+    return shape.steps == 0 ? 0 : 4 * ((shape.steps * 2 - 1) * 6 + 3) + 6;
+}
+
+template <typename Writer>
+constexpr void writeMesh(Writer& out, const SteppedPyramidShape& shape)
+{
+    using namespace mesh_generator_detail;
+    if (shape.steps == 0)
+        return;
+    // point i of the profile from the bottom edge to the top: odd points end a riser, even ones a tread
+    unsigned int points = shape.steps * 2 + 1;
+    auto radius = [&shape](unsigned int point) { return shape.halfWidth * (1.0f - (float)(point / 2) / shape.steps); };
+    auto height = [&shape](unsigned int point) { return shape.height * (float)((point + 1) / 2) / shape.steps; };
+    for (int side = 0; side < 4; side++)
+    {
+        auto corner = [&](float t, unsigned int point)
+        {
+            return faceCorner(side, t, height(point), radius(point), (t / shape.halfWidth + 1.0f) * 0.5f * shape.uvTiling,
+                              (float)point / (points - 1) * shape.uvTiling);
+        };
+        for (unsigned int point = 0; point + 1 < points; point++)
+        {
+            float r0 = radius(point), r1 = radius(point + 1);
+            if (point + 2 < points)
+                quad(out, corner(-r0, point), corner(r0, point), corner(r1, point + 1), corner(-r1, point + 1));
+            else
+                triangle(out, corner(-r0, point), corner(r0, point), corner(0.0f, point + 1));
+        }
+    }
+    base(out, shape.halfWidth, shape.uvTiling);
+}
+
+// walls
+// -----
+constexpr size_t vertexCount(const WallRingShape& shape)
+{
+    return (shape.gateWidth > 0.0f ? 5 : 4) * 30;
+}
+
+template <typename Writer>
+constexpr void writeMesh(Writer& out, const WallRingShape& shape)
+{
+    using namespace mesh_generator_detail;
+    float s = shape.halfSize, t = shape.thickness, y0 = shape.baseY, y1 = shape.baseY + shape.height;
+    if (shape.gateWidth > 0.0f)
+    {
+        float gate = shape.gateWidth * 0.5f;
+        box(out, -s, y0, s, -gate, y1, s + t, shape.uvTiling);
+        box(out, gate, y0, s, s, y1, s + t, shape.uvTiling);
+    }
+    else
+        box(out, -s, y0, s, s, y1, s + t, shape.uvTiling);
+    box(out, -s, y0, -s - t, s, y1, -s, shape.uvTiling);
+    box(out, s - t, y0, -s, s, y1, s, shape.uvTiling);
+    box(out, -s, y0, -s, -s + t, y1, s, shape.uvTiling);
+}
+
+// ground
+// ------
+constexpr size_t vertexCount(const GroundTileShape& shape)
+{
+    return (size_t)shape.divisions * shape.divisions * 6;
+}
+
+template <typename Writer>
+constexpr void writeMesh(Writer& out, const GroundTileShape& shape)
+{
+    using namespace mesh_generator_detail;
+    float stepX = (shape.maxX - shape.minX) / shape.divisions, stepZ = (shape.maxZ - shape.minZ) / shape.divisions;
+    for (unsigned int i = 0; i < shape.divisions; i++)
+        for (unsigned int j = 0; j < shape.divisions; j++)
+        {
+            float x0 = shape.minX + stepX * i, x1 = i + 1 == shape.divisions ? shape.maxX : x0 + stepX;
+            float z0 = shape.minZ + stepZ * j, z1 = j + 1 == shape.divisions ? shape.maxZ : z0 + stepZ;
+            float u0 = (x0 - shape.minX) * shape.uvTiling, u1 = (x1 - shape.minX) * shape.uvTiling;
+            float v0 = (z0 - shape.minZ) * shape.uvTiling, v1 = (z1 - shape.minZ) * shape.uvTiling;
+            quad(out, MeshCorner{ x0, shape.y, z1, u0, v1 }, MeshCorner{ x1, shape.y, z1, u1, v1 },
+                 MeshCorner{ x1, shape.y, z0, u1, v0 }, MeshCorner{ x0, shape.y, z0, u0, v0 });
+        }
+}
+
+// any shape above
+// ---------------
+template <typename Shape>
+inline std::vector<float> generateMesh(const Shape& shape)
+{
+    VectorMeshWriter out;
+    out.floats.reserve(vertexCount(shape) * 5);
+    writeMesh(out, shape);
+    return out.floats;
+}
+
+// VertexCount must be vertexCount(shape); anything else fails to compile in a constant expression
+template <size_t VertexCount, typename Shape>
+constexpr std::array<float, VertexCount * 5> generateMeshArray(const Shape& shape)
+{
+    ArrayMeshWriter<VertexCount> out;
+    writeMesh(out, shape);
+    if (out.count != VertexCount)
+        throw std::logic_error("generateMeshArray: VertexCount is not vertexCount(shape)");
+    return out.floats;
+}
+
+#endif
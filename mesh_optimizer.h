@@ -0,0 +1,256 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// triangle list with a shared vertex array, floatsPerVertex floats per vertex
+struct IndexedMesh
+{
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int floatsPerVertex = 5;
+
+    size_t vertexCount() const { return floatsPerVertex ? vertices.size() / floatsPerVertex : 0; }
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+// numbers printed by processMesh
+struct MeshStats
+{
+    size_t inputVertices = 0;
+    size_t outputVertices = 0;
+    size_t triangles = 0;
+    float acmrBefore = 0.0f;
+    float acmrWelded = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+// average cache miss ratio: vertex shader invocations per triangle for a FIFO post-transform
+// cache of cacheSize entries (3.0 is the worst case, ~0.5-0.7 is very good for closed meshes)
+// -------------------------------------------------------------------------------------------
+inline float computeACMR(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+    if (indices.size() < 3)
+        return 0.0f;
+
+    std::vector<unsigned int> timestamps(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0;
+    for (unsigned int index : indices)
+    {
+        // a vertex is still in the FIFO if fewer than cacheSize misses happened since it went in
+        if (time - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+// merges vertices whose floats are identical (position and texcoord) and returns an indexed mesh
+// ------------------------------------------------------------------------------------------------
+inline IndexedMesh weldVertices(const float* vertices, size_t vertexCount, unsigned int floatsPerVertex)
+{
+    std::vector<unsigned int> order(vertexCount);
+    std::iota(order.begin(), order.end(), 0u);
+    auto less = [&](unsigned int a, unsigned int b)
+    {
+        return std::lexicographical_compare(vertices + a * floatsPerVertex, vertices + (a + 1) * floatsPerVertex,
+                                            vertices + b * floatsPerVertex, vertices + (b + 1) * floatsPerVertex);
+    };
+    auto equal = [&](unsigned int a, unsigned int b)
+    {
+        return std::equal(vertices + a * floatsPerVertex, vertices + (a + 1) * floatsPerVertex, vertices + b * floatsPerVertex);
+    };
+    std::stable_sort(order.begin(), order.end(), less);
+
+    IndexedMesh mesh;
+    mesh.floatsPerVertex = floatsPerVertex;
+    mesh.indices.resize(vertexCount);
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (i == 0 || !equal(order[i - 1], order[i]))
+            mesh.vertices.insert(mesh.vertices.end(), vertices + order[i] * floatsPerVertex, vertices + (order[i] + 1) * floatsPerVertex);
+        mesh.indices[order[i]] = (unsigned int)mesh.vertexCount() - 1;
+    }
+    // a trailing partial triangle can't be drawn, drop it
+    mesh.indices.resize(mesh.indices.size() / 3 * 3);
+    return mesh;
+}
+
+// reorders triangles for the post-transform vertex cache (Tom Forsyth's linear-speed algorithm)
+// -------------------------------------------------------------------------------------------
+inline void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    auto vertexScore = [](int cachePosition, unsigned int remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // the last triangle's vertices get a fixed score so it isn't simply repeated
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (cachePosition - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+        }
+        // prefer vertices with few triangles left so they retire early
+        return score + 2.0f / std::sqrt((float)remaining);
+    };
+
+    // vertex -> triangles adjacency
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[t * 3 + k]]++] = (unsigned int)t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++)
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+    std::vector<unsigned int> cache;
+    cache.reserve(CACHE_SIZE + 3);
+
+    size_t best = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+    size_t scanStart = 0;
+    while (output.size() < indices.size())
+    {
+        emitted[best] = true;
+        std::vector<unsigned int> newCache;
+        newCache.reserve(CACHE_SIZE + 3);
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[best * 3 + k];
+            output.push_back(v);
+            // drop the triangle from the vertex's live adjacency
+            unsigned int* begin = adjacency.data() + offsets[v];
+            unsigned int* end = begin + remaining[v];
+            unsigned int* found = std::find(begin, end, (unsigned int)best);
+            if (found != end)
+            {
+                std::iter_swap(found, end - 1);
+                remaining[v]--;
+            }
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back(v);
+        }
+        for (unsigned int v : cache)
+            if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+                newCache.push_back(v);
+
+        // rescore everything that is in (or just fell out of) the cache and their triangles
+        for (size_t i = 0; i < newCache.size(); i++)
+            cachePosition[newCache[i]] = i < (size_t)CACHE_SIZE ? (int)i : -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : newCache)
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        for (unsigned int v : newCache)
+        {
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                unsigned int t = adjacency[offsets[v] + i];
+                triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+        if (newCache.size() > (size_t)CACHE_SIZE)
+            newCache.resize(CACHE_SIZE);
+        cache.swap(newCache);
+
+        if (bestScore < 0.0f)
+        {
+            // nothing left around the cache, continue with the next untouched triangle
+            while (scanStart < triangleCount && emitted[scanStart])
+                scanStart++;
+            if (scanStart == triangleCount)
+                break;
+            best = scanStart;
+        }
+    }
+    indices.swap(output);
+}
+
+// renumbers vertices in order of first use so vertex fetch walks memory linearly; unused vertices go away
+// ------------------------------------------------------------------------------------------------------
+inline void optimizeVertexFetch(IndexedMesh& mesh)
+{
+    const unsigned int NONE = ~0u;
+    std::vector<unsigned int> remap(mesh.vertexCount(), NONE);
+    std::vector<float> vertices;
+    vertices.reserve(mesh.vertices.size());
+    unsigned int next = 0;
+    for (unsigned int& index : mesh.indices)
+    {
+        if (remap[index] == NONE)
+        {
+            remap[index] = next++;
+            vertices.insert(vertices.end(), mesh.vertices.begin() + index * mesh.floatsPerVertex,
+                            mesh.vertices.begin() + (index + 1) * mesh.floatsPerVertex);
+        }
+        index = remap[index];
+    }
+    mesh.vertices.swap(vertices);
+}
+
+// full pipeline for a flat triangle list: weld -> vertex cache order -> vertex fetch order
+// ---------------------------------------------------------------------------------------
+inline IndexedMesh processMesh(const float* vertices, size_t vertexCount, unsigned int floatsPerVertex, MeshStats* stats = NULL)
+{
+    IndexedMesh mesh = weldVertices(vertices, vertexCount, floatsPerVertex);
+    float acmrWelded = computeACMR(mesh.indices, mesh.vertexCount());
+    optimizeVertexCache(mesh.indices, mesh.vertexCount());
+    optimizeVertexFetch(mesh);
+
+    if (stats)
+    {
+        stats->inputVertices = vertexCount;
+        stats->outputVertices = mesh.vertexCount();
+        stats->triangles = mesh.triangleCount();
+        // an unindexed list transforms every corner of every triangle
+        stats->acmrBefore = mesh.triangleCount() ? 3.0f : 0.0f;
+        stats->acmrWelded = acmrWelded;
+        stats->acmrAfter = computeACMR(mesh.indices, mesh.vertexCount());
+    }
+    return mesh;
+}
+
+inline void printMeshStats(const std::string& name, const MeshStats& stats)
+{
+    std::cout << "mesh " << name << ": vertices " << stats.inputVertices << " -> " << stats.outputVertices
+              << ", triangles " << stats.triangles
+              << ", ACMR " << stats.acmrBefore << " -> " << stats.acmrWelded << " (welded) -> " << stats.acmrAfter << " (optimized)"
+              << std::endl;
+}
+
+#endif
@@ -0,0 +1,304 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+// one level of detail: triangles over the vertices of the full mesh
+struct MeshLod
+{
+    std::vector<unsigned int> indices;
+    float error = 0.0f;     // how far (in mesh units) the surface may have moved from the full mesh
+};
+
+// symmetric 4x4 error quadric of Garland and Heckbert: the sum of squared distances to a set of planes
+// ----------------------------------------------------------------------------------------------------
+struct Quadric
+{
+    double a[10] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };    // xx xy xz xw yy yz yw zz zw ww
+
+    void addPlane(const glm::vec3& normal, double distance, double weight)
+    {
+        double n[4] = { normal.x, normal.y, normal.z, distance };
+        int k = 0;
+        for (int i = 0; i < 4; i++)
+            for (int j = i; j < 4; j++)
+                a[k++] += n[i] * n[j] * weight;
+    }
+
+    void add(const Quadric& other)
+    {
+        for (int k = 0; k < 10; k++)
+            a[k] += other.a[k];
+    }
+
+    double evaluate(const glm::vec3& point) const
+    {
+        double x = point.x, y = point.y, z = point.z;
+        double result = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+                      + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+                      + a[7] * z * z + 2.0 * a[8] * z
+                      + a[9];
+        return std::max(result, 0.0);
+    }
+};
+
+// distance from p to the closest point of triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+inline float pointTriangleDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f)
+        return glm::length(ap);
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3)
+        return glm::length(bp);
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6)
+        return glm::length(cp);
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+    float denominator = 1.0f / (va + vb + vc);
+    return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+}
+
+// level-of-detail chain by quadric error edge collapses: LOD 0 is the mesh itself, every further
+// level has about ratio times the triangles of the previous one, until maxLevels levels or until
+// the mesh can't lose more triangles. Levels share the mesh's vertices, so a batch stores them once.
+//
+// Collapses move one position onto a neighbouring one (no new vertices) in passes: every edge is
+// costed with the accumulated quadric of the position that goes away, the cheapest ones are applied
+// as long as they don't touch a position already changed in the same pass. Positions split for a
+// texture seam move along the seam only (every split vertex must have a partner at the target), a
+// collapse that would flip a triangle is skipped and open edges keep an extra plane so outlines
+// stay put. The error of a level is measured, not taken from the quadrics (coplanar triangles add
+// the same plane many times): the farthest any position of the full mesh is from the level's surface.
+// ---------------------------------------------------------------------------------------------------
+inline std::vector<MeshLod> generateLodChain(const IndexedMesh& mesh, unsigned int maxLevels = 5, float ratio = 0.5f)
+{
+    std::vector<MeshLod> lods(1);
+    lods[0].indices = mesh.indices;
+    size_t vertexCount = mesh.vertexCount();
+    if (maxLevels < 2 || mesh.indices.empty())
+        return lods;
+
+    // vertices at the same place share one position (and one quadric)
+    std::map<std::array<float, 3>, unsigned int> positionIds;
+    std::vector<unsigned int> positionOf(vertexCount);
+    std::vector<glm::vec3> points;
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        const float* p = &mesh.vertices[v * mesh.floatsPerVertex];
+        std::array<float, 3> key = { { p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f } };
+        auto found = positionIds.insert(std::make_pair(key, (unsigned int)points.size()));
+        if (found.second)
+            points.push_back(glm::vec3(p[0], p[1], p[2]));
+        positionOf[v] = found.first->second;
+    }
+    size_t positionCount = points.size();
+
+    const double BORDER_WEIGHT = 10.0;
+    std::vector<Quadric> quadrics(positionCount);
+    std::map<std::pair<unsigned int, unsigned int>, int> edgeUses;
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        unsigned int corner[3] = { positionOf[mesh.indices[i]], positionOf[mesh.indices[i + 1]], positionOf[mesh.indices[i + 2]] };
+        glm::vec3 p0(points[corner[0]]), p1(points[corner[1]]), p2(points[corner[2]]);
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        float area = glm::length(normal);
+        if (area <= 0.0f)
+            continue;
+        normal = normal * (1.0f / area);
+        for (int k = 0; k < 3; k++)
+            quadrics[corner[k]].addPlane(normal, -glm::dot(normal, p0), 1.0);
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = corner[k], b = corner[(k + 1) % 3];
+            edgeUses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+        unsigned int corner[3] = { positionOf[mesh.indices[i]], positionOf[mesh.indices[i + 1]], positionOf[mesh.indices[i + 2]] };
+        glm::vec3 p0(points[corner[0]]), p1(points[corner[1]]), p2(points[corner[2]]);
+        glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        if (glm::length(normal) <= 0.0f)
+            continue;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int a = corner[k], b = corner[(k + 1) % 3];
+            if (edgeUses[std::make_pair(std::min(a, b), std::max(a, b))] != 1)
+                continue;
+            // the plane through the open edge, perpendicular to its triangle
+            glm::vec3 pa(points[a]), pb(points[b]);
+            glm::vec3 side = glm::cross(pb - pa, normal);
+            float length = glm::length(side);
+            if (length <= 0.0f)
+                continue;
+            side = side * (1.0f / length);
+            quadrics[a].addPlane(side, -glm::dot(side, pa), BORDER_WEIGHT);
+            quadrics[b].addPlane(side, -glm::dot(side, pa), BORDER_WEIGHT);
+        }
+    }
+
+    std::vector<unsigned int> indices = mesh.indices;
+    std::vector<unsigned int> remap(vertexCount);
+    std::vector<std::vector<unsigned int> > positionTriangles(positionCount);
+    std::vector<char> locked(positionCount);
+    struct Collapse
+    {
+        double cost;
+        unsigned int from, to;
+        bool operator<(const Collapse& other) const { return cost < other.cost; }
+    };
+    std::vector<Collapse> collapses;
+    size_t target = (size_t)(indices.size() / 3 * ratio) * 3;
+
+    while (lods.size() < maxLevels)
+    {
+        for (std::vector<unsigned int>& triangles : positionTriangles)
+            triangles.clear();
+        collapses.clear();
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int from = positionOf[indices[i + k]], to = positionOf[indices[i + (k + 1) % 3]];
+                positionTriangles[from].push_back((unsigned int)i);
+                Collapse forward = { quadrics[from].evaluate(points[to]), from, to };
+                Collapse backward = { quadrics[to].evaluate(points[from]), to, from };
+                collapses.push_back(forward);
+                collapses.push_back(backward);
+            }
+        std::sort(collapses.begin(), collapses.end());
+
+        std::iota(remap.begin(), remap.end(), 0u);
+        std::fill(locked.begin(), locked.end(), 0);
+        size_t removeGoal = indices.size() > target ? (indices.size() - target) / 3 : 0;
+        size_t removed = 0, applied = 0;
+        std::vector<std::pair<unsigned int, unsigned int> > moves;
+        for (const Collapse& collapse : collapses)
+        {
+            if (removed >= removeGoal)
+                break;
+            if (locked[collapse.from] || locked[collapse.to])
+                continue;
+
+            // every vertex at the old position needs a partner at the new one it shares a triangle with,
+            // and no remaining triangle may turn over
+            moves.clear();
+            bool valid = true;
+            size_t degenerate = 0;
+            for (unsigned int triangle : positionTriangles[collapse.from])
+            {
+                int at = -1, partner = -1;
+                for (int k = 0; k < 3; k++)
+                {
+                    if (positionOf[indices[triangle + k]] == collapse.from)
+                        at = k;
+                    else if (positionOf[indices[triangle + k]] == collapse.to)
+                        partner = k;
+                }
+                if (partner >= 0)
+                {
+                    degenerate++;
+                    moves.push_back(std::make_pair(indices[triangle + at], indices[triangle + partner]));
+                    continue;
+                }
+                glm::vec3 p[3];
+                for (int k = 0; k < 3; k++)
+                    p[k] = points[positionOf[indices[triangle + k]]];
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                p[at] = points[collapse.to];
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                if (glm::dot(before, after) <= 0.0f)
+                {
+                    valid = false;
+                    break;
+                }
+            }
+            for (unsigned int triangle : positionTriangles[collapse.from])
+            {
+                if (!valid)
+                    break;
+                for (int k = 0; k < 3 && valid; k++)
+                {
+                    unsigned int vertex = indices[triangle + k];
+                    if (positionOf[vertex] != collapse.from)
+                        continue;
+                    auto partner = std::find_if(moves.begin(), moves.end(),
+                                                [vertex](const std::pair<unsigned int, unsigned int>& move) { return move.first == vertex; });
+                    valid = partner != moves.end();
+                }
+            }
+            if (!valid || degenerate == 0)
+                continue;
+
+            for (const std::pair<unsigned int, unsigned int>& move : moves)
+                remap[move.first] = move.second;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            for (unsigned int triangle : positionTriangles[collapse.from])
+                for (int k = 0; k < 3; k++)
+                    locked[positionOf[indices[triangle + k]]] = 1;
+            removed += degenerate;
+            applied++;
+        }
+
+        // apply the pass and drop the triangles that lost their area
+        size_t kept = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (positionOf[a] == positionOf[b] || positionOf[b] == positionOf[c] || positionOf[c] == positionOf[a])
+                continue;
+            indices[kept++] = a;
+            indices[kept++] = b;
+            indices[kept++] = c;
+        }
+        indices.resize(kept);
+
+        bool reached = indices.size() <= target;
+        // a level must be worth its draw: stuck meshes only get one if they lost a tenth
+        if (!indices.empty() && (reached || (applied == 0 && indices.size() * 10 <= lods.back().indices.size() * 9)))
+        {
+            MeshLod lod;
+            lod.indices = indices;
+            for (const glm::vec3& point : points)
+            {
+                float distance = FLT_MAX;
+                for (size_t i = 0; i < indices.size() && distance > 0.0f; i += 3)
+                    distance = std::min(distance, pointTriangleDistance(point, points[positionOf[indices[i]]], points[positionOf[indices[i + 1]]],
+                                                                        points[positionOf[indices[i + 2]]]));
+                lod.error = std::max(lod.error, distance);
+            }
+            // never below the previous level: selection walks the chain assuming errors grow
+            lod.error = std::max(lod.error, lods.back().error);
+            optimizeVertexCache(lod.indices, vertexCount);
+            lods.push_back(lod);
+            target = (size_t)(indices.size() / 3 * ratio) * 3;
+        }
+        if (applied == 0 || indices.empty())
+            break;
+    }
+    return lods;
+}
+
+#endif
@@ -0,0 +1,436 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// one level of a mip chain, same channel count as the image it was made from
+struct MipLevel
+{
+    unsigned int width = 0;
+    unsigned int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+enum MipKernel
+{
+    MIP_KERNEL_SCALAR = 0,
+    MIP_KERNEL_SSE2,
+    MIP_KERNEL_AVX2
+};
+
+inline const char* mipKernelName(MipKernel kernel)
+{
+    switch (kernel)
+    {
+    case MIP_KERNEL_SSE2: return "sse2";
+    case MIP_KERNEL_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+inline bool mipKernelSupported(MipKernel kernel)
+{
+    if (kernel == MIP_KERNEL_SCALAR)
+        return true;
+#ifdef PYRAMID_SSE2
+    if (kernel == MIP_KERNEL_SSE2)
+        return true;
+    return cpuHasAVX2();
+#else
+    return false;
+#endif
+}
+
+// widest kernel this CPU runs, checked once
+inline MipKernel bestMipKernel()
+{
+    static const MipKernel best = mipKernelSupported(MIP_KERNEL_AVX2) ? MIP_KERNEL_AVX2 :
+                                  mipKernelSupported(MIP_KERNEL_SSE2) ? MIP_KERNEL_SSE2 : MIP_KERNEL_SCALAR;
+    return best;
+}
+
+namespace mip
+{
+    // sRGB <-> linear tables; encoding goes through 4096 linear steps, which is finer than one
+    // 8-bit sRGB step everywhere but the very darkest values
+    struct GammaTables
+    {
+        float toLinear[256];
+        unsigned char toSrgb[4096];
+
+        GammaTables()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for (int i = 0; i < 4096; i++)
+            {
+                float l = i / 4095.0f;
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+                toSrgb[i] = (unsigned char)std::min(255.0f, c * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    inline const GammaTables& gammaTables()
+    {
+        static const GammaTables tables;
+        return tables;
+    }
+
+    // one row of 8-bit sRGB pixels to linear RGBA floats; grey fills RGB, alpha stays linear
+    inline void decodeRow(const unsigned char* src, float* dst, unsigned int width, int channels)
+    {
+        const float* toLinear = gammaTables().toLinear;
+        for (unsigned int x = 0; x < width; x++, src += channels, dst += 4)
+        {
+            if (channels >= 3)
+            {
+                dst[0] = toLinear[src[0]];
+                dst[1] = toLinear[src[1]];
+                dst[2] = toLinear[src[2]];
+            }
+            else
+                dst[0] = dst[1] = dst[2] = toLinear[src[0]];
+            dst[3] = channels == 4 ? src[3] / 255.0f : channels == 2 ? src[1] / 255.0f : 1.0f;
+        }
+    }
+
+    // stores one texel from its table indices (sRGB steps for RGB, 8-bit alpha)
+    inline void storeTexel(const int* index, unsigned char* dst, int channels)
+    {
+        const unsigned char* toSrgb = gammaTables().toSrgb;
+        dst[0] = toSrgb[index[0]];
+        if (channels >= 3)
+        {
+            dst[1] = toSrgb[index[1]];
+            dst[2] = toSrgb[index[2]];
+        }
+        if (channels == 2 || channels == 4)
+            dst[channels - 1] = (unsigned char)index[3];
+    }
+
+    // linear RGBA floats back to 8-bit sRGB with the source channel count
+    inline void encodeRowScalar(const float* src, unsigned char* dst, unsigned int width, int channels, unsigned int first = 0)
+    {
+        src += first * 4;
+        dst += first * channels;
+        for (unsigned int x = first; x < width; x++, src += 4, dst += channels)
+        {
+            int index[4];
+            for (int k = 0; k < 4; k++)
+                index[k] = (int)(std::min(std::max(src[k], 0.0f), 1.0f) * (k == 3 ? 255.0f : 4095.0f) + 0.5f);
+            storeTexel(index, dst, channels);
+        }
+    }
+    // 2x2 box filter of two RGBA float rows of srcWidth texels into dstWidth texels; an odd last
+    // column is clamped. Every kernel adds the four texels in the same order, so their results
+    // are bit-identical.
+    inline void reduceRowScalar(const float* row0, const float* row1, float* out, unsigned int srcWidth, unsigned int dstWidth, unsigned int first = 0)
+    {
+        for (unsigned int x = first; x < dstWidth; x++)
+        {
+            unsigned int x0 = std::min(2 * x, srcWidth - 1) * 4, x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+            for (int k = 0; k < 4; k++)
+                out[x * 4 + k] = (row0[x0 + k] + row0[x1 + k] + row1[x0 + k] + row1[x1 + k]) * 0.25f;
+        }
+    }
+
+#ifdef PYRAMID_SSE2
+    // one output texel (4 floats) per iteration
+    inline void reduceRowSSE2(const float* row0, const float* row1, float* out, unsigned int srcWidth, unsigned int dstWidth)
+    {
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        unsigned int x = 0;
+        for (; 2 * x + 1 < srcWidth && x < dstWidth; x++)
+        {
+            __m128 a = _mm_loadu_ps(row0 + 8 * x), b = _mm_loadu_ps(row0 + 8 * x + 4);
+            __m128 c = _mm_loadu_ps(row1 + 8 * x), d = _mm_loadu_ps(row1 + 8 * x + 4);
+            _mm_storeu_ps(out + 4 * x, _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(a, b), c), d), quarter));
+        }
+        reduceRowScalar(row0, row1, out, srcWidth, dstWidth, x);
+    }
+
+    // two output texels per iteration: the 128-bit lanes are regrouped so lane 0 holds the even
+    // source texels and lane 1 the odd ones
+    PYRAMID_TARGET_AVX2 inline void reduceRowAVX2(const float* row0, const float* row1, float* out, unsigned int srcWidth, unsigned int dstWidth)
+    {
+        const __m256 quarter = _mm256_set1_ps(0.25f);
+        unsigned int x = 0;
+        for (; 2 * x + 3 < srcWidth && x + 1 < dstWidth; x += 2)
+        {
+            __m256 a0 = _mm256_loadu_ps(row0 + 8 * x), b0 = _mm256_loadu_ps(row0 + 8 * x + 8);
+            __m256 a1 = _mm256_loadu_ps(row1 + 8 * x), b1 = _mm256_loadu_ps(row1 + 8 * x + 8);
+            __m256 even0 = _mm256_permute2f128_ps(a0, b0, 0x20), odd0 = _mm256_permute2f128_ps(a0, b0, 0x31);
+            __m256 even1 = _mm256_permute2f128_ps(a1, b1, 0x20), odd1 = _mm256_permute2f128_ps(a1, b1, 0x31);
+            __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(even0, odd0), even1), odd1);
+            _mm256_storeu_ps(out + 4 * x, _mm256_mul_ps(sum, quarter));
+        }
+        reduceRowScalar(row0, row1, out, srcWidth, dstWidth, x);
+    }
+
+    // clamp, scale and round in registers, only the table lookups stay scalar
+    inline void encodeRowSSE2(const float* src, unsigned char* dst, unsigned int width, int channels)
+    {
+        const __m128 scale = _mm_set_ps(255.0f, 4095.0f, 4095.0f, 4095.0f);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), half = _mm_set1_ps(0.5f);
+        alignas(16) int index[4];
+        for (unsigned int x = 0; x < width; x++, src += 4, dst += channels)
+        {
+            __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), zero), one);
+            _mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half)));
+            storeTexel(index, dst, channels);
+        }
+    }
+
+    PYRAMID_TARGET_AVX2 inline void encodeRowAVX2(const float* src, unsigned char* dst, unsigned int width, int channels)
+    {
+        const __m256 scale = _mm256_set_ps(255.0f, 4095.0f, 4095.0f, 4095.0f, 255.0f, 4095.0f, 4095.0f, 4095.0f);
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+        alignas(32) int index[8];
+        unsigned int x = 0;
+        for (; x + 1 < width; x += 2, src += 8, dst += 2 * channels)
+        {
+            __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src), zero), one);
+            _mm256_store_si256((__m256i*)index, _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half)));
+            storeTexel(index, dst, channels);
+            storeTexel(index + 4, dst + channels, channels);
+        }
+        encodeRowScalar(src - x * 4, dst - x * channels, width, channels, x);
+    }
+#endif
+
+    inline void reduceRow(MipKernel kernel, const float* row0, const float* row1, float* out, unsigned int srcWidth, unsigned int dstWidth)
+    {
+#ifdef PYRAMID_SSE2
+        if (kernel == MIP_KERNEL_AVX2)
+            return reduceRowAVX2(row0, row1, out, srcWidth, dstWidth);
+        if (kernel == MIP_KERNEL_SSE2)
+            return reduceRowSSE2(row0, row1, out, srcWidth, dstWidth);
+#endif
+        (void)kernel;
+        reduceRowScalar(row0, row1, out, srcWidth, dstWidth);
+    }
+
+    inline void encodeRow(MipKernel kernel, const float* src, unsigned char* dst, unsigned int width, int channels)
+    {
+#ifdef PYRAMID_SSE2
+        if (kernel == MIP_KERNEL_AVX2)
+            return encodeRowAVX2(src, dst, width, channels);
+        if (kernel == MIP_KERNEL_SSE2)
+            return encodeRowSSE2(src, dst, width, channels);
+#endif
+        (void)kernel;
+        encodeRowScalar(src, dst, width, channels);
+    }
+}
+
+// levels 1..n (down to 1x1) of an 8-bit sRGB image with 1-4 channels, as stbi_load returns it.
+// Texels are averaged in linear space with a 2x2 box filter; alpha is averaged as is. Level 1 is
+// filtered straight from decoded rows of level 0, the following levels from the previous float
+// level; each row is encoded back to 8 bit right after it is filtered, while it is still in cache.
+//
+// For cube faces: with even sizes the 2x2 footprint never crosses a face edge, so the faces can
+// be filtered independently (and in parallel); the seams are then handled when sampling, by
+// GL_TEXTURE_CUBE_MAP_SEAMLESS filtering across faces.
+// --------------------------------------------------------------------------------------------
+inline std::vector<MipLevel> generateMipChain(const unsigned char* pixels, unsigned int width, unsigned int height, int channels, MipKernel kernel = bestMipKernel())
+{
+    std::vector<MipLevel> levels;
+    if (!mipKernelSupported(kernel))
+        kernel = MIP_KERNEL_SCALAR;
+
+    std::vector<float> previous, current;
+    std::vector<float> row0((size_t)width * 4), row1((size_t)width * 4);
+    unsigned int w = width, h = height;
+    while (w > 1 || h > 1)
+    {
+        unsigned int nw = std::max(1u, w / 2), nh = std::max(1u, h / 2);
+        current.resize((size_t)nw * nh * 4);
+        MipLevel level;
+        level.width = nw;
+        level.height = nh;
+        level.pixels.resize((size_t)nw * nh * channels);
+        for (unsigned int y = 0; y < nh; y++)
+        {
+            unsigned int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+            const float* source0;
+            const float* source1;
+            if (levels.empty())
+            {
+                mip::decodeRow(&pixels[(size_t)y0 * w * channels], row0.data(), w, channels);
+                mip::decodeRow(&pixels[(size_t)y1 * w * channels], row1.data(), w, channels);
+                source0 = row0.data();
+                source1 = row1.data();
+            }
+            else
+            {
+                source0 = &previous[(size_t)y0 * w * 4];
+                source1 = &previous[(size_t)y1 * w * 4];
+            }
+            float* row = &current[(size_t)y * nw * 4];
+            mip::reduceRow(kernel, source0, source1, row, w, nw);
+            mip::encodeRow(kernel, row, &level.pixels[(size_t)y * nw * channels], nw, channels);
+        }
+        levels.push_back(std::move(level));
+        previous.swap(current);
+        w = nw;
+        h = nh;
+    }
+    return levels;
+}
+
+// bilinear resample of an 8-bit sRGB image (1-4 channels) to another size, filtered in linear
+// space like the mips; meant for bringing textures of similar size to one common size, it does
+// not prefilter for large reductions
+// -----------------------------------------------------------------------------------------------
+inline std::vector<unsigned char> resizeImage(const unsigned char* pixels, unsigned int width, unsigned int height, int channels,
+                                              unsigned int newWidth, unsigned int newHeight)
+{
+    std::vector<float> linear((size_t)width * height * 4);
+    for (unsigned int y = 0; y < height; y++)
+        mip::decodeRow(&pixels[(size_t)y * width * channels], &linear[(size_t)y * width * 4], width, channels);
+
+    std::vector<unsigned char> resized((size_t)newWidth * newHeight * channels);
+    std::vector<float> row((size_t)newWidth * 4);
+    for (unsigned int y = 0; y < newHeight; y++)
+    {
+        float sy = std::min(std::max((y + 0.5f) * height / newHeight - 0.5f, 0.0f), (float)(height - 1));
+        unsigned int y0 = (unsigned int)sy, y1 = std::min(y0 + 1, height - 1);
+        float fy = sy - y0;
+        for (unsigned int x = 0; x < newWidth; x++)
+        {
+            float sx = std::min(std::max((x + 0.5f) * width / newWidth - 0.5f, 0.0f), (float)(width - 1));
+            unsigned int x0 = (unsigned int)sx, x1 = std::min(x0 + 1, width - 1);
+            float fx = sx - x0;
+            const float* a = &linear[((size_t)y0 * width + x0) * 4];
+            const float* b = &linear[((size_t)y0 * width + x1) * 4];
+            const float* c = &linear[((size_t)y1 * width + x0) * 4];
+            const float* d = &linear[((size_t)y1 * width + x1) * 4];
+            for (int k = 0; k < 4; k++)
+                row[x * 4 + k] = (a[k] * (1.0f - fx) + b[k] * fx) * (1.0f - fy) + (c[k] * (1.0f - fx) + d[k] * fx) * fy;
+        }
+        mip::encodeRowScalar(row.data(), &resized[(size_t)y * newWidth * channels], newWidth, channels);
+    }
+    return resized;
+}
+
+// --mip-benchmark: builds the mip chains of the given cube faces with every kernel this CPU has,
+// once face after face and once with the faces spread over the pool, and times glGenerateMipmap
+// on the same cube for comparison (best of a few runs each, glFinish around the GL one)
+// -----------------------------------------------------------------------------------------------
+inline void benchmarkMipGeneration(const std::vector<std::string>& faces, ThreadPool& pool, std::ostream& out)
+{
+    pool.wait(); // texture loads would share the cores with the timed runs
+    struct Face
+    {
+        unsigned char* pixels = NULL;
+        int width = 0, height = 0, channels = 0;
+    };
+    std::vector<Face> images(faces.size());
+    double texels = 0.0;
+    for (size_t i = 0; i < faces.size(); i++)
+    {
+        Face& face = images[i];
+        face.pixels = stbi_load(faces[i].c_str(), &face.width, &face.height, &face.channels, 0);
+        if (!face.pixels || face.width != images[0].width || face.height != images[0].height ||
+            face.channels != images[0].channels)
+        {
+            std::cout << "Mip benchmark: cannot use face " << faces[i] << std::endl;
+            for (Face& image : images)
+                stbi_image_free(image.pixels);
+            return;
+        }
+        texels += (double)face.width * face.height;
+    }
+
+    const int RUNS = 3;
+    typedef std::chrono::steady_clock Clock;
+    auto best = [&](const std::function<void()>& work)
+    {
+        double fastest = 0.0;
+        for (int run = 0; run < RUNS; run++)
+        {
+            auto start = Clock::now();
+            work();
+            std::chrono::duration<double, std::milli> time = Clock::now() - start;
+            fastest = run == 0 ? time.count() : std::min(fastest, time.count());
+        }
+        return fastest;
+    };
+
+    out << "mip benchmark: " << faces.size() << " faces of " << images[0].width << "x" << images[0].height
+        << ", " << images[0].channels << " channels, best of " << RUNS << std::endl;
+    std::vector<std::vector<MipLevel> > reference(images.size());
+    double scalarTime = 0.0;
+    const MipKernel kernels[] = { MIP_KERNEL_SCALAR, MIP_KERNEL_SSE2, MIP_KERNEL_AVX2 };
+    for (MipKernel kernel : kernels)
+    {
+        if (!mipKernelSupported(kernel))
+            continue;
+        std::vector<std::vector<MipLevel> > chains(images.size());
+        double serial = best([&]()
+        {
+            for (size_t i = 0; i < images.size(); i++)
+                chains[i] = generateMipChain(images[i].pixels, images[i].width, images[i].height, images[i].channels, kernel);
+        });
+        double parallel = best([&]()
+        {
+            for (size_t i = 0; i < images.size(); i++)
+                pool.submit([&, i]() { chains[i] = generateMipChain(images[i].pixels, images[i].width, images[i].height, images[i].channels, kernel); });
+            pool.wait();
+        });
+
+        bool identical = true;
+        if (kernel == MIP_KERNEL_SCALAR)
+        {
+            reference = chains;
+            scalarTime = serial;
+        }
+        else
+            for (size_t i = 0; i < chains.size(); i++)
+                for (size_t level = 0; level < chains[i].size(); level++)
+                    identical = identical && chains[i][level].pixels == reference[i][level].pixels;
+
+        out << "  " << mipKernelName(kernel) << ": " << serial << " ms (" << texels / serial / 1000.0 << " Mtexel/s, x"
+            << scalarTime / serial << " vs scalar), " << parallel << " ms on " << pool.size() << " threads"
+            << (identical ? "" : ", OUTPUT DIFFERS FROM SCALAR") << std::endl;
+    }
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLenum format = images[0].channels == 4 ? GL_RGBA : images[0].channels == 3 ? GL_RGB : images[0].channels == 2 ? GL_RG : GL_RED;
+    for (size_t i = 0; i < images.size() && i < 6; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)i, 0, format, images[i].width, images[i].height, 0, format, GL_UNSIGNED_BYTE, images[i].pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glFinish();
+    double gpu = best([&]()
+    {
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glFinish();
+    });
+    glDeleteTextures(1, &texture);
+    out << "  glGenerateMipmap: " << gpu << " ms (driver filter, gamma unaware)" << std::endl;
+
+    for (Face& image : images)
+        stbi_image_free(image.pixels);
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef NECROPOLIS_H
+#define NECROPOLIS_H
+
+#include <glm/glm.hpp>
+
+#include "dune_field.h"
+#include "instance_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+// --necropolis N: a stress field of N pyramids and mastabas around the scene. Instances sit on a
+// jittered grid filled ring by ring from the centre outwards, so any N gives a compact field; the
+// cells under the existing scene are left free. The layout only depends on the seed. With dunes
+// every instance stands at the lowest point under its footprint, otherwise on the flat ground.
+// ------------------------------------------------------------------------------------------------
+inline void scatterNecropolis(InstanceBatch& batch, unsigned int pyramidMesh, unsigned int mastabaMesh, unsigned int count,
+                              float pyramidLayer, float mastabaLayer, const DuneField* dunes = NULL, uint32_t seed = 1)
+{
+    const float SPACING = 9.0f;
+    const float GROUND = -1.0f;
+    const float SCENE_EXTENT = 20.0f;     // half size of the hand-made scene
+    uint32_t state = seed ? seed : 1;
+    auto random = [&state]()
+    {
+        // xorshift32, [0, 1)
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) / 16777216.0f;
+    };
+
+    unsigned int placed = 0;
+    for (int ring = 0; placed < count; ring++)
+        for (int i = -ring; i <= ring && placed < count; i++)
+            for (int j = -ring; j <= ring && placed < count; j++)
+            {
+                if (std::max(std::abs(i), std::abs(j)) != ring)
+                    continue;
+                float x = i * SPACING + (random() - 0.5f) * 3.0f;
+                float z = j * SPACING + (random() - 0.5f) * 3.0f;
+                if (std::fabs(x) < SCENE_EXTENT && std::fabs(z) < SCENE_EXTENT)
+                    continue;
+
+                bool mastaba = random() < 0.3f;
+                float halfWidth = mastaba ? 2.0f + random() * 1.5f : 1.5f + random() * 2.0f;
+                float height = mastaba ? 1.0f + random() * 0.6f : halfWidth * (1.2f + random() * 0.3f);
+                InstanceData instance;
+                float ground = dunes ? dunes->footprintHeight(x, z, halfWidth) : GROUND;
+                instance.positionYaw = glm::vec4(x, ground, z, random() * 6.2831853f);
+                instance.scaleLayer = glm::vec4(halfWidth, height, halfWidth, mastaba ? mastabaLayer : pyramidLayer);
+                batch.addInstance(mastaba ? mastabaMesh : pyramidMesh, instance);
+                placed++;
+            }
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "frame_pacer.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// settings filled in from the command line
+// ----------------------------------------
+struct AppOptions
+{
+    // headless benchmark
+    bool headless = false;
+    unsigned int frames = 500;
+    unsigned int warmupFrames = 20;
+    unsigned int width = 1280;
+    unsigned int height = 720;
+
+    // frame pacing
+    double fpsCap = 0.0;                // 0: uncapped
+    SwapMode swapMode = SWAP_DEFAULT;
+    bool renderOnDemand = false;        // skip frames while nothing on screen can change
+    double simulationRate = 120.0;      // fixed simulation steps per second, independent of the frame rate
+
+    // profiling
+    bool gpuTimers = false;
+    std::string gpuTimersCsv;
+
+    // static geometry
+    VertexFormat vertexFormat = { POSITION_UNORM16, TEXCOORD_UNORM16 };
+    bool quantizationReport = false;
+    unsigned int pyramidSteps = 24;     // anything else generates the pyramid at startup
+    unsigned int necropolis = 0;        // extra instanced pyramids/mastabas for stress tests
+    bool culling = true;                // BVH frustum culling of meshes and instances
+    bool gpuCulling = false;            // instances culled by a compute shader (GL 4.3), CPU otherwise
+    bool hizCulling = false;            // plus Hi-Z occlusion culling, implies gpuCulling
+    bool cpuOcclusion = false;          // masked occlusion culling of the instances on a worker thread
+    bool occlusionBenchmark = false;
+    bool lod = true;                    // instanced meshes drawn at the level of detail their distance allows
+    float lodError = 1.0f;              // in pixels
+    bool terrain = true;                // dune terrain instead of the flat ground quad
+    float terrainSize = 4096.0f;        // edge length in world units
+    std::string terrainCacheDirectory = "terrain_cache";    // where the baked tile store lives
+    float terrainBudget = 4.0f;         // MB of streamed height/splat tiles on the GPU
+
+    // per-frame uniforms, instances and patches go through a fenced ring of this many frame regions
+    // (0 uploads them with glBufferData / glBufferSubData)
+    unsigned int ringFrames = 3;
+
+    // shaders
+    std::string shaderCacheDirectory = "shader_cache";
+
+    // the built scene, mapped on the next start (an empty directory builds it every time)
+    std::string sceneCacheDirectory = "scene_cache";
+    // a scene file to draw instead of building the scene (any the scene cache writes, from any build
+    // with the same layout); the other scene options don't apply to it
+    std::string sceneFile;
+
+    // textures (an empty directory loads the JPEGs uncompressed)
+    std::string textureCacheDirectory = "texture_cache";
+    bool mipBenchmark = false;
+};
+
+// accepts: --headless --frames N --warmup N --size WIDTHxHEIGHT --fps-cap FPS --vsync off|on|adaptive --on-demand
+//          --sim-rate HZ --gpu-timers --gpu-timers-csv FILE
+//          --vertex-format float|half|unorm16|unorm10 --quantization-report --pyramid-steps N --necropolis N --no-culling --gpu-culling --hiz-culling
+//          --cpu-occlusion --occlusion-benchmark --no-lod --lod-error PIXELS --no-terrain --terrain-size UNITS
+//          --terrain-cache DIR --terrain-vram MB --ring-frames N
+//          --shader-cache DIR --no-shader-cache --scene-cache DIR --no-scene-cache --scene FILE
+//          --texture-cache DIR --no-texture-cache --mip-benchmark
+// ------------------------------------------------------------------------------------------------
+inline AppOptions parseAppOptions(int argc, char* argv[])
+{
+    AppOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0)
+            options.headless = true;
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+            options.frames = (unsigned int)std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+            options.warmupFrames = (unsigned int)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--fps-cap") == 0 && hasValue)
+            options.fpsCap = std::max(0.0, atof(argv[++i]));
+        else if (strcmp(argv[i], "--vsync") == 0 && hasValue)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "off") == 0)
+                options.swapMode = SWAP_IMMEDIATE;
+            else if (strcmp(mode, "on") == 0)
+                options.swapMode = SWAP_VSYNC;
+            else if (strcmp(mode, "adaptive") == 0)
+                options.swapMode = SWAP_ADAPTIVE;
+            else
+                std::cout << "Ignoring unknown --vsync " << mode << ", expected off, on or adaptive" << std::endl;
+        }
+        else if (strcmp(argv[i], "--on-demand") == 0)
+            options.renderOnDemand = true;
+        else if (strcmp(argv[i], "--sim-rate") == 0 && hasValue)
+            options.simulationRate = std::max(1.0, atof(argv[++i]));
+        else if (strcmp(argv[i], "--gpu-timers") == 0)
+            options.gpuTimers = true;
+        else if (strcmp(argv[i], "--gpu-timers-csv") == 0 && hasValue)
+        {
+            options.gpuTimers = true;
+            options.gpuTimersCsv = argv[++i];
+        }
+        else if (strcmp(argv[i], "--vertex-format") == 0 && hasValue)
+        {
+            if (!parseVertexFormat(argv[++i], options.vertexFormat))
+                std::cout << "Ignoring unknown --vertex-format " << argv[i] << ", expected float, half, unorm16 or unorm10" << std::endl;
+        }
+        else if (strcmp(argv[i], "--quantization-report") == 0)
+            options.quantizationReport = true;
+        else if (strcmp(argv[i], "--pyramid-steps") == 0 && hasValue)
+            options.pyramidSteps = (unsigned int)std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--necropolis") == 0 && hasValue)
+            options.necropolis = (unsigned int)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--no-culling") == 0)
+            options.culling = false;
+        else if (strcmp(argv[i], "--gpu-culling") == 0)
+            options.gpuCulling = true;
+        else if (strcmp(argv[i], "--hiz-culling") == 0)
+            options.gpuCulling = options.hizCulling = true;
+        else if (strcmp(argv[i], "--cpu-occlusion") == 0)
+            options.cpuOcclusion = true;
+        else if (strcmp(argv[i], "--occlusion-benchmark") == 0)
+            options.occlusionBenchmark = true;
+        else if (strcmp(argv[i], "--no-lod") == 0)
+            options.lod = false;
+        else if (strcmp(argv[i], "--lod-error") == 0 && hasValue)
+            options.lodError = std::max(0.0f, (float)atof(argv[++i]));
+        else if (strcmp(argv[i], "--no-terrain") == 0)
+            options.terrain = false;
+        else if (strcmp(argv[i], "--terrain-size") == 0 && hasValue)
+            options.terrainSize = std::max(1.0f, (float)atof(argv[++i]));
+        else if (strcmp(argv[i], "--terrain-cache") == 0 && hasValue)
+            options.terrainCacheDirectory = argv[++i];
+        else if (strcmp(argv[i], "--terrain-vram") == 0 && hasValue)
+            options.terrainBudget = std::max(0.0f, (float)atof(argv[++i]));
+        else if (strcmp(argv[i], "--ring-frames") == 0 && hasValue)
+            options.ringFrames = (unsigned int)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--shader-cache") == 0 && hasValue)
+            options.shaderCacheDirectory = argv[++i];
+        else if (strcmp(argv[i], "--no-shader-cache") == 0)
+            options.shaderCacheDirectory.clear();
+        else if (strcmp(argv[i], "--scene-cache") == 0 && hasValue)
+            options.sceneCacheDirectory = argv[++i];
+        else if (strcmp(argv[i], "--no-scene-cache") == 0)
+            options.sceneCacheDirectory.clear();
+        else if (strcmp(argv[i], "--scene") == 0 && hasValue)
+            options.sceneFile = argv[++i];
+        else if (strcmp(argv[i], "--texture-cache") == 0 && hasValue)
+            options.textureCacheDirectory = argv[++i];
+        else if (strcmp(argv[i], "--no-texture-cache") == 0)
+            options.textureCacheDirectory.clear();
+        else if (strcmp(argv[i], "--mip-benchmark") == 0)
+            options.mipBenchmark = true;
+        else if (strcmp(argv[i], "--size") == 0 && hasValue)
+        {
+            unsigned int width, height;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) == 2 && width > 0 && height > 0)
+            {
+                options.width = width;
+                options.height = height;
+            }
+            else
+                std::cout << "Ignoring malformed --size, expected WIDTHxHEIGHT" << std::endl;
+        }
+        else
+            std::cout << "Ignoring unknown argument: " << argv[i] << std::endl;
+    }
+    return options;
+}
+
+#endif
@@ -0,0 +1,332 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_extensions.h"
+#include "gpu_timer.h"
+#include "uniform_buffer.h"
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// passes run in this order; each one sets its own depth function
+enum RenderQueuePass
+{
+    QUEUE_PASS_OPAQUE = 0,
+    QUEUE_PASS_SKYBOX = 1,
+    QUEUE_PASS_COUNT
+};
+
+// everything the queue needs to issue one draw. Indexed items (indexType != 0) that end up next
+// to each other with the same state are merged into one glMultiDrawElementsBaseVertex; instanced
+// items (instanceCount > 0, indexed only) are always drawn on their own, and so are indirect items
+// (indirectBuffer != 0), whose indirectCount commands come from a GL_DRAW_INDIRECT_BUFFER.
+struct DrawItem
+{
+    unsigned int pass = QUEUE_PASS_OPAQUE;
+    unsigned int program = 0;
+    GLenum textureTarget = GL_TEXTURE_2D;
+    unsigned int texture = 0;
+    unsigned int VAO = 0;
+    const DrawBlockBuffer* drawBlocks = NULL;   // optional per-draw uniform block records
+    unsigned int drawBlock = 0;
+    int timerPass = -1;                         // GpuTimer pass started when this item is reached
+    glm::vec3 center = glm::vec3(0.0f);         // world space, for the front-to-back order
+
+    GLenum mode = GL_TRIANGLES;
+    GLenum indexType = 0;                       // 0 draws arrays
+    GLsizei count = 0;
+    const void* indexOffset = NULL;
+    GLint baseVertex = 0;                       // first vertex when drawing arrays
+    GLsizei instanceCount = 0;                  // > 0 draws that many instances
+    unsigned int indirectBuffer = 0;            // != 0: glMultiDrawElementsIndirect (GL 4.3), indexed only
+    GLsizei indirectCount = 0;
+};
+
+// collects the draws of a frame, sorts them by a 64-bit key and submits them with as few state
+// changes as possible. Key layout, most significant first:
+//
+//   pass (4) | program (12) | texture (12) | VAO (12) | depth (24)
+//
+// Program, texture and VAO names are replaced by small ids handed out in first-seen order, so
+// the key only says "same state or not". Depth is the view-space distance of the item's center,
+// which orders the items sharing a state front to back for early-Z. The skybox pass sorts after
+// everything else. The sort is an LSD radix sort over the key bytes that skips bytes every key
+// shares, which for a static scene is most of them.
+// ------------------------------------------------------------------------------------------------
+class RenderQueue
+{
+public:
+    // once per frame, before submit(); items farther than farPlane share the largest depth
+    void begin(const glm::vec3& eye, const glm::vec3& forward, float farPlane)
+    {
+        items.clear();
+        entries.clear();
+        viewPosition = eye;
+        viewDirection = forward;
+        depthScale = farPlane > 0.0f ? (float)DEPTH_MASK / farPlane : 0.0f;
+    }
+
+    void submit(const DrawItem& item)
+    {
+        const uint64_t maxDepth = DEPTH_MASK;
+        float distance = glm::dot(item.center - viewPosition, viewDirection) * depthScale;
+        uint64_t depth = distance <= 0.0f ? 0 : distance >= (float)maxDepth ? maxDepth : (uint64_t)distance;
+
+        uint64_t key = (uint64_t)(item.pass & 0xF) << 60;
+        key |= (uint64_t)(stateId(programs, item.program) & 0xFFF) << 48;
+        key |= (uint64_t)(stateId(textures, item.texture) & 0xFFF) << 36;
+        key |= (uint64_t)(stateId(vertexArrays, item.VAO) & 0xFFF) << 24;
+        key |= depth;
+
+        SortEntry entry = { key, (uint32_t)items.size() };
+        entries.push_back(entry);
+        items.push_back(item);
+    }
+
+    // sorts and draws everything submitted since begin(); timer may be an uninitialised GpuTimer
+    void execute(GpuTimer& timer)
+    {
+        unsortedChanges = countStateChanges(false);
+        sortEntries();
+        sortedChanges = countStateChanges(true);
+        drawCalls = 0;
+
+        State state;
+        int timerPass = -1;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const DrawItem& item = items[entries[i].item];
+            if (item.timerPass >= 0 && item.timerPass != timerPass)
+            {
+                flush();
+                timer.begin((unsigned int)item.timerPass);
+                timerPass = item.timerPass;
+            }
+            if (state.differs(item))
+            {
+                flush();
+                apply(state, item);
+            }
+
+            if (item.indirectBuffer != 0)
+            {
+                flush();
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, item.indirectBuffer);
+                glExt().MultiDrawElementsIndirect(item.mode, item.indexType, item.indexOffset, item.indirectCount, 0);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+                drawCalls++;
+                continue;
+            }
+            if (item.instanceCount > 0)
+            {
+                flush();
+                glDrawElementsInstancedBaseVertex(item.mode, item.count, item.indexType, item.indexOffset,
+                                                  item.instanceCount, item.baseVertex);
+                drawCalls++;
+                continue;
+            }
+            if (item.indexType == 0)
+            {
+                glDrawArrays(item.mode, item.baseVertex, item.count);
+                drawCalls++;
+                continue;
+            }
+            if (!batchCounts.empty() && (item.mode != batchMode || item.indexType != batchIndexType))
+                flush();
+            batchMode = item.mode;
+            batchIndexType = item.indexType;
+            batchCounts.push_back(item.count);
+            batchOffsets.push_back(item.indexOffset);
+            batchBaseVertices.push_back(item.baseVertex);
+        }
+        flush();
+
+        glBindVertexArray(0);
+        glDepthFunc(GL_LESS);
+
+        frames++;
+        totalItems += entries.size();
+        totalDrawCalls += drawCalls;
+        totalUnsortedChanges += unsortedChanges;
+        totalSortedChanges += sortedChanges;
+    }
+
+    // last frame
+    unsigned int itemCount() const { return (unsigned int)entries.size(); }
+    unsigned int drawCallCount() const { return drawCalls; }
+    unsigned int stateChanges() const { return sortedChanges; }
+    unsigned int stateChangesSaved() const { return unsortedChanges - sortedChanges; }
+
+    // per-frame averages over every executed frame
+    void report(std::ostream& out) const
+    {
+        if (frames == 0)
+            return;
+        double n = (double)frames;
+        out << "render queue: " << totalItems / n << " items, " << totalDrawCalls / n << " draw calls, "
+            << totalSortedChanges / n << " state changes per frame (" << totalUnsortedChanges / n
+            << " in submission order, " << (totalUnsortedChanges - totalSortedChanges) / n << " saved)" << std::endl;
+    }
+
+private:
+    static const uint64_t DEPTH_MASK = (1u << 24) - 1;
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t item;
+    };
+
+    // what is currently bound; ~0u means unknown so the first item binds everything
+    struct State
+    {
+        unsigned int pass = ~0u;
+        unsigned int program = ~0u;
+        unsigned int texture = ~0u;
+        unsigned int VAO = ~0u;
+        const DrawBlockBuffer* drawBlocks = NULL;
+        unsigned int drawBlock = ~0u;
+
+        // one per piece of state that has to be rebound for item
+        unsigned int changes(const DrawItem& item) const
+        {
+            unsigned int count = 0;
+            count += item.pass != pass;
+            count += item.program != program;
+            count += item.texture != texture;
+            count += item.VAO != VAO;
+            count += item.drawBlocks && (item.drawBlocks != drawBlocks || item.drawBlock != drawBlock);
+            return count;
+        }
+        bool differs(const DrawItem& item) const { return changes(item) != 0; }
+
+        void set(const DrawItem& item)
+        {
+            pass = item.pass;
+            program = item.program;
+            texture = item.texture;
+            VAO = item.VAO;
+            if (item.drawBlocks)
+            {
+                drawBlocks = item.drawBlocks;
+                drawBlock = item.drawBlock;
+            }
+        }
+    };
+
+    std::vector<DrawItem> items;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;
+    std::vector<unsigned int> programs;
+    std::vector<unsigned int> textures;
+    std::vector<unsigned int> vertexArrays;
+
+    glm::vec3 viewPosition = glm::vec3(0.0f);
+    glm::vec3 viewDirection = glm::vec3(0.0f, 0.0f, -1.0f);
+    float depthScale = 0.0f;
+
+    GLenum batchMode = GL_TRIANGLES;
+    GLenum batchIndexType = 0;
+    std::vector<GLsizei> batchCounts;
+    std::vector<const void*> batchOffsets;
+    std::vector<GLint> batchBaseVertices;
+
+    unsigned int drawCalls = 0;
+    unsigned int unsortedChanges = 0;
+    unsigned int sortedChanges = 0;
+    unsigned long long frames = 0;
+    unsigned long long totalItems = 0;
+    unsigned long long totalDrawCalls = 0;
+    unsigned long long totalUnsortedChanges = 0;
+    unsigned long long totalSortedChanges = 0;
+
+    static unsigned int stateId(std::vector<unsigned int>& names, unsigned int name)
+    {
+        for (unsigned int i = 0; i < names.size(); i++)
+            if (names[i] == name)
+                return i;
+        names.push_back(name);
+        return (unsigned int)names.size() - 1;
+    }
+
+    static GLenum passDepthFunc(unsigned int pass)
+    {
+        // the skybox is drawn at depth 1.0, which only passes against a cleared buffer with LEQUAL
+        return pass == QUEUE_PASS_SKYBOX ? GL_LEQUAL : GL_LESS;
+    }
+
+    void apply(State& state, const DrawItem& item) const
+    {
+        if (item.pass != state.pass)
+            glDepthFunc(passDepthFunc(item.pass));
+        if (item.program != state.program)
+            glUseProgram(item.program);
+        if (item.texture != state.texture)
+            glBindTexture(item.textureTarget, item.texture);
+        if (item.VAO != state.VAO)
+            glBindVertexArray(item.VAO);
+        if (item.drawBlocks && (item.drawBlocks != state.drawBlocks || item.drawBlock != state.drawBlock))
+            item.drawBlocks->bind(item.drawBlock);
+        state.set(item);
+    }
+
+    // issues the pending run of indexed draws as one multi-draw
+    void flush()
+    {
+        if (batchCounts.empty())
+            return;
+        glMultiDrawElementsBaseVertex(batchMode, batchCounts.data(), batchIndexType, batchOffsets.data(),
+                                      (GLsizei)batchCounts.size(), batchBaseVertices.data());
+        drawCalls++;
+        batchCounts.clear();
+        batchOffsets.clear();
+        batchBaseVertices.clear();
+    }
+
+    // state changes needed to draw the items in submission or in sorted order
+    unsigned int countStateChanges(bool sorted) const
+    {
+        State state;
+        unsigned int count = 0;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            const DrawItem& item = items[sorted ? entries[i].item : i];
+            count += state.changes(item);
+            state.set(item);
+        }
+        return count;
+    }
+
+    // stable LSD radix sort, 8 bits per pass
+    void sortEntries()
+    {
+        size_t n = entries.size();
+        if (n < 2)
+            return;
+        scratch.resize(n);
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = {};
+            for (const SortEntry& entry : entries)
+                offsets[(entry.key >> shift) & 0xFF]++;
+            if (offsets[(entries[0].key >> shift) & 0xFF] == n)
+                continue; // every key has the same byte here
+            size_t sum = 0;
+            for (size_t& offset : offsets)
+            {
+                size_t count = offset;
+                offset = sum;
+                sum += count;
+            }
+            for (const SortEntry& entry : entries)
+                scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+            entries.swap(scratch);
+        }
+    }
+};
+
+#endif
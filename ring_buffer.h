@@ -0,0 +1,244 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "gl_extensions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// one buffer for everything written every frame (uniform blocks, instance attributes, streamed
+// vertices), split into regionCount frame regions used round-robin. Each frame writes only its own
+// region, so the GPU can still be reading the previous ones; a fence after the frame's draws guards
+// the region, and beginFrame() waits on it only when the CPU has come all the way round while the
+// GPU is still behind. Every such wait is counted and timed.
+//
+// With GL 4.4 / GL_ARB_buffer_storage the buffer is immutable and mapped once, persistent and
+// coherent, and map() just hands out a pointer into it. On plain GL 3.3 every map() is a
+// glMapBufferRange of that range with GL_MAP_UNSYNCHRONIZED_BIT (the fences do the
+// synchronization instead of the driver), unmapped again by unmap().
+//
+// Allocations are aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so any of them can be bound as a
+// uniform block. A frame that asks for more than its region gets NULL (the caller uploads the old
+// way) and the next beginFrame() recreates the buffer with larger regions.
+// ------------------------------------------------------------------------------------------------
+class RingBuffer
+{
+public:
+    unsigned int buffer = 0;
+
+    void create(GLsizeiptr regionBytes, unsigned int regionCount = 3)
+    {
+        GLint uniformAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        alignment = std::max((GLsizeiptr)uniformAlignment, (GLsizeiptr)16);
+        regions.assign(std::max(regionCount, 1u), Region());
+        allocate(regionBytes);
+        current = 0;
+        used = asked = 0;
+        frameOpen = false;
+    }
+
+    // claims the next region, first waiting for the GPU to finish the frame that used it last
+    void beginFrame()
+    {
+        if (grow)
+            resize();
+        current = (current + 1) % regions.size();
+        Region& region = regions[current];
+        if (region.fence)
+        {
+            GLenum status = glClientWaitSync(region.fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                auto waitBegin = std::chrono::steady_clock::now();
+                do
+                    status = glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                while (status == GL_TIMEOUT_EXPIRED);
+                std::chrono::duration<double, std::milli> waitTime = std::chrono::steady_clock::now() - waitBegin;
+                waits++;
+                totalWait += waitTime.count();
+                maxWait = std::max(maxWait, waitTime.count());
+            }
+            glDeleteSync(region.fence);
+            region.fence = 0;
+        }
+        used = 0;
+        asked = 0;
+        frameOpen = true;
+        frames++;
+    }
+
+    // fences the region once the frame's draws are submitted
+    void endFrame()
+    {
+        if (!frameOpen)
+            return;
+        regions[current].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        peakUsed = std::max(peakUsed, used);
+        frameOpen = false;
+    }
+
+    // reserves size bytes of this frame's region and returns where to write them, with their offset
+    // in buffer; NULL when the region is full. Call unmap() once written.
+    void* map(GLsizeiptr size, GLintptr& offset)
+    {
+        if (!frameOpen || size <= 0)
+            return NULL;
+        GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+        asked = (asked + alignment - 1) / alignment * alignment + size;
+        if (start + size > regionBytes)
+        {
+            overflows++;
+            grow = std::max(grow, asked);
+            return NULL;
+        }
+        used = start + size;
+        offset = (GLintptr)current * regionBytes + start;
+        if (persistent)
+            return mapped + offset;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (!data)
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return data;
+    }
+
+    void unmap()
+    {
+        if (persistent)
+            return;
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    // copies data into this frame's region and returns its offset in buffer, or -1 when it doesn't fit
+    GLintptr write(const void* data, GLsizeiptr size)
+    {
+        GLintptr offset = 0;
+        void* target = map(size, offset);
+        if (!target)
+            return -1;
+        memcpy(target, data, size);
+        unmap();
+        return offset;
+    }
+
+    // writes a uniform block into this frame's region and binds it to binding; false when it doesn't fit
+    bool bindUniform(unsigned int binding, const void* data, GLsizeiptr size)
+    {
+        GLintptr offset = write(data, size);
+        if (offset < 0)
+            return false;
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+        return true;
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (frames == 0)
+            return;
+        out << "ring buffer: " << (persistent ? "persistent" : "unsynchronized glMapBufferRange") << ", " << regions.size() << " x "
+            << regionBytes / 1024.0 << " KB, peak " << peakUsed / 1024.0 << " KB per frame, fence waits " << waits << " of " << frames
+            << " frames";
+        if (waits > 0)
+            out << " (" << totalWait << " ms total, max " << maxWait << " ms)";
+        if (overflows > 0)
+            out << ", " << overflows << " allocations overflowed";
+        out << std::endl;
+    }
+
+    void destroy()
+    {
+        release();
+        regions.clear();
+    }
+
+private:
+    struct Region
+    {
+        GLsync fence = 0;
+    };
+
+    std::vector<Region> regions;
+    GLsizeiptr regionBytes = 0;
+    GLsizeiptr alignment = 256;
+    unsigned int current = 0;
+    GLsizeiptr used = 0;            // bytes of the current region handed out
+    GLsizeiptr asked = 0;           // and what this frame asked for, including what didn't fit
+    bool frameOpen = false;
+    bool persistent = false;
+    unsigned char* mapped = NULL;   // the whole buffer, when persistent
+    GLsizeiptr grow = 0;            // regions need this much, set on overflow
+
+    unsigned long long frames = 0;
+    unsigned long long waits = 0;
+    unsigned long long overflows = 0;
+    double totalWait = 0.0;
+    double maxWait = 0.0;
+    GLsizeiptr peakUsed = 0;
+
+    void allocate(GLsizeiptr bytes)
+    {
+        regionBytes = (bytes + alignment - 1) / alignment * alignment;
+        GLsizeiptr size = regionBytes * (GLsizeiptr)regions.size();
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        const GLExtensions& ext = glExt();
+        persistent = ext.bufferStorage;
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            ext.BufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags);
+            if (!mapped)
+            {
+                std::cout << "ring buffer: persistent mapping failed, mapping ranges instead" << std::endl;
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+                persistent = false;
+            }
+        }
+        if (!persistent)
+            glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void release()
+    {
+        for (Region& region : regions)
+            if (region.fence)
+            {
+                glClientWaitSync(region.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(region.fence);
+                region.fence = 0;
+            }
+        if (mapped)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = NULL;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    // a frame asked for more than a region: the GPU finishes with the old buffer, then every region
+    // gets room for what was asked plus half again (at least twice the old size)
+    void resize()
+    {
+        GLsizeiptr bytes = std::max(regionBytes * 2, grow + grow / 2);
+        release();
+        allocate(bytes);
+        std::cout << "ring buffer: regions grown to " << regionBytes / 1024.0 << " KB" << std::endl;
+        grow = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,370 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "file_util.h"
+#include "instance_batch.h"
+#include "static_batch.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// sections of a scene file, in file order
+enum SceneSection
+{
+    SCENE_MATERIALS,            // SceneMaterial, one per layer of the material texture array
+    SCENE_STATIC_MESHES,        // SceneStaticMesh
+    SCENE_STATIC_GROUPS,        // StaticBatch::GroupRecord
+    SCENE_STATIC_VERTICES,      // encoded, as StaticBatch uploads them
+    SCENE_STATIC_INDICES,       // 16 or 32 bit, see SceneFileHeader::staticIndexType
+    SCENE_INSTANCED_MESHES,     // InstanceBatch::MeshRecord
+    SCENE_INSTANCED_VERTICES,   // 5 floats per vertex
+    SCENE_INSTANCED_INDICES,    // 32 bit, every level of every mesh
+    SCENE_INSTANCES,            // InstanceData, grouped by mesh
+    SCENE_SKY_VERTICES,         // 3 floats per vertex, the skybox cube
+    SCENE_OCCLUDERS,            // glm::vec3, three world-space corners per triangle (--cpu-occlusion)
+    SCENE_SECTION_COUNT
+};
+
+struct SceneMaterial
+{
+    char texture[128];          // image path, zero-terminated
+};
+
+struct SceneStaticMesh
+{
+    char name[32];
+    MeshRange range;
+};
+
+// what SceneFile::write stores: the batches after build(true), so their GPU data is still around
+struct SceneContents
+{
+    std::vector<std::string> materials;
+    const StaticBatch* staticBatch = NULL;
+    std::vector<std::string> staticMeshNames;
+    const InstanceBatch* instanceBatch = NULL;
+    const float* skyVertices = NULL;
+    size_t skyFloatCount = 0;
+    std::vector<glm::vec3> occluders;
+};
+
+// the scene as it goes to the GPU, in one file:
+//
+//   SceneFileHeader (section table) | sections, each 64-byte aligned
+//
+// Every section is either a blob that goes to glBufferData as it is (vertices, indices, instances)
+// or a table of plain records, so loading is mapping the file and handing pointers into it to the
+// batches; nothing is parsed or converted, and only the pages GL actually reads are ever loaded.
+// Any file with this version and record layout loads (open(path), --scene FILE); open() checks
+// every range the records point at against its section before any of it goes to GL, so a damaged
+// or hand-edited file is rejected rather than drawn. As the scene cache, the file is also only
+// valid for the build that wrote it: the header holds a stamp of whatever the scene was made from
+// (the caller's business), open(path, stamp) treats any other as stale and the scene is rebuilt.
+// ------------------------------------------------------------------------------------------------
+class SceneFile
+{
+public:
+    static const size_t SECTION_ALIGNMENT = 64;
+
+    // maps path and checks it; false when it is missing, damaged or of another version or layout
+    bool open(const std::string& path)
+    {
+        close();
+        if (!file.open(path) || file.size() < sizeof(SceneFileHeader))
+            return false;
+        memcpy(&header, file.data(), sizeof(header));
+        bool valid = header.magic == MAGIC && header.version == VERSION && header.layoutStamp == layoutStamp() &&
+                     (header.staticIndexType == GL_UNSIGNED_SHORT || header.staticIndexType == GL_UNSIGNED_INT);
+        for (unsigned int section = 0; section < SCENE_SECTION_COUNT && valid; section++)
+        {
+            const SectionEntry& entry = header.sections[section];
+            size_t record = recordSize((SceneSection)section);
+            valid = entry.offset % SECTION_ALIGNMENT == 0 && entry.offset <= file.size() && entry.size <= file.size() - entry.offset &&
+                    entry.size % record == 0;
+        }
+        if (!valid || !recordsInBounds())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // the same, as a cache entry: also false when it was written from anything but stamp
+    bool open(const std::string& path, uint64_t stamp)
+    {
+        if (!open(path))
+            return false;
+        if (header.stamp != stamp)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        header = SceneFileHeader();
+    }
+
+    bool isOpen() const { return file.data() != NULL; }
+    size_t size() const { return file.size(); }
+
+    // a section as an array of T, straight from the mapping
+    template <typename T>
+    const T* records(SceneSection section) const
+    {
+        return (const T*)(file.data() + header.sections[section].offset);
+    }
+    template <typename T>
+    size_t count(SceneSection section) const
+    {
+        return (size_t)(header.sections[section].size / sizeof(T));
+    }
+    size_t sectionBytes(SceneSection section) const { return (size_t)header.sections[section].size; }
+
+    std::vector<std::string> materials() const
+    {
+        std::vector<std::string> textures;
+        const SceneMaterial* material = records<SceneMaterial>(SCENE_MATERIALS);
+        for (size_t i = 0; i < count<SceneMaterial>(SCENE_MATERIALS); i++)
+            textures.push_back(std::string(material[i].texture, strnlen(material[i].texture, sizeof(material[i].texture))));
+        return textures;
+    }
+
+    std::string staticMeshName(unsigned int id) const
+    {
+        const SceneStaticMesh& mesh = records<SceneStaticMesh>(SCENE_STATIC_MESHES)[id];
+        return std::string(mesh.name, strnlen(mesh.name, sizeof(mesh.name)));
+    }
+
+    void loadStaticBatch(StaticBatch& batch) const
+    {
+        std::vector<MeshRange> ranges;
+        const SceneStaticMesh* meshes = records<SceneStaticMesh>(SCENE_STATIC_MESHES);
+        for (size_t i = 0; i < count<SceneStaticMesh>(SCENE_STATIC_MESHES); i++)
+            ranges.push_back(meshes[i].range);
+        batch.load(ranges.data(), ranges.size(), records<StaticBatch::GroupRecord>(SCENE_STATIC_GROUPS),
+                   count<StaticBatch::GroupRecord>(SCENE_STATIC_GROUPS), records<unsigned char>(SCENE_STATIC_VERTICES),
+                   sectionBytes(SCENE_STATIC_VERTICES), records<unsigned char>(SCENE_STATIC_INDICES), sectionBytes(SCENE_STATIC_INDICES),
+                   (GLenum)header.staticIndexType);
+    }
+
+    void loadInstanceBatch(InstanceBatch& batch) const
+    {
+        batch.load(records<InstanceBatch::MeshRecord>(SCENE_INSTANCED_MESHES), count<InstanceBatch::MeshRecord>(SCENE_INSTANCED_MESHES),
+                   records<float>(SCENE_INSTANCED_VERTICES), count<float>(SCENE_INSTANCED_VERTICES),
+                   records<unsigned int>(SCENE_INSTANCED_INDICES), count<unsigned int>(SCENE_INSTANCED_INDICES),
+                   records<InstanceData>(SCENE_INSTANCES), count<InstanceData>(SCENE_INSTANCES));
+    }
+
+    // writes contents under a temporary name and renames it into place, so no run ever maps half a file
+    static bool write(const std::string& path, uint64_t stamp, const SceneContents& contents)
+    {
+        SceneFileHeader header;
+        header.stamp = stamp;
+        header.layoutStamp = layoutStamp();
+        header.staticIndexType = contents.staticBatch->indexFormat();
+
+        std::vector<SceneMaterial> materials(contents.materials.size());
+        for (size_t i = 0; i < materials.size(); i++)
+            strncpy(materials[i].texture, contents.materials[i].c_str(), sizeof(materials[i].texture) - 1);
+        std::vector<SceneStaticMesh> staticMeshes(contents.staticBatch->meshCount());
+        for (unsigned int id = 0; id < staticMeshes.size(); id++)
+        {
+            if (id < contents.staticMeshNames.size())
+                strncpy(staticMeshes[id].name, contents.staticMeshNames[id].c_str(), sizeof(staticMeshes[id].name) - 1);
+            staticMeshes[id].range = contents.staticBatch->mesh(id);
+        }
+        std::vector<StaticBatch::GroupRecord> groups = contents.staticBatch->groupRecords();
+        std::vector<InstanceBatch::MeshRecord> instancedMeshes = contents.instanceBatch->meshRecords();
+
+        const void* data[SCENE_SECTION_COUNT];
+        data[SCENE_MATERIALS] = materials.data();
+        header.sections[SCENE_MATERIALS].size = materials.size() * sizeof(SceneMaterial);
+        data[SCENE_STATIC_MESHES] = staticMeshes.data();
+        header.sections[SCENE_STATIC_MESHES].size = staticMeshes.size() * sizeof(SceneStaticMesh);
+        data[SCENE_STATIC_GROUPS] = groups.data();
+        header.sections[SCENE_STATIC_GROUPS].size = groups.size() * sizeof(StaticBatch::GroupRecord);
+        data[SCENE_STATIC_VERTICES] = contents.staticBatch->encodedVertices().data();
+        header.sections[SCENE_STATIC_VERTICES].size = contents.staticBatch->encodedVertices().size();
+        data[SCENE_STATIC_INDICES] = contents.staticBatch->encodedIndices().data();
+        header.sections[SCENE_STATIC_INDICES].size = contents.staticBatch->encodedIndices().size();
+        data[SCENE_INSTANCED_MESHES] = instancedMeshes.data();
+        header.sections[SCENE_INSTANCED_MESHES].size = instancedMeshes.size() * sizeof(InstanceBatch::MeshRecord);
+        data[SCENE_INSTANCED_VERTICES] = contents.instanceBatch->sourceVertices().data();
+        header.sections[SCENE_INSTANCED_VERTICES].size = contents.instanceBatch->sourceVertices().size() * sizeof(float);
+        data[SCENE_INSTANCED_INDICES] = contents.instanceBatch->sourceIndices().data();
+        header.sections[SCENE_INSTANCED_INDICES].size = contents.instanceBatch->sourceIndices().size() * sizeof(unsigned int);
+        data[SCENE_INSTANCES] = contents.instanceBatch->instances().data();
+        header.sections[SCENE_INSTANCES].size = contents.instanceBatch->instances().size() * sizeof(InstanceData);
+        data[SCENE_SKY_VERTICES] = contents.skyVertices;
+        header.sections[SCENE_SKY_VERTICES].size = contents.skyFloatCount * sizeof(float);
+        data[SCENE_OCCLUDERS] = contents.occluders.data();
+        header.sections[SCENE_OCCLUDERS].size = contents.occluders.size() * sizeof(glm::vec3);
+
+        uint64_t offset = sizeof(SceneFileHeader);
+        for (unsigned int section = 0; section < SCENE_SECTION_COUNT; section++)
+        {
+            offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+            header.sections[section].offset = offset;
+            offset += header.sections[section].size;
+        }
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char*)&header, sizeof(header));
+            uint64_t written = sizeof(header);
+            static const char padding[SECTION_ALIGNMENT] = {};
+            for (unsigned int section = 0; section < SCENE_SECTION_COUNT; section++)
+            {
+                out.write(padding, (std::streamsize)(header.sections[section].offset - written));
+                out.write((const char*)data[section], (std::streamsize)header.sections[section].size);
+                written = header.sections[section].offset + header.sections[section].size;
+            }
+            if (!out)
+                return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x4E535950; // "PYSN"
+    static const uint32_t VERSION = 1;
+
+    struct SectionEntry
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    struct SceneFileHeader
+    {
+        uint32_t magic = MAGIC;
+        uint32_t version = VERSION;
+        uint64_t stamp = 0;
+        uint64_t layoutStamp = 0;           // the record sizes of the build that wrote it
+        uint32_t staticIndexType = GL_UNSIGNED_SHORT;
+        uint32_t reserved = 0;
+        SectionEntry sections[SCENE_SECTION_COUNT];
+    };
+
+    MappedFile file;
+    SceneFileHeader header;
+
+    static size_t recordSize(SceneSection section)
+    {
+        switch (section)
+        {
+        case SCENE_MATERIALS: return sizeof(SceneMaterial);
+        case SCENE_STATIC_MESHES: return sizeof(SceneStaticMesh);
+        case SCENE_STATIC_GROUPS: return sizeof(StaticBatch::GroupRecord);
+        case SCENE_INSTANCED_MESHES: return sizeof(InstanceBatch::MeshRecord);
+        case SCENE_INSTANCED_VERTICES: return InstanceBatch::FLOATS_PER_VERTEX * sizeof(float);
+        case SCENE_INSTANCED_INDICES: return sizeof(unsigned int);
+        case SCENE_INSTANCES: return sizeof(InstanceData);
+        case SCENE_SKY_VERTICES: return 3 * sizeof(float);
+        case SCENE_OCCLUDERS: return 3 * sizeof(glm::vec3);
+        default: return 1;
+        }
+    }
+
+    // every range a record points at lies inside its section, and every index inside its mesh, so
+    // nothing drawn from the file reads outside the buffers it is uploaded to
+    bool recordsInBounds() const
+    {
+        size_t groupCount = count<StaticBatch::GroupRecord>(SCENE_STATIC_GROUPS);
+        const StaticBatch::GroupRecord* groups = records<StaticBatch::GroupRecord>(SCENE_STATIC_GROUPS);
+        uint64_t vertexBytes = sectionBytes(SCENE_STATIC_VERTICES);
+        for (size_t g = 0; g < groupCount; g++)
+            if ((unsigned int)groups[g].format.position > POSITION_UNORM10 || (unsigned int)groups[g].format.texCoord > TEXCOORD_UNORM16 ||
+                groups[g].byteOffset > groups[g].layerOffset || groups[g].layerOffset > vertexBytes)
+                return false;
+
+        size_t staticIndexSize = header.staticIndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        uint64_t staticIndexCount = sectionBytes(SCENE_STATIC_INDICES) / staticIndexSize;
+        const unsigned char* staticIndices = records<unsigned char>(SCENE_STATIC_INDICES);
+        const SceneStaticMesh* staticMeshes = records<SceneStaticMesh>(SCENE_STATIC_MESHES);
+        for (size_t id = 0; id < count<SceneStaticMesh>(SCENE_STATIC_MESHES); id++)
+        {
+            const MeshRange& range = staticMeshes[id].range;
+            if (range.group >= groupCount || range.baseVertex < 0 || range.indexCount < 0 ||
+                (uint64_t)range.firstIndex + (uint64_t)range.indexCount > staticIndexCount)
+                return false;
+            const StaticBatch::GroupRecord& group = groups[range.group];
+            uint64_t vertexEnd = (uint64_t)range.baseVertex + range.vertexCount;
+            if (group.byteOffset + vertexEnd * group.format.stride() > group.layerOffset || group.layerOffset + vertexEnd > vertexBytes)
+                return false;
+            for (GLsizei i = 0; i < range.indexCount; i++)
+            {
+                size_t at = ((size_t)range.firstIndex + i) * staticIndexSize;
+                uint32_t index = 0;
+                if (staticIndexSize == sizeof(uint16_t))
+                {
+                    uint16_t shortIndex;
+                    memcpy(&shortIndex, staticIndices + at, sizeof(shortIndex));
+                    index = shortIndex;
+                }
+                else
+                    memcpy(&index, staticIndices + at, sizeof(index));
+                if (index >= range.vertexCount)
+                    return false;
+            }
+        }
+
+        // the instance ranges have to tile the instances in mesh order, that is how InstanceBatch maps
+        // an instance back to its mesh
+        size_t meshCount = count<InstanceBatch::MeshRecord>(SCENE_INSTANCED_MESHES);
+        if (meshCount == 0 || meshCount > 65536)
+            return false;
+        uint64_t instancedVertexCount = count<float>(SCENE_INSTANCED_VERTICES) / InstanceBatch::FLOATS_PER_VERTEX;
+        uint64_t instancedIndexCount = count<unsigned int>(SCENE_INSTANCED_INDICES);
+        const unsigned int* instancedIndices = records<unsigned int>(SCENE_INSTANCED_INDICES);
+        const InstanceBatch::MeshRecord* meshes = records<InstanceBatch::MeshRecord>(SCENE_INSTANCED_MESHES);
+        uint64_t nextInstance = 0;
+        for (size_t id = 0; id < meshCount; id++)
+        {
+            const InstanceBatch::MeshRecord& mesh = meshes[id];
+            if (mesh.lodCount == 0 || mesh.lodCount > InstanceBatch::MAX_LODS || mesh.baseVertex < 0 ||
+                (uint64_t)mesh.baseVertex + mesh.vertexCount > instancedVertexCount || mesh.firstInstance != nextInstance)
+                return false;
+            nextInstance += mesh.instanceCount;
+            for (unsigned int level = 0; level < mesh.lodCount; level++)
+            {
+                unsigned int firstIndex = mesh.lods[level].firstIndex;
+                GLsizei indexCount = mesh.lods[level].indexCount;
+                if (indexCount < 0 || (uint64_t)firstIndex + (uint64_t)indexCount > instancedIndexCount)
+                    return false;
+                for (GLsizei i = 0; i < indexCount; i++)
+                    if (instancedIndices[firstIndex + i] >= mesh.vertexCount)
+                        return false;
+            }
+        }
+        return nextInstance == count<InstanceData>(SCENE_INSTANCES);
+    }
+
+    static uint64_t layoutStamp()
+    {
+        uint64_t sizes[SCENE_SECTION_COUNT];
+        for (unsigned int section = 0; section < SCENE_SECTION_COUNT; section++)
+            sizes[section] = recordSize((SceneSection)section);
+        return hashBytes(sizes, sizeof(sizes));
+    }
+};
+
+#endif
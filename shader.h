@@ -0,0 +1,232 @@
+#ifndef PYRAMID_SHADER_H
+#define PYRAMID_SHADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_extensions.h"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+// same interface as learnopengl/shader_m.h, plus a constructor that adopts an already linked
+// program so programs can be shared and loaded from the ShaderCache.
+//
+// Uniform locations are read once per program right after linking; the set* helpers look
+// them up in that table instead of calling glGetUniformLocation every time. Copies of a Shader
+// share the table.
+// ------------------------------------------------------------------------------------------
+class Shader
+{
+public:
+    unsigned int ID = 0;
+
+    Shader() {}
+
+    explicit Shader(unsigned int program) : ID(program)
+    {
+        cacheUniformLocations();
+    }
+
+    // constructor reads, compiles and links the shader on the fly
+    // ------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath)
+    {
+        std::string vertexCode, fragmentCode;
+        readFile(vertexPath, vertexCode);
+        readFile(fragmentPath, fragmentCode);
+        ID = compileProgram(vertexCode, fragmentCode);
+        cacheUniformLocations();
+    }
+
+    // activate the shader
+    // -------------------
+    void use() const
+    {
+        glUseProgram(ID);
+    }
+
+    // utility uniform functions
+    // -------------------------
+    void setBool(const std::string &name, bool value) const
+    {
+        glUniform1i(location(name), (int)value);
+    }
+    void setInt(const std::string &name, int value) const
+    {
+        glUniform1i(location(name), value);
+    }
+    void setFloat(const std::string &name, float value) const
+    {
+        glUniform1f(location(name), value);
+    }
+    void setVec2(const std::string &name, const glm::vec2 &value) const
+    {
+        glUniform2fv(location(name), 1, &value[0]);
+    }
+    void setVec3(const std::string &name, const glm::vec3 &value) const
+    {
+        glUniform3fv(location(name), 1, &value[0]);
+    }
+    void setVec4(const std::string &name, const glm::vec4 &value) const
+    {
+        glUniform4fv(location(name), 1, &value[0]);
+    }
+    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
+    }
+
+    // location from the table built at link time, -1 for uniforms that aren't active
+    // ------------------------------------------------------------------------------
+    GLint location(const std::string &name) const
+    {
+        if (!locations)
+            return glGetUniformLocation(ID, name.c_str());
+        auto found = locations->find(name);
+        return found != locations->end() ? found->second : -1;
+    }
+
+    // connects a uniform block of this program to a binding point (GLSL 330 has no binding layout)
+    // ---------------------------------------------------------------------------------------------
+    void bindUniformBlock(const char* name, unsigned int binding) const
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+
+    // reads a whole text file, prints and returns false if it can't be opened
+    // ------------------------------------------------------------------------
+    static bool readFile(const char* path, std::string& contents)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        contents = stream.str();
+        return true;
+    }
+
+    // compiles both stages and links them; the returned program is valid even on errors, which
+    // are printed, so rendering just shows nothing for it like learnopengl's Shader does
+    // ----------------------------------------------------------------------------------------
+    static unsigned int compileProgram(const std::string& vertexCode, const std::string& fragmentCode, bool retrievable = false)
+    {
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        // vertex shader
+        unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        // ask the driver to keep the binary around when the ShaderCache wants to store it
+        if (retrievable && glExt().programBinary)
+            glExt().ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        return program;
+    }
+
+    // a compute program (GL 4.3) from one source; errors are printed like compileProgram's
+    // ------------------------------------------------------------------------------------
+    static unsigned int compileComputeProgram(const std::string& computeCode)
+    {
+        const char* cShaderCode = computeCode.c_str();
+        unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(compute, 1, &cShaderCode, NULL);
+        glCompileShader(compute);
+        checkCompileErrors(compute, "COMPUTE");
+        unsigned int program = glCreateProgram();
+        glAttachShader(program, compute);
+        glLinkProgram(program);
+        checkCompileErrors(program, "PROGRAM");
+        glDeleteShader(compute);
+        return program;
+    }
+
+    static bool linked(unsigned int program)
+    {
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
+private:
+    std::shared_ptr<const std::unordered_map<std::string, GLint> > locations;
+
+    // every active uniform of the default block; arrays are reachable as "name" and "name[0]"
+    // ---------------------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        auto table = std::make_shared<std::unordered_map<std::string, GLint> >();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+            std::string uniform(name.c_str(), length);
+            GLint location = glGetUniformLocation(ID, uniform.c_str());
+            if (location < 0)
+                continue; // member of a uniform block
+            (*table)[uniform] = location;
+            size_t bracket = uniform.find('[');
+            if (bracket != std::string::npos)
+                (*table)[uniform.substr(0, bracket)] = location;
+        }
+        locations = table;
+    }
+
+    // utility function for checking shader compilation/linking errors.
+    // ------------------------------------------------------------------------
+    static void checkCompileErrors(GLuint shader, std::string type)
+    {
+        GLint success;
+        GLchar infoLog[1024];
+        if (type != "PROGRAM")
+        {
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+        else
+        {
+            glGetProgramiv(shader, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            }
+        }
+    }
+};
+
+#endif
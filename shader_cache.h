@@ -0,0 +1,195 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include "file_util.h"
+#include "gl_extensions.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// shares linked programs between identical (vertex source, fragment source, defines) triples and
+// persists them with glGetProgramBinary so a warm start links nothing at all.
+//
+// Binaries live in <directory>/<source hash>.bin and carry a hash of GL_VENDOR/GL_RENDERER/
+// GL_VERSION; a driver change, a rejected binary or a missing file falls back to compiling.
+// -----------------------------------------------------------------------------------------------
+class ShaderCache
+{
+public:
+    unsigned int compiled = 0;   // programs built from source
+    unsigned int fromDisk = 0;   // programs restored with glProgramBinary
+    unsigned int shared = 0;     // requests answered by an already loaded program
+
+    // an empty directory keeps the in-memory sharing but never touches the disk
+    void init(const std::string& cacheDirectory)
+    {
+        directory = cacheDirectory;
+        persistent = !directory.empty() && glExt().programBinary;
+        if (!directory.empty() && !glExt().programBinary)
+            std::cout << "Shader cache: program binaries not supported, caching in memory only" << std::endl;
+        if (persistent)
+            makeDirectory(directory);
+
+        std::string driver;
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (GLenum name : strings)
+        {
+            const char* value = (const char*)glGetString(name);
+            driver += value ? value : "";
+            driver += '\n';
+        }
+        driverHash = hashString(driver);
+    }
+
+    // defines are inserted as-is right after the #version line of both stages
+    Shader load(const char* vertexPath, const char* fragmentPath, const std::string& defines = "")
+    {
+        std::string vertexCode, fragmentCode;
+        Shader::readFile(vertexPath, vertexCode);
+        Shader::readFile(fragmentPath, fragmentCode);
+        vertexCode = injectDefines(vertexCode, defines);
+        fragmentCode = injectDefines(fragmentCode, defines);
+
+        uint64_t key = hashString(vertexCode + '\0' + fragmentCode);
+        auto found = programs.find(key);
+        if (found != programs.end())
+        {
+            shared++;
+            return found->second;
+        }
+
+        unsigned int program = 0;
+        if (persistent)
+            program = loadBinary(key);
+        if (program)
+            fromDisk++;
+        else
+        {
+            program = Shader::compileProgram(vertexCode, fragmentCode, persistent);
+            compiled++;
+            if (persistent && Shader::linked(program))
+                storeBinary(key, program);
+        }
+        Shader shader(program);
+        programs[key] = shader;
+        return shader;
+    }
+
+    void destroy()
+    {
+        for (auto& entry : programs)
+            glDeleteProgram(entry.second.ID);
+        programs.clear();
+    }
+
+    void report(std::ostream& out, double milliseconds) const
+    {
+        out << "shaders: " << programs.size() << " programs, " << compiled << " compiled, " << fromDisk
+            << " from disk, " << shared << " shared, " << milliseconds << " ms" << std::endl;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x43535950; // "PYSC"
+    static const uint32_t VERSION = 1;
+
+    struct BinaryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t driverHash;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    std::string directory;
+    bool persistent = false;
+    uint64_t driverHash = 0;
+    std::unordered_map<uint64_t, Shader> programs;
+
+    static std::string injectDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty())
+            return source;
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + "\n" + source;
+        return source.substr(0, lineEnd + 1) + defines + "\n" + source.substr(lineEnd + 1);
+    }
+
+    std::string binaryPath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return directory + "/" + name;
+    }
+
+    unsigned int loadBinary(uint64_t key) const
+    {
+        std::ifstream file(binaryPath(key).c_str(), std::ios::binary);
+        if (!file)
+            return 0;
+        BinaryHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || header.magic != MAGIC || header.version != VERSION ||
+            header.driverHash != driverHash || header.length == 0)
+            return 0;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), binary.size()))
+            return 0;
+
+        unsigned int program = glCreateProgram();
+        glExt().ProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        if (!Shader::linked(program))
+        {
+            // the driver may reject binaries at any time (e.g. after an update with the same version string)
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void storeBinary(uint64_t key, unsigned int program) const
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glExt().GetProgramBinary(program, length, NULL, &format, binary.data());
+
+        // write to a temporary name first so a concurrent or interrupted run never reads half a file
+        BinaryHeader header = { MAGIC, VERSION, driverHash, format, (uint32_t)length };
+        std::string path = binaryPath(key);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cout << "Shader cache: failed to write " << path << std::endl;
+                return;
+            }
+            file.write((const char*)&header, sizeof(header));
+            file.write(binary.data(), binary.size());
+            if (!file)
+            {
+                file.close();
+                std::remove(temporary.c_str());
+                std::cout << "Shader cache: failed to write " << path << std::endl;
+                return;
+            }
+        }
+        std::remove(path.c_str());
+        std::rename(temporary.c_str(), path.c_str());
+    }
+};
+
+#endif
@@ -2,10 +2,12 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+flat in float Layer;
 
-uniform sampler2D texture1;
+// one layer per material
+uniform sampler2DArray materials;
 
 void main()
 {    
-    FragColor = texture(texture1, TexCoords);
+    FragColor = texture(materials, vec3(TexCoords, Layer));
 }
\ No newline at end of file
@@ -1,15 +1,31 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
+layout (location = 2) in float aLayer;
 
 out vec2 TexCoords;
+flat out float Layer;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// written once per frame (UBO_BINDING_CAMERA)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// one record per draw (UBO_BINDING_DRAW); the scale/offset pairs undo the vertex
+// quantization (scale 1, offset 0 for float data), texCoordScaleOffset is xy = scale, zw = offset
+layout (std140) uniform Draw
+{
+    mat4 model;
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 texCoordScaleOffset;
+};
 
 void main()
 {
-    TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    TexCoords = aTexCoords * texCoordScaleOffset.xy + texCoordScaleOffset.zw;
+    Layer = aLayer;
+    gl_Position = projection * view * model * vec4(aPos * positionScale.xyz + positionOffset.xyz, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+// per instance (InstanceData): xyz position + yaw, xyz scale + material layer
+layout (location = 3) in vec4 aPositionYaw;
+layout (location = 4) in vec4 aScaleLayer;
+
+out vec2 TexCoords;
+flat out float Layer;
+
+// written once per frame (UBO_BINDING_CAMERA)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+void main()
+{
+    vec3 local = aPos * aScaleLayer.xyz;
+    float s = sin(aPositionYaw.w);
+    float c = cos(aPositionYaw.w);
+    vec3 world = vec3(c * local.x + s * local.z, local.y, c * local.z - s * local.x) + aPositionYaw.xyz;
+    TexCoords = aTexCoords;
+    Layer = aScaleLayer.w;
+    gl_Position = projection * view * vec4(world, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#version 430 core
+// frustum and Hi-Z occlusion culling of InstanceBatch instances: every invocation tests one
+// instance box and appends the survivors to their mesh's range of the visible buffer, counting
+// them in the instanceCount of the mesh's indirect draw command (reset to 0 before the dispatch)
+layout (local_size_x = 64) in;
+
+struct Bounds
+{
+    vec4 centerMesh;    // xyz: world-space box center, w: mesh id
+    vec4 extent;        // xyz: half size
+};
+
+struct Instance
+{
+    vec4 positionYaw;
+    vec4 scaleLayer;
+};
+
+layout (std430, binding = 0) readonly buffer BoundsBuffer { Bounds bounds[]; };
+layout (std430, binding = 1) readonly buffer InstanceBuffer { Instance instances[]; };
+layout (std430, binding = 2) writeonly buffer VisibleBuffer { Instance visible[]; };
+// DrawElementsIndirectCommand: count, instanceCount, firstIndex, baseVertex, baseInstance, one
+// per mesh, then the number of occluded instances
+layout (std430, binding = 3) buffer CommandBuffer { uint commands[]; };
+
+uniform vec4 planes[6];
+uniform uint objectCount;
+uniform uint occludedCounter;
+
+// occlusion: the HiZBuffer built from this frame's occluders, with the same camera
+uniform bool occlusion;
+uniform sampler2D hiz;
+uniform mat4 viewProjection;
+
+// true when the whole box is behind the farthest occluder depth over its screen rectangle
+bool occluded(vec3 center, vec3 extent)
+{
+    vec3 boxMin = vec3(1.0);
+    vec3 boxMax = vec3(-1.0);
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = center + extent * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        // crossing the camera plane: the projected rectangle means nothing, keep the box
+        if (clip.w <= 0.0)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        boxMin = min(boxMin, ndc);
+        boxMax = max(boxMax, ndc);
+    }
+
+    // the pixel rectangle, then the level where it spans at most 2x2 texels
+    ivec2 size = textureSize(hiz, 0);
+    ivec2 pixelMin = clamp(ivec2(floor((boxMin.xy * 0.5 + 0.5) * vec2(size))), ivec2(0), size - 1);
+    ivec2 pixelMax = clamp(ivec2(floor((boxMax.xy * 0.5 + 0.5) * vec2(size))), ivec2(0), size - 1);
+    ivec2 span = pixelMax - pixelMin + 1;
+    int level = min(int(ceil(log2(float(max(span.x, span.y))))), textureQueryLevels(hiz) - 1);
+    // computed rather than textureSize(hiz, level): llvmpipe answers that for the first
+    // invocation's level only
+    ivec2 levelSize = max(size >> ivec2(level), ivec2(1));
+    ivec2 texelMin = min(pixelMin >> ivec2(level), levelSize - 1);
+    ivec2 texelMax = min(pixelMax >> ivec2(level), levelSize - 1);
+
+    float farthest = 0.0;
+    for (int y = texelMin.y; y <= texelMax.y; y++)
+        for (int x = texelMin.x; x <= texelMax.x; x++)
+            farthest = max(farthest, texelFetch(hiz, ivec2(x, y), level).r);
+    return boxMin.z * 0.5 + 0.5 > farthest;
+}
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= objectCount)
+        return;
+
+    vec3 center = bounds[i].centerMesh.xyz;
+    vec3 extent = bounds[i].extent.xyz;
+    for (int p = 0; p < 6; p++)
+    {
+        if (dot(planes[p].xyz, center) + planes[p].w + dot(abs(planes[p].xyz), extent) < 0.0)
+            return;
+    }
+
+    if (occlusion && occluded(center, extent))
+    {
+        atomicAdd(commands[occludedCounter], 1u);
+        return;
+    }
+
+    uint command = uint(bounds[i].centerMesh.w) * 5u;
+    uint slot = atomicAdd(commands[command + 1u], 1u);
+    visible[commands[command + 4u] + slot] = instances[i];
+}
\ No newline at end of file
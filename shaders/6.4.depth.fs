@@ -0,0 +1,6 @@
+#version 330 core
+// depth-only pass (Hi-Z occluders): no color output, nothing to sample
+
+void main()
+{
+}
\ No newline at end of file
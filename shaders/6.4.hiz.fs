@@ -0,0 +1,16 @@
+#version 330 core
+// one level of the Hi-Z pyramid: the farthest depth of the texels it covers in the level above.
+// An odd source size gives the last row/column a third texel, so nothing is ever skipped.
+uniform sampler2D depth;   // base and max level set to the source level
+
+void main()
+{
+    ivec2 sourceSize = textureSize(depth, 0);
+    ivec2 source = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = min(source + 1 + (sourceSize & 1) * ivec2(greaterThanEqual(source + 3, sourceSize)), sourceSize - 1);
+    float farthest = 0.0;
+    for (int y = source.y; y <= last.y; y++)
+        for (int x = source.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(depth, ivec2(x, y), 0).r);
+    gl_FragDepth = farthest;
+}
\ No newline at end of file
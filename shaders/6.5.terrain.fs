@@ -0,0 +1,48 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+in vec2 World;
+flat in vec2 Layers;     // x: sand, y: slip faces
+in float Shade;
+
+// written once per frame (UBO_BINDING_TERRAIN), see TerrainBlock
+layout (std140) uniform Terrain
+{
+    vec4 cameraPosition;        // w: material layer
+    vec4 tiles;                 // x: terrain corner, y: level 0 tile size, z: quads per tile, w: level 0 tiles per side
+    vec4 heightRange;           // height = value * x + y, z: texture repeats per unit, w: patch grid
+    vec4 surface;               // x: slip-face material layer, y: texel in world units
+    vec4 morph[12];             // x: morph start distance, y: 1 / morph length
+};
+
+// one layer per material
+uniform sampler2DArray materials;
+
+// the splat maps of the resident tiles and the page table, as in the vertex shader
+uniform sampler2DArray splat;
+uniform usampler2D pageTable;
+
+vec3 tileCoords(vec2 xz)
+{
+    vec2 position = (xz - tiles.x) / tiles.y;
+    ivec2 page = clamp(ivec2(floor(position)), ivec2(0), ivec2(int(tiles.w) - 1));
+    uvec2 entry = texelFetch(pageTable, page, 0).rg;
+    float scale = float(1u << entry.y);
+    vec2 local = position / scale - vec2(page >> int(entry.y));
+    return vec3((local * tiles.z + 0.5) / (tiles.z + 1.0), float(entry.x));
+}
+
+void main()
+{
+    // the sand isn't made to tile: every other repeat is mirrored so the edges always meet their own
+    // pixels, the gradients of the unmirrored coordinates keep the mip selection smooth across the folds
+    vec2 mirrored = 1.0 - abs(mod(TexCoords, 2.0) - 1.0);
+    vec2 dx = dFdx(TexCoords), dy = dFdy(TexCoords);
+    vec3 color = textureGrad(materials, vec3(mirrored, Layers.x), dx, dy).rgb;
+    // the slip faces' material, per pixel so it follows the dunes rather than the patch triangles
+    float slipFace = textureLod(splat, tileCoords(World), 0.0).r;
+    if (slipFace > 0.0)
+        color = mix(color, textureGrad(materials, vec3(mirrored, Layers.y), dx, dy).rgb, slipFace);
+    FragColor = vec4(color * Shade, 1.0);
+}
@@ -0,0 +1,75 @@
+#version 330 core
+layout (location = 0) in vec2 aGrid;        // vertex of the shared patch, in quads (0..grid)
+layout (location = 1) in vec4 aPatch;       // per instance: xz origin, size, level
+
+out vec2 TexCoords;
+out vec2 World;
+flat out vec2 Layers;
+out float Shade;
+
+// written once per frame (UBO_BINDING_CAMERA)
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// written once per frame (UBO_BINDING_TERRAIN), see TerrainBlock
+layout (std140) uniform Terrain
+{
+    vec4 cameraPosition;        // w: material layer
+    vec4 tiles;                 // x: terrain corner, y: level 0 tile size, z: quads per tile, w: level 0 tiles per side
+    vec4 heightRange;           // height = value * x + y, z: texture repeats per unit, w: patch grid
+    vec4 surface;               // x: slip-face material layer, y: texel in world units
+    vec4 morph[12];             // x: morph start distance, y: 1 / morph length
+};
+
+// the resident tiles, one per layer (TileStreamer), and per level 0 tile the layer and level of
+// the finest resident tile covering it
+uniform sampler2DArray heights;
+uniform usampler2D pageTable;
+
+// towards the low sun of the skybox
+const vec3 sunDirection = vec3(-0.62, 0.55, -0.56);
+
+// where xz is in the resident tile covering it: uv of its samples, layer
+vec3 tileCoords(vec2 xz)
+{
+    vec2 position = (xz - tiles.x) / tiles.y;
+    ivec2 page = clamp(ivec2(floor(position)), ivec2(0), ivec2(int(tiles.w) - 1));
+    uvec2 entry = texelFetch(pageTable, page, 0).rg;
+    float scale = float(1u << entry.y);
+    vec2 local = position / scale - vec2(page >> int(entry.y));
+    return vec3((local * tiles.z + 0.5) / (tiles.z + 1.0), float(entry.x));
+}
+
+float heightAt(vec2 xz)
+{
+    return textureLod(heights, tileCoords(xz), 0.0).r * heightRange.x + heightRange.y;
+}
+
+void main()
+{
+    float grid = heightRange.w;
+    vec2 world = aPatch.xy + aGrid / grid * aPatch.z;
+    float distance = length(vec3(world.x, heightAt(world), world.y) - cameraPosition.xyz);
+
+    // towards the end of the level's range the odd vertices slide onto their even neighbours, until
+    // the patch is the next coarser level's grid
+    vec2 range = morph[int(aPatch.w)].xy;
+    float k = clamp((distance - range.x) * range.y, 0.0, 1.0);
+    vec2 odd = fract(aGrid * 0.5) * 2.0;
+    world = aPatch.xy + (aGrid - odd * k) / grid * aPatch.z;
+    float height = heightAt(world);
+
+    // normal from central differences; flat sand keeps the texture's own brightness
+    float e = surface.y;
+    vec3 normal = normalize(vec3(heightAt(world - vec2(e, 0.0)) - heightAt(world + vec2(e, 0.0)), 2.0 * e,
+                                 heightAt(world - vec2(0.0, e)) - heightAt(world + vec2(0.0, e))));
+    Shade = 0.45 + 0.55 * max(dot(normal, sunDirection), 0.0) / sunDirection.y;
+
+    TexCoords = world * heightRange.z;
+    World = world;
+    Layers = vec2(cameraPosition.w, surface.x);
+    gl_Position = projection * view * vec4(world.x, height, world.y, 1.0);
+}
@@ -0,0 +1,46 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// x86 SIMD support shared by the CPU kernels: SSE2 is used whenever the compiler targets it (always
+// on x86-64), AVX2 functions are compiled with PYRAMID_TARGET_AVX2 and only called after
+// cpuHasAVX2() said so, so the binary still runs on older CPUs
+// ----------------------------------------------------------------------------------------------
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PYRAMID_SSE2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define PYRAMID_TARGET_AVX2
+#else
+#define PYRAMID_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+inline bool cpuHasAVX2()
+{
+#ifdef PYRAMID_SSE2
+#ifdef _MSC_VER
+    static const bool avx2 = []()
+    {
+        // AVX2 in leaf 7, and OSXSAVE plus XCR0 bits 1-2: the OS saves the YMM registers, else any
+        // AVX instruction faults
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+#else
+    static const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include "mesh_optimizer.h"
+#include "render_queue.h"
+#include "uniform_buffer.h"
+#include "vertex_format.h"
+
+#include <cstdint>
+#include <vector>
+
+// one mesh inside the shared buffers: its vertices start at baseVertex inside its format group,
+// its indices (local to the mesh) at firstIndex
+struct MeshRange
+{
+    GLint baseVertex;
+    unsigned int firstIndex;
+    GLsizei indexCount;
+    unsigned int vertexCount;
+    unsigned int material;
+    unsigned int group;
+    QuantizationError error;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
+
+// packs every static mesh into one VBO and one index buffer, so the opaque scene is drawn from
+// one VAO per vertex format; the RenderQueue merges the meshes that share a format group (and
+// GPU timer pass) into one glMultiDrawElementsBaseVertex.
+// Indices are stored per mesh relative to baseVertex, which keeps them 16-bit until a single
+// mesh grows past 65535 vertices.
+//
+// Every mesh picks its own VertexFormat. Meshes sharing a format form a group: one contiguous
+// region of the VBO with its own VAO and dequantization range (the AABB/UV range of the whole
+// group), so a material costs one multi-draw per format group it uses. The group's model matrix
+// and dequantization range live in a DrawBlock record that drawItem() selects with one range bind.
+//
+// A mesh's material is also its layer in the material texture array: every vertex carries it as
+// one unsigned byte (attribute 2, a separate stream after each group's vertices), so meshes with
+// different materials need neither a texture bind nor a uniform change between them.
+//
+// build() encodes the meshes and uploads the result; load() uploads a batch encoded earlier (a
+// SceneFile's, straight from the mapping) without the source meshes.
+// ---------------------------------------------------------------------------------------------
+class StaticBatch
+{
+public:
+    static const unsigned int FLOATS_PER_VERTEX = 5;
+
+    // a format group as a scene file stores it: how to dequantize it, where its vertices and its
+    // material layers start in the vertex data
+    struct GroupRecord
+    {
+        VertexFormat format;
+        QuantizationRange range;
+        uint64_t byteOffset;
+        uint64_t layerOffset;
+    };
+
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+
+    // copies the mesh (5 floats per vertex) into the batch and returns the mesh id; call before build().
+    // material (0-255) is the layer the fragment shader samples
+    unsigned int addMesh(const IndexedMesh& mesh, unsigned int material, const VertexFormat& format = VertexFormat())
+    {
+        MeshRange range;
+        range.baseVertex = 0;
+        range.firstIndex = (unsigned int)indices.size();
+        range.indexCount = (GLsizei)mesh.indices.size();
+        range.vertexCount = (unsigned int)mesh.vertexCount();
+        range.material = material;
+        range.group = findGroup(format);
+        range.boundsMin = glm::vec3(0.0f);
+        range.boundsMax = glm::vec3(0.0f);
+        for (size_t v = 0; v < mesh.vertexCount(); v++)
+        {
+            const float* p = &mesh.vertices[v * mesh.floatsPerVertex];
+            glm::vec3 position(p[0], p[1], p[2]);
+            range.boundsMin = v == 0 ? position : glm::min(range.boundsMin, position);
+            range.boundsMax = v == 0 ? position : glm::max(range.boundsMax, position);
+        }
+        sources.push_back(mesh.vertices);
+        indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        meshes.push_back(range);
+        return (unsigned int)meshes.size() - 1;
+    }
+
+    // encodes every group and uploads everything once; keepEncoded keeps the encoded data for
+    // encodedVertices() / encodedIndices() (to write a scene file)
+    void build(bool keepEncoded = false)
+    {
+        indexType = GL_UNSIGNED_SHORT;
+        for (const MeshRange& mesh : meshes)
+            if (mesh.vertexCount > 0xFFFF)
+                indexType = GL_UNSIGNED_INT;
+        indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        std::vector<unsigned char>& data = vertexData;
+        data.clear();
+        vertexCount = 0;
+        for (unsigned int g = 0; g < groups.size(); g++)
+        {
+            Group& group = groups[g];
+            std::vector<float> groupVertices;
+            for (unsigned int id = 0; id < meshes.size(); id++)
+            {
+                if (meshes[id].group != g)
+                    continue;
+                meshes[id].baseVertex = (GLint)(groupVertices.size() / FLOATS_PER_VERTEX);
+                groupVertices.insert(groupVertices.end(), sources[id].begin(), sources[id].end());
+            }
+            size_t groupVertexCount = groupVertices.size() / FLOATS_PER_VERTEX;
+            group.range = computeQuantizationRange(group.format, groupVertices.data(), groupVertexCount, FLOATS_PER_VERTEX);
+
+            // every stride is a multiple of 4, so groups stay aligned back to back
+            group.byteOffset = data.size();
+            unsigned int stride = group.format.stride();
+            data.resize(data.size() + groupVertexCount * stride);
+            for (size_t v = 0; v < groupVertexCount; v++)
+                encodeVertex(group.format, group.range, &groupVertices[v * FLOATS_PER_VERTEX], &data[group.byteOffset + v * stride]);
+            vertexCount += (unsigned int)groupVertexCount;
+
+            // material layer stream, padded so the next group stays 4-byte aligned
+            group.layerOffset = data.size();
+            for (unsigned int id = 0; id < meshes.size(); id++)
+                if (meshes[id].group == g)
+                    data.insert(data.end(), meshes[id].vertexCount, (unsigned char)meshes[id].material);
+            data.resize((data.size() + 3) & ~(size_t)3);
+        }
+        for (unsigned int id = 0; id < meshes.size(); id++)
+        {
+            const Group& group = groups[meshes[id].group];
+            meshes[id].error = measureQuantizationError(group.format, group.range, sources[id].data(), meshes[id].vertexCount, FLOATS_PER_VERTEX);
+        }
+
+        indexData.resize(indices.size() * indexSize);
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+            if (indexType == GL_UNSIGNED_SHORT)
+                ((uint16_t*)indexData.data())[i] = (uint16_t)indices[i];
+            else
+                ((uint32_t*)indexData.data())[i] = indices[i];
+        }
+        upload(vertexData.data(), vertexData.size(), indexData.data(), indexData.size());
+
+        sources.clear();
+        sources.shrink_to_fit();
+        indices.clear();
+        indices.shrink_to_fit();
+        if (!keepEncoded)
+            releaseEncoded();
+    }
+
+    // a batch build() encoded earlier: vertex and index bytes go to glBufferData as they are (they
+    // may point into a mapped scene file), the mesh and group tables are copied
+    void load(const MeshRange* meshRanges, size_t meshCount, const GroupRecord* groupRecords, size_t groupCount,
+              const void* vertices, size_t vertexByteCount, const void* indexBytes, size_t indexByteCount, GLenum indexFormat)
+    {
+        meshes.assign(meshRanges, meshRanges + meshCount);
+        groups.clear();
+        for (size_t g = 0; g < groupCount; g++)
+        {
+            Group group;
+            group.format = groupRecords[g].format;
+            group.range = groupRecords[g].range;
+            group.byteOffset = (size_t)groupRecords[g].byteOffset;
+            group.layerOffset = (size_t)groupRecords[g].layerOffset;
+            groups.push_back(group);
+        }
+        indexType = indexFormat;
+        indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        vertexCount = 0;
+        for (const MeshRange& mesh : meshes)
+            vertexCount += mesh.vertexCount;
+        upload(vertices, vertexByteCount, indexBytes, indexByteCount);
+    }
+
+    // the group table as load() takes it
+    std::vector<GroupRecord> groupRecords() const
+    {
+        std::vector<GroupRecord> records;
+        for (const Group& group : groups)
+            records.push_back({ group.format, group.range, (uint64_t)group.byteOffset, (uint64_t)group.layerOffset });
+        return records;
+    }
+
+    // what build(true) uploaded, until releaseEncoded()
+    const std::vector<unsigned char>& encodedVertices() const { return vertexData; }
+    const std::vector<unsigned char>& encodedIndices() const { return indexData; }
+
+    void releaseEncoded()
+    {
+        vertexData.clear();
+        vertexData.shrink_to_fit();
+        indexData.clear();
+        indexData.shrink_to_fit();
+    }
+
+    // the geometry half of a queue item for one mesh: VAO, draw block and index range. The caller
+    // fills in pass, program and texture; the program needs the "Draw" block.
+    DrawItem drawItem(unsigned int id) const
+    {
+        const MeshRange& mesh = meshes[id];
+        const Group& group = groups[mesh.group];
+        DrawItem item;
+        item.VAO = group.VAO;
+        item.drawBlocks = &drawBlocks;
+        item.drawBlock = group.drawBlock;
+        item.center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+        item.mode = GL_TRIANGLES;
+        item.indexType = indexType;
+        item.count = mesh.indexCount;
+        item.indexOffset = (const void*)(mesh.firstIndex * indexSize);
+        item.baseVertex = mesh.baseVertex;
+        return item;
+    }
+
+    void destroy()
+    {
+        for (Group& group : groups)
+        {
+            glDeleteVertexArrays(1, &group.VAO);
+            group.VAO = 0;
+        }
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VBO = EBO = 0;
+        drawBlocks.destroy();
+    }
+
+    const MeshRange& mesh(unsigned int id) const { return meshes[id]; }
+    const VertexFormat& meshFormat(unsigned int id) const { return groups[meshes[id].group].format; }
+    unsigned int meshCount() const { return (unsigned int)meshes.size(); }
+    unsigned int groupCount() const { return (unsigned int)groups.size(); }
+    unsigned int totalVertices() const { return vertexCount; }
+    unsigned int totalVertexBytes() const { return vertexBytes; }
+    unsigned int totalIndices() const { return indexCount; }
+    GLenum indexFormat() const { return indexType; }
+
+private:
+    struct Group
+    {
+        VertexFormat format;
+        QuantizationRange range;
+        unsigned int VAO = 0;
+        size_t byteOffset = 0;
+        size_t layerOffset = 0;
+        unsigned int drawBlock = 0;
+    };
+
+    std::vector<std::vector<float> > sources;
+    std::vector<unsigned int> indices;
+    std::vector<unsigned char> vertexData;      // encoded, kept by build(true)
+    std::vector<unsigned char> indexData;
+    std::vector<MeshRange> meshes;
+    std::vector<Group> groups;
+    DrawBlockBuffer drawBlocks;
+    GLenum indexType = GL_UNSIGNED_SHORT;
+    size_t indexSize = sizeof(uint16_t);
+    unsigned int vertexCount = 0;
+    unsigned int vertexBytes = 0;
+    unsigned int indexCount = 0;
+
+    // buffers, one VAO per group, draw blocks
+    void upload(const void* vertices, size_t vertexByteCount, const void* indexBytes, size_t indexByteCount)
+    {
+        glGenBuffers(1, &VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexByteCount, vertices, GL_STATIC_DRAW);
+
+        // the index buffer is shared by every group's VAO, upload it through a non-VAO target
+        glGenBuffers(1, &EBO);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexByteCount, indexBytes, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        for (Group& group : groups)
+        {
+            glGenVertexArrays(1, &group.VAO);
+            glBindVertexArray(group.VAO);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            setupVertexAttributes(group.format, group.byteOffset);
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 1, GL_UNSIGNED_BYTE, GL_FALSE, 1, (void*)group.layerOffset);
+        }
+        glBindVertexArray(0);
+
+        for (Group& group : groups)
+        {
+            DrawBlock block;
+            block.model = glm::mat4(1.0f);
+            block.positionScale = glm::vec4(group.range.positionScale, 0.0f);
+            block.positionOffset = glm::vec4(group.range.positionOffset, 0.0f);
+            block.texCoordScaleOffset = glm::vec4(group.range.texCoordScale, group.range.texCoordOffset);
+            group.drawBlock = drawBlocks.add(block);
+        }
+        drawBlocks.build();
+
+        vertexBytes = (unsigned int)vertexByteCount;
+        indexCount = (unsigned int)(indexByteCount / indexSize);
+    }
+
+    unsigned int findGroup(const VertexFormat& format)
+    {
+        for (unsigned int g = 0; g < groups.size(); g++)
+            if (groups[g].format == format)
+                return g;
+        Group group;
+        group.format = format;
+        groups.push_back(group);
+        return (unsigned int)groups.size() - 1;
+    }
+};
+
+#endif
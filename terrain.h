@@ -0,0 +1,364 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "dune_field.h"
+#include "frustum_culler.h"
+#include "mesh_optimizer.h"
+#include "render_queue.h"
+#include "ring_buffer.h"
+#include "thread_pool.h"
+#include "tile_store.h"
+#include "tile_streamer.h"
+#include "uniform_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const unsigned int TERRAIN_MAX_LEVELS = 12;
+
+// std140 "Terrain" block of shaders/6.5.terrain.vs (UBO_BINDING_TERRAIN), written once per frame
+struct TerrainBlock
+{
+    glm::vec4 cameraPosition;               // xyz, w: material layer
+    glm::vec4 tiles;                        // x: terrain corner, y: level 0 tile size, z: quads per tile, w: level 0 tiles per side
+    glm::vec4 heightRange;                  // height = texel value * x + y, z: texture repeats per unit, w: patch grid
+    glm::vec4 surface;                      // x: slip-face material layer, y: heightmap texel in world units
+    glm::vec4 morph[TERRAIN_MAX_LEVELS];    // per level, x: distance the morph starts at, y: 1 / its length
+};
+
+// heightmap terrain drawn with CDLOD (continuous distance-dependent level of detail, Strugar 2010).
+//
+// The terrain is a square quadtree: the root covers it all, each level down halves the node size,
+// leaves are LEAF_SIZE units wide, and a node at any level is drawn with the same number of
+// vertices, so every level has twice the vertex spacing of the one below. Each level has a range,
+// twice that of the level below; every frame the tree is walked from the root and a node is drawn
+// at its level where the camera is within its range but not within the next finer one. Nodes are
+// drawn a quarter at a time, so a node whose children are partly in range draws only the quarters
+// the children don't.
+//
+// Every quarter is an instance of one shared PATCH_GRID x PATCH_GRID grid mesh (origin, size and
+// level per instance), all of them one instanced draw. The vertex shader samples the height from
+// the streamed tiles, and over the last third of a level's range morphs the odd grid vertices onto
+// their even neighbours so a level has become the next coarser one where the two meet: no cracks
+// and no popping. The selected quarters are bounded by the ranges, not by the terrain's size, so
+// a larger terrain only adds a level.
+//
+// The heightmap and splat map live in a TileStore on disk; only the tiles near the camera are on
+// the GPU, paged in by a TileStreamer (the vertex shader finds them through its page table, falling
+// back to a coarser tile while a finer one is on its way). Node bounds for the range and frustum
+// tests come from a min/max tree over the store's leaf bounds.
+// ------------------------------------------------------------------------------------------------
+class Terrain
+{
+public:
+    static const unsigned int PATCH_GRID = 8;          // quads along a patch edge, a node is two patches wide
+    static const unsigned int HEIGHT_UNIT = 1;         // texture units the streamed tiles stay bound to
+    static const unsigned int SPLAT_UNIT = 2;
+    static const unsigned int PAGE_UNIT = 3;
+    static constexpr float LEAF_SIZE = 32.0f;
+    static constexpr float LEAF_RANGE = 80.0f;         // range of level 0, doubled every level up
+    static constexpr float MORPH_START = 0.66f;        // morph over the last third of a level's range
+    static constexpr float TEXEL_SIZE = 4.0f;          // heightmap spacing in world units (as long as it fits MAX_RESOLUTION)
+    static const unsigned int MAX_RESOLUTION = 4097;
+
+    unsigned int VAO = 0;
+
+    // opens (baking it on first use) the tile store of the field in cacheDirectory, centred on the
+    // origin, starts streaming it within budgetBytes of GPU memory and builds the quadtree; size is
+    // rounded up to LEAF_SIZE times a power of two. The bake is spread over pool when given.
+    bool init(const DuneField& field, float size, const std::string& cacheDirectory, size_t budgetBytes, float materialLayer,
+              float slipFaceLayer, float textureRepeat, ThreadPool* pool = NULL)
+    {
+        levels = 1;
+        while (LEAF_SIZE * (float)(1u << (levels - 1)) < size && levels < TERRAIN_MAX_LEVELS)
+            levels++;
+        worldSize = LEAF_SIZE * (float)(1u << (levels - 1));
+        origin = -0.5f * worldSize;
+        float texel = worldSize / std::min((unsigned int)(worldSize / TEXEL_SIZE), MAX_RESOLUTION - 1);
+        if (!store.open(cacheDirectory, field, worldSize, texel, LEAF_SIZE, pool))
+            return false;
+        buildBoundsTree();
+
+        // a level 0 tile is fine enough as long as the vertex spacing is no finer than its texel
+        float vertexSpacing = LEAF_SIZE / (2 * PATCH_GRID);
+        texel = worldSize / (store.tilesPerSide(0) * store.tileQuads());
+        streamer.init(store, budgetBytes, LEAF_RANGE * std::max(texel / vertexSpacing, 1.0f), HEIGHT_UNIT, SPLAT_UNIT, PAGE_UNIT);
+
+        // the patch: (PATCH_GRID + 1)^2 grid coordinates, counted in quads so the shader's morph is exact
+        std::vector<float> grid;
+        for (unsigned int j = 0; j <= PATCH_GRID; j++)
+            for (unsigned int i = 0; i <= PATCH_GRID; i++)
+            {
+                grid.push_back((float)i);
+                grid.push_back((float)j);
+            }
+        std::vector<unsigned int> indices;
+        for (unsigned int j = 0; j < PATCH_GRID; j++)
+            for (unsigned int i = 0; i < PATCH_GRID; i++)
+            {
+                unsigned int a = j * (PATCH_GRID + 1) + i, b = a + 1, c = a + PATCH_GRID + 1, d = c + 1;
+                unsigned int quad[6] = { a, c, d, a, d, b };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        optimizeVertexCache(indices, grid.size() / 2);
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        indexCount = (GLsizei)shortIndices.size();
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &patchVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(float), grid.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, patchVBO);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // per-level morph ranges and the constant part of the block
+        float previous = 0.0f;
+        for (unsigned int level = 0; level < levels; level++)
+        {
+            ranges[level] = LEAF_RANGE * (float)(1u << level);
+            float start = previous + (ranges[level] - previous) * MORPH_START;
+            block.morph[level] = glm::vec4(start, 1.0f / (ranges[level] - start), 0.0f, 0.0f);
+            previous = ranges[level];
+        }
+        block.cameraPosition = glm::vec4(0.0f, 0.0f, 0.0f, materialLayer);
+        block.tiles = glm::vec4(origin, store.tileSize(0), (float)store.tileQuads(), (float)store.tilesPerSide(0));
+        block.heightRange = glm::vec4(store.maxHeight() - store.minHeight(), store.minHeight(), textureRepeat, (float)PATCH_GRID);
+        block.surface = glm::vec4(slipFaceLayer, texel, 0.0f, 0.0f);
+        terrainBuffer.create(sizeof(TerrainBlock), UBO_BINDING_TERRAIN);
+
+        std::cout << "terrain: " << worldSize << " units, " << levels << " levels, " << texel << " units/texel, heights "
+                  << store.minHeight() << ".." << store.maxHeight() << std::endl;
+        return true;
+    }
+
+    // picks this frame's patches and uploads them with the camera position (into the ring's current
+    // region when given and they fit), streams the tiles around where the camera is and is heading
+    void update(const glm::vec3& cameraPosition, const Frustum& frustum, RingBuffer* ring = NULL)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (frames > 0)
+        {
+            std::chrono::duration<float> elapsed = now - lastUpdate;
+            if (elapsed.count() > 0.0f)
+                velocity = glm::mix(velocity, (cameraPosition - camera) / elapsed.count(), 0.25f);
+        }
+        lastUpdate = now;
+        streamer.update(cameraPosition, velocity);
+
+        auto selectBegin = std::chrono::steady_clock::now();
+        camera = cameraPosition;
+        patches.clear();
+        selectNode(frustum, levels - 1, 0, 0);
+        std::chrono::duration<double, std::milli> selectTime = std::chrono::steady_clock::now() - selectBegin;
+
+        block.cameraPosition = glm::vec4(cameraPosition, block.cameraPosition.w);
+        GLintptr ringOffset = ring && !patches.empty() ? ring->write(patches.data(), patches.size() * sizeof(glm::vec4)) : -1;
+        if (ringOffset >= 0)
+            pointPatches(ring->buffer, ringOffset);
+        else
+        {
+            pointPatches(patchVBO, 0);
+            glBindBuffer(GL_ARRAY_BUFFER, patchVBO);
+            glBufferData(GL_ARRAY_BUFFER, patches.size() * sizeof(glm::vec4), patches.data(), GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        if (!ring || !ring->bindUniform(UBO_BINDING_TERRAIN, &block, sizeof(block)))
+        {
+            glBindBufferBase(GL_UNIFORM_BUFFER, UBO_BINDING_TERRAIN, terrainBuffer.UBO);
+            terrainBuffer.update(&block, sizeof(block));
+        }
+
+        unsigned long long triangles = (unsigned long long)patches.size() * PATCH_GRID * PATCH_GRID * 2;
+        frames++;
+        totalPatches += patches.size();
+        totalTriangles += triangles;
+        maxTriangles = std::max(maxTriangles, triangles);
+        totalSelectTime += selectTime.count();
+    }
+
+    // this frame's patches as one instanced draw (nothing to draw when patchCount() is 0)
+    DrawItem drawItem() const
+    {
+        DrawItem item;
+        item.VAO = VAO;
+        item.indexType = GL_UNSIGNED_SHORT;
+        item.count = indexCount;
+        item.instanceCount = (GLsizei)patches.size();
+        item.center = camera;
+        return item;
+    }
+
+    // blocks until the tiles around the camera are resident (benchmark warmup)
+    void finishStreaming(const glm::vec3& cameraPosition)
+    {
+        streamer.finish(cameraPosition);
+    }
+
+    // tiles still arriving around the camera (the picture sharpens without the camera moving)
+    bool streaming() const { return streamer.streaming(); }
+
+    unsigned int patchCount() const { return (unsigned int)patches.size(); }
+    unsigned int levelCount() const { return levels; }
+
+    // nothing is drawn farther out than the coarsest level's range or the terrain's far corner
+    float viewDistance() const
+    {
+        return std::min(ranges[levels - 1], worldSize * 1.5f);
+    }
+
+    void report(std::ostream& out) const
+    {
+        if (frames == 0)
+            return;
+        out << "terrain: " << (double)totalPatches / frames << " patches, " << totalTriangles / frames << " triangles per frame (max "
+            << maxTriangles << "), selection " << totalSelectTime / frames << " ms avg" << std::endl;
+        streamer.report(out);
+    }
+
+    void destroy()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &patchVBO);
+        streamer.destroy();
+        store.close();
+        terrainBuffer.destroy();
+        VAO = VBO = EBO = patchVBO = 0;
+    }
+
+private:
+    unsigned int VBO = 0;
+    unsigned int EBO = 0;
+    unsigned int patchVBO = 0;
+    GLsizei indexCount = 0;
+
+    TileStore store;
+    TileStreamer streamer;
+    unsigned int levels = 0;
+    float worldSize = 0.0f;
+    float origin = 0.0f;
+    float ranges[TERRAIN_MAX_LEVELS] = {};
+    std::vector<glm::vec2> bounds[TERRAIN_MAX_LEVELS];  // min/max height per node, row-major per level
+
+    TerrainBlock block;
+    UniformBuffer terrainBuffer;
+    glm::vec3 camera = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);              // smoothed, for the streamer's lookahead
+    std::chrono::steady_clock::time_point lastUpdate;
+    std::vector<glm::vec4> patches;                     // xz origin, size, level
+
+    unsigned long long frames = 0;
+    unsigned long long totalPatches = 0;
+    unsigned long long totalTriangles = 0;
+    unsigned long long maxTriangles = 0;
+    double totalSelectTime = 0.0;
+
+    unsigned int nodesPerSide(unsigned int level) const { return 1u << (levels - 1 - level); }
+    float nodeSize(unsigned int level) const { return LEAF_SIZE * (float)(1u << level); }
+
+    // points the per-patch attribute at wherever this frame's patches are
+    void pointPatches(unsigned int buffer, GLintptr offset)
+    {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)offset);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // leaves straight from the store (baked from the samples they span, as filtered by the GPU, so
+    // no vertex leaves that range), the levels above from their children
+    void buildBoundsTree()
+    {
+        bounds[0] = store.leaves();
+        for (unsigned int level = 1; level < levels; level++)
+        {
+            unsigned int n = nodesPerSide(level);
+            const std::vector<glm::vec2>& children = bounds[level - 1];
+            bounds[level].assign(n * n, glm::vec2(0.0f));
+            for (unsigned int z = 0; z < n; z++)
+                for (unsigned int x = 0; x < n; x++)
+                {
+                    glm::vec2 b = children[(z * 2) * n * 2 + x * 2];
+                    for (unsigned int child = 1; child < 4; child++)
+                    {
+                        glm::vec2 c = children[(z * 2 + (child >> 1)) * n * 2 + x * 2 + (child & 1)];
+                        b = glm::vec2(std::min(b.x, c.x), std::max(b.y, c.y));
+                    }
+                    bounds[level][z * n + x] = b;
+                }
+        }
+    }
+
+    AABB nodeBox(unsigned int level, unsigned int x, unsigned int z) const
+    {
+        float size = nodeSize(level);
+        glm::vec2 heights = bounds[level][z * nodesPerSide(level) + x];
+        AABB box;
+        box.min = glm::vec3(origin + x * size, heights.x, origin + z * size);
+        box.max = glm::vec3(box.min.x + size, heights.y, box.min.z + size);
+        return box;
+    }
+
+    bool inRange(const AABB& box, float range) const
+    {
+        glm::vec3 nearest = glm::clamp(camera, box.min, box.max);
+        glm::vec3 d = nearest - camera;
+        return glm::dot(d, d) <= range * range;
+    }
+
+    // quarter (0..3, x then z) of a node, drawn at the node's level
+    void addQuarter(const Frustum& frustum, unsigned int level, const AABB& node, unsigned int quarter)
+    {
+        float half = nodeSize(level) * 0.5f;
+        AABB box = node;
+        box.min.x += (quarter & 1) * half;
+        box.min.z += (quarter >> 1) * half;
+        box.max.x = box.min.x + half;
+        box.max.z = box.min.z + half;
+        if (frustum.intersects(box))
+            patches.push_back(glm::vec4(box.min.x, box.min.z, half, (float)level));
+    }
+
+    // false when the node is beyond its level's range, its parent then covers the area
+    bool selectNode(const Frustum& frustum, unsigned int level, unsigned int x, unsigned int z)
+    {
+        AABB box = nodeBox(level, x, z);
+        if (!inRange(box, ranges[level]))
+            return false;
+        if (!frustum.intersects(box))
+            return true;
+        if (level == 0 || !inRange(box, ranges[level - 1]))
+        {
+            for (unsigned int quarter = 0; quarter < 4; quarter++)
+                addQuarter(frustum, level, box, quarter);
+            return true;
+        }
+        for (unsigned int child = 0; child < 4; child++)
+            if (!selectNode(frustum, level - 1, x * 2 + (child & 1), z * 2 + (child >> 1)))
+                addQuarter(frustum, level, box, child);
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,493 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <glad/glad.h>
+
+#include "file_util.h"
+#include "gl_extensions.h"
+#include "mip_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// a GPU-ready texture: BC1 (opaque) or BC3 (with alpha) blocks for every mip level, either
+// encoded in memory or read straight out of a memory-mapped cache file
+struct CookedTexture
+{
+    GLenum format = 0;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    float psnr = 0.0f;                          // level 0 against the source image, RGB only
+    std::vector<const unsigned char*> levels;
+    std::vector<uint32_t> levelSizes;
+
+    std::vector<unsigned char> storage;         // owns the blocks after cooking
+    MappedFile file;                            // or maps them from disk
+
+    size_t totalSize() const
+    {
+        size_t total = 0;
+        for (uint32_t size : levelSizes)
+            total += size;
+        return total;
+    }
+};
+
+// BC1 / BC3 block encoder
+// -----------------------
+namespace bc
+{
+    inline uint16_t packRGB565(const float color[3])
+    {
+        int r = (int)std::lround(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f);
+        int g = (int)std::lround(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f);
+        int b = (int)std::lround(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRGB565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // the four-colour palette of a block whose first endpoint is the larger one
+    inline void palette(uint16_t c0, uint16_t c1, int colors[4][3])
+    {
+        unpackRGB565(c0, colors[0]);
+        unpackRGB565(c1, colors[1]);
+        for (int k = 0; k < 3; k++)
+        {
+            colors[2][k] = (2 * colors[0][k] + colors[1][k]) / 3;
+            colors[3][k] = (colors[0][k] + 2 * colors[1][k]) / 3;
+        }
+    }
+
+    // picks the closest palette entry per pixel, returns the squared error
+    inline int selectIndices(const unsigned char rgba[64], uint16_t c0, uint16_t c1, uint32_t& indices)
+    {
+        int colors[4][3];
+        palette(c0, c1, colors);
+        indices = 0;
+        int error = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = rgba[i * 4] - colors[p][0], dg = rgba[i * 4 + 1] - colors[p][1], db = rgba[i * 4 + 2] - colors[p][2];
+                int e = dr * dr + dg * dg + db * db;
+                if (e < bestError)
+                {
+                    bestError = e;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t)best << (2 * i);
+            error += bestError;
+        }
+        return error;
+    }
+
+    // endpoints minimising the squared error for fixed indices (2x2 normal equations per channel)
+    inline bool refineEndpoints(const unsigned char rgba[64], uint32_t indices, float end0[3], float end1[3])
+    {
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = {}, bx[3] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float a = weights[(indices >> (2 * i)) & 3], b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int k = 0; k < 3; k++)
+            {
+                ax[k] += a * rgba[i * 4 + k];
+                bx[k] += b * rgba[i * 4 + k];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (std::fabs(det) < 1e-6f)
+            return false;
+        for (int k = 0; k < 3; k++)
+        {
+            end0[k] = (ax[k] * bb - bx[k] * ab) / det;
+            end1[k] = (bx[k] * aa - ax[k] * ab) / det;
+        }
+        return true;
+    }
+
+    // writes c0 > c1 so the block is decoded in four-colour mode (also what BC3 assumes)
+    inline void writeColorBlock(uint16_t c0, uint16_t c1, uint32_t indices, unsigned char out[8])
+    {
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+            indices ^= 0x55555555; // 0<->1, 2<->3
+        }
+        else if (c0 == c1)
+            indices = 0;
+        out[0] = (unsigned char)(c0 & 0xFF);
+        out[1] = (unsigned char)(c0 >> 8);
+        out[2] = (unsigned char)(c1 & 0xFF);
+        out[3] = (unsigned char)(c1 >> 8);
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (unsigned char)(indices >> (8 * i));
+    }
+
+    // endpoints along the principal axis of the block's colours, then one least-squares refinement
+    inline void encodeColorBlock(const unsigned char rgba[64], unsigned char out[8])
+    {
+        float mean[3] = {};
+        for (int i = 0; i < 16; i++)
+            for (int k = 0; k < 3; k++)
+                mean[k] += rgba[i * 4 + k] / 16.0f;
+        float cov[6] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float r = rgba[i * 4] - mean[0], g = rgba[i * 4 + 1] - mean[1], b = rgba[i * 4 + 2] - mean[2];
+            cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+            cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+        }
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if (length < 1e-6f)
+                break;
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+        float minDot = 1e30f, maxDot = -1e30f;
+        for (int i = 0; i < 16; i++)
+        {
+            float d = 0.0f;
+            for (int k = 0; k < 3; k++)
+                d += (rgba[i * 4 + k] - mean[k]) * axis[k];
+            minDot = std::min(minDot, d);
+            maxDot = std::max(maxDot, d);
+        }
+        float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        float end0[3], end1[3];
+        for (int k = 0; k < 3; k++)
+        {
+            end0[k] = mean[k] + axis[k] * maxDot / std::max(axisLength2, 1e-6f);
+            end1[k] = mean[k] + axis[k] * minDot / std::max(axisLength2, 1e-6f);
+        }
+
+        uint16_t c0 = packRGB565(end0), c1 = packRGB565(end1);
+        if (c0 < c1)
+            std::swap(c0, c1);
+        uint32_t indices;
+        int error = selectIndices(rgba, c0, c1, indices);
+        if (error > 0 && c0 != c1 && refineEndpoints(rgba, indices, end0, end1))
+        {
+            uint16_t r0 = packRGB565(end0), r1 = packRGB565(end1);
+            if (r0 < r1)
+                std::swap(r0, r1);
+            uint32_t refined;
+            if (r0 != r1 && selectIndices(rgba, r0, r1, refined) < error)
+            {
+                c0 = r0;
+                c1 = r1;
+                indices = refined;
+            }
+        }
+        writeColorBlock(c0, c1, indices, out);
+    }
+
+    // BC3 alpha: eight interpolated values between the block's max and min alpha
+    inline void encodeAlphaBlock(const unsigned char rgba[64], unsigned char out[8])
+    {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            a0 = std::max(a0, (int)rgba[i * 4 + 3]);
+            a1 = std::min(a1, (int)rgba[i * 4 + 3]);
+        }
+        out[0] = (unsigned char)a0;
+        out[1] = (unsigned char)a1;
+        uint64_t bits = 0;
+        if (a0 > a1)
+        {
+            int values[8] = { a0, a1 };
+            for (int v = 1; v < 7; v++)
+                values[v + 1] = ((7 - v) * a0 + v * a1) / 7;
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, bestError = 1 << 30;
+                for (int v = 0; v < 8; v++)
+                {
+                    int e = std::abs(rgba[i * 4 + 3] - values[v]);
+                    if (e < bestError)
+                    {
+                        bestError = e;
+                        best = v;
+                    }
+                }
+                bits |= (uint64_t)best << (3 * i);
+            }
+        }
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (unsigned char)(bits >> (8 * i));
+    }
+
+    // colour part of a block back to 16 RGB pixels (four-colour mode only, which is all we write)
+    inline void decodeColorBlock(const unsigned char block[8], unsigned char rgb[48])
+    {
+        uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+        uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+        uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+        int colors[4][3];
+        palette(c0, c1, colors);
+        for (int i = 0; i < 16; i++)
+            for (int k = 0; k < 3; k++)
+                rgb[i * 3 + k] = (unsigned char)colors[(indices >> (2 * i)) & 3][k];
+    }
+}
+
+// encodes 1-4 channel 8-bit pixels (as stbi_load returns them) into BC1, or BC3 when there is an
+// alpha channel, with the full mip chain, and measures the PSNR of level 0
+// -----------------------------------------------------------------------
+inline void cookTexture(const unsigned char* pixels, unsigned int width, unsigned int height, int channels, CookedTexture& out)
+{
+    bool alpha = channels == 4;
+    unsigned int blockBytes = alpha ? 16 : 8;
+    out.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    out.width = width;
+    out.height = height;
+
+    // the mip levels are filtered gamma-correct from the source by generateMipChain, every level
+    // is widened to RGBA for the block encoder
+    std::vector<MipLevel> mips = generateMipChain(pixels, width, height, channels);
+    auto expand = [channels, alpha](const unsigned char* source, unsigned int w, unsigned int h)
+    {
+        std::vector<unsigned char> image((size_t)w * h * 4);
+        for (size_t i = 0; i < (size_t)w * h; i++)
+        {
+            const unsigned char* p = &source[i * channels];
+            image[i * 4 + 0] = p[0];
+            image[i * 4 + 1] = channels >= 3 ? p[1] : p[0];
+            image[i * 4 + 2] = channels >= 3 ? p[2] : p[0];
+            image[i * 4 + 3] = alpha ? p[3] : 255;
+        }
+        return image;
+    };
+
+    std::vector<size_t> offsets;
+    out.storage.clear();
+    out.levelSizes.clear();
+    for (size_t level = 0; level <= mips.size(); level++)
+    {
+        unsigned int w = level == 0 ? width : mips[level - 1].width, h = level == 0 ? height : mips[level - 1].height;
+        std::vector<unsigned char> image = expand(level == 0 ? pixels : mips[level - 1].pixels.data(), w, h);
+        unsigned int blocksX = (w + 3) / 4, blocksY = (h + 3) / 4;
+        size_t offset = out.storage.size();
+        offsets.push_back(offset);
+        out.levelSizes.push_back(blocksX * blocksY * blockBytes);
+        out.storage.resize(offset + (size_t)blocksX * blocksY * blockBytes);
+        unsigned char block[64];
+        for (unsigned int by = 0; by < blocksY; by++)
+            for (unsigned int bx = 0; bx < blocksX; bx++)
+            {
+                for (unsigned int i = 0; i < 16; i++)
+                {
+                    unsigned int x = std::min(bx * 4 + i % 4, w - 1), y = std::min(by * 4 + i / 4, h - 1);
+                    memcpy(&block[i * 4], &image[((size_t)y * w + x) * 4], 4);
+                }
+                unsigned char* target = &out.storage[offset + ((size_t)by * blocksX + bx) * blockBytes];
+                if (alpha)
+                {
+                    bc::encodeAlphaBlock(block, target);
+                    target += 8;
+                }
+                bc::encodeColorBlock(block, target);
+            }
+    }
+    out.levels.clear();
+    for (size_t offset : offsets)
+        out.levels.push_back(&out.storage[offset]);
+
+    // PSNR of level 0 (RGB)
+    double squaredError = 0.0;
+    unsigned int blocksX = (width + 3) / 4;
+    for (unsigned int y = 0; y < height; y++)
+        for (unsigned int x = 0; x < width; x++)
+        {
+            const unsigned char* block = out.levels[0] + ((size_t)(y / 4) * blocksX + x / 4) * blockBytes + (alpha ? 8 : 0);
+            unsigned char rgb[48];
+            bc::decodeColorBlock(block, rgb);
+            const unsigned char* decoded = &rgb[((y % 4) * 4 + x % 4) * 3];
+            const unsigned char* p = &pixels[((size_t)y * width + x) * channels];
+            for (int k = 0; k < 3; k++)
+            {
+                double d = (double)decoded[k] - p[channels >= 3 ? k : 0];
+                squaredError += d * d;
+            }
+        }
+    double mse = squaredError / ((double)width * height * 3);
+    out.psnr = mse > 0.0 ? (float)(10.0 * std::log10(255.0 * 255.0 / mse)) : 99.0f;
+}
+
+// on-disk cache of cooked textures, one file per source image:
+//
+//   CookedHeader | levels x { offset, size } | block data
+//
+// The header carries a stamp of the source file's size and modification time; a stale or broken
+// file is simply cooked again. Files are memory-mapped and the level pointers point into the
+// mapping, so a warm load is an mmap plus glCompressedTexImage2D per level. load() and cook() run
+// on the worker threads.
+// -----------------------------------------------------------------------------------------------
+class TextureCache
+{
+public:
+    std::atomic<unsigned int> cooked{ 0 };     // encoded this run
+    std::atomic<unsigned int> fromDisk{ 0 };   // mapped from the cache directory
+
+    // an empty directory (or a driver without S3TC) disables compression: plain JPEG decode path
+    void init(const std::string& cacheDirectory)
+    {
+        directory = cacheDirectory;
+        if (!directory.empty() && !glExt().textureCompressionS3TC)
+        {
+            std::cout << "Texture cache: S3TC not supported, loading uncompressed textures" << std::endl;
+            directory.clear();
+        }
+        if (!directory.empty())
+            makeDirectory(directory);
+    }
+
+    bool enabled() const { return !directory.empty(); }
+
+    // variant tells apart several cooked versions of one source (e.g. resized array layers)
+    std::shared_ptr<CookedTexture> load(const std::string& sourcePath, const std::string& variant = "")
+    {
+        uint64_t stamp;
+        if (!fileStamp(sourcePath, stamp))
+            return std::shared_ptr<CookedTexture>();
+        std::shared_ptr<CookedTexture> texture(new CookedTexture());
+        MappedFile& file = texture->file;
+        if (!file.open(cachePath(sourcePath, variant)) || file.size() < sizeof(CookedHeader))
+            return std::shared_ptr<CookedTexture>();
+
+        CookedHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        size_t tableEnd = sizeof(CookedHeader) + (size_t)header.levels * sizeof(LevelEntry);
+        if (header.magic != MAGIC || header.version != VERSION || header.sourceStamp != stamp ||
+            header.levels == 0 || header.levels > 32 || tableEnd > file.size())
+            return std::shared_ptr<CookedTexture>();
+
+        texture->format = header.format;
+        texture->width = header.width;
+        texture->height = header.height;
+        texture->psnr = header.psnr;
+        const LevelEntry* table = (const LevelEntry*)(file.data() + sizeof(CookedHeader));
+        for (uint32_t level = 0; level < header.levels; level++)
+        {
+            if ((size_t)table[level].offset + table[level].size > file.size())
+                return std::shared_ptr<CookedTexture>();
+            texture->levels.push_back(file.data() + table[level].offset);
+            texture->levelSizes.push_back(table[level].size);
+        }
+        fromDisk++;
+        return texture;
+    }
+
+    // encodes the decoded image and writes it to the cache (a failed write only costs the next start)
+    std::shared_ptr<CookedTexture> cook(const std::string& sourcePath, const unsigned char* pixels, int width, int height, int channels,
+                                        const std::string& variant = "")
+    {
+        std::shared_ptr<CookedTexture> texture(new CookedTexture());
+        cookTexture(pixels, (unsigned int)width, (unsigned int)height, channels, *texture);
+        cooked++;
+
+        uint64_t stamp;
+        if (!fileStamp(sourcePath, stamp))
+            return texture;
+        CookedHeader header = { MAGIC, VERSION, stamp, texture->format, texture->width, texture->height,
+                                (uint32_t)texture->levels.size(), texture->psnr, 0 };
+        std::vector<LevelEntry> table;
+        uint32_t offset = (uint32_t)(sizeof(CookedHeader) + texture->levels.size() * sizeof(LevelEntry));
+        for (uint32_t size : texture->levelSizes)
+        {
+            LevelEntry entry = { offset, size };
+            table.push_back(entry);
+            offset += size;
+        }
+        // write to a temporary name first so a concurrent or interrupted run never maps half a file
+        std::string path = cachePath(sourcePath, variant);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                std::cout << "Texture cache: failed to write " << path << std::endl;
+                return texture;
+            }
+            file.write((const char*)&header, sizeof(header));
+            file.write((const char*)table.data(), table.size() * sizeof(LevelEntry));
+            file.write((const char*)texture->storage.data(), texture->storage.size());
+            // close() flushes, so a full disk may only show here
+            file.close();
+            if (!file)
+            {
+                std::remove(temporary.c_str());
+                std::cout << "Texture cache: failed to write " << path << std::endl;
+                return texture;
+            }
+        }
+        std::remove(path.c_str());
+        std::rename(temporary.c_str(), path.c_str());
+        return texture;
+    }
+
+private:
+    static const uint32_t MAGIC = 0x58545950; // "PYTX"
+    static const uint32_t VERSION = 2;   // 2: gamma-correct mip levels
+
+    struct CookedHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceStamp;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels;
+        float psnr;
+        uint32_t reserved;
+    };
+
+    struct LevelEntry
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    std::string directory;
+
+    std::string cachePath(const std::string& sourcePath, const std::string& variant) const
+    {
+        char name[32];
+        std::string key = sourcePath + (variant.empty() ? "" : "#" + variant);
+        snprintf(name, sizeof(name), "%016llx.pytx", (unsigned long long)hashString(key));
+        return directory + "/" + name;
+    }
+};
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "mip_generator.h"
+#include "texture_cooker.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// loads textures without blocking the first frame: every texture is created right away with a
+// 1x1 placeholder, the files are decoded by stbi_load on a ThreadPool, and update() (main thread,
+// once per frame) uploads whatever finished through a pixel unpack buffer and swaps it in. The
+// texture name never changes, so nothing that already holds it has to be told.
+//
+// A cubemap is uploaded only once all six faces are decoded, since a cube with faces of different
+// sizes is incomplete and samples black. Its mip chain is built on the workers by
+// generateMipChain (gamma-correct, one job per face) and sampled trilinearly. Texture arrays are
+// handled the same way, one image per layer; the workers also resize every layer to the size of
+// the array.
+//
+// With an enabled TextureCache the workers map the cooked BC1/BC3 file instead of decoding the
+// JPEG (cooking and storing it the first time), and update() hands the mapped blocks of every mip
+// level to glCompressedTexImage2D. 2D textures then get their precomputed mip chain instead of
+// glGenerateMipmap, cube faces the same chain generateMipChain makes for them.
+// ------------------------------------------------------------------------------------------------
+class TextureStreamer
+{
+public:
+    void init(ThreadPool& workerPool, TextureCache* textureCache = NULL)
+    {
+        pool = &workerPool;
+        cache = textureCache && textureCache->enabled() ? textureCache : NULL;
+        glGenBuffers(1, &PBO);
+    }
+
+    unsigned int loadTexture(const std::string& path)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        uploadPlaceholder(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        request(textureID, GL_TEXTURE_2D, std::vector<std::string>(1, path));
+        return textureID;
+    }
+
+    // faces in GL order: +X, -X, +Y, -Y, +Z, -Z
+    unsigned int loadCubemap(const std::vector<std::string>& faces)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        for (unsigned int i = 0; i < 6; i++)
+            uploadPlaceholder(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        request(textureID, GL_TEXTURE_CUBE_MAP, faces);
+        return textureID;
+    }
+
+    // a GL_TEXTURE_2D_ARRAY with one layer per path, every layer resized to width x height
+    unsigned int loadTextureArray(const std::vector<std::string>& layers, unsigned int width, unsigned int height)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+        std::vector<unsigned char> grey(layers.size() * 4, 128);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, 1, 1, (GLsizei)layers.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, grey.data());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+
+        request(textureID, GL_TEXTURE_2D_ARRAY, layers, width, height);
+        return textureID;
+    }
+
+    // uploads every texture whose images are all decoded; returns how many are still loading
+    unsigned int update()
+    {
+        std::vector<Decoded> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.swap(decoded);
+        }
+        for (Decoded& image : finished)
+        {
+            Request& req = *requests[image.request];
+            decodeMilliseconds += image.milliseconds;
+            req.images[image.face] = std::move(image);
+            req.ready++;
+            if (req.ready == req.paths.size())
+            {
+                upload(req);
+                pending--;
+            }
+        }
+        return pending;
+    }
+
+    // blocks until everything requested so far is decoded and uploaded
+    void finish()
+    {
+        pool->wait();
+        update();
+    }
+
+    // VRAM is estimated from what was uploaded: compressed sizes, or 4 bytes per texel (drivers
+    // pad RGB) plus a third for the mip chain; "uncompressed" is the same estimate for the JPEG
+    // path, to compare against
+    void report(std::ostream& out) const
+    {
+        const double MB = 1024.0 * 1024.0;
+        out << "textures: " << requests.size() << " textures, " << imageCount << " images loaded on "
+            << pool->size() << " threads (" << decodeMilliseconds << " ms worker time), "
+            << uploadedBytes / MB << " MB uploaded" << std::endl;
+        out << "texture memory: " << vramBytes / MB << " MB (uncompressed " << uncompressedBytes / MB << " MB)" << std::endl;
+        if (cache)
+        {
+            out << "texture cache: " << cache->cooked << " cooked, " << cache->fromDisk << " from disk";
+            if (psnrCount > 0)
+                out << ", PSNR avg " << psnrSum / psnrCount << " dB, min " << psnrMin << " dB";
+            out << std::endl;
+        }
+    }
+
+    // waits for the workers to go idle so no job writes into a destroyed streamer
+    void destroy()
+    {
+        if (pool)
+            pool->wait();
+        update();
+        glDeleteBuffers(1, &PBO);
+        PBO = 0;
+    }
+
+private:
+    struct Decoded
+    {
+        unsigned int request = 0;
+        unsigned int face = 0;
+        unsigned char* pixels = NULL;   // from stbi_load
+        std::vector<unsigned char> resized;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        std::vector<MipLevel> mips;     // levels 1..n made on the CPU (uncompressed cube faces)
+        std::shared_ptr<CookedTexture> cooked;
+        double milliseconds = 0.0;
+
+        bool valid() const { return pixels || !resized.empty() || cooked; }
+        const unsigned char* data() const { return pixels ? pixels : resized.data(); }
+        GLenum compressedFormat() const { return cooked ? cooked->format : 0; }
+    };
+
+    struct Request
+    {
+        unsigned int texture;
+        GLenum target;
+        std::vector<std::string> paths;
+        std::vector<Decoded> images;
+        unsigned int ready = 0;
+        unsigned int width = 0;     // array layers are resized to this, 0 keeps the image size
+        unsigned int height = 0;
+    };
+
+    ThreadPool* pool = NULL;
+    TextureCache* cache = NULL;
+    unsigned int PBO = 0;
+    std::vector<std::unique_ptr<Request> > requests;
+    std::vector<Decoded> decoded;   // filled by the workers
+    std::mutex mutex;
+    unsigned int pending = 0;
+    unsigned int imageCount = 0;
+    double decodeMilliseconds = 0.0;
+    size_t uploadedBytes = 0;
+    size_t vramBytes = 0;
+    size_t uncompressedBytes = 0;
+    double psnrSum = 0.0;
+    double psnrMin = 0.0;
+    unsigned int psnrCount = 0;
+
+    static void uploadPlaceholder(GLenum target)
+    {
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    }
+
+    static GLenum channelFormat(int channels)
+    {
+        if (channels == 1)
+            return GL_RED;
+        if (channels == 2)
+            return GL_RG;
+        if (channels == 4)
+            return GL_RGBA;
+        return GL_RGB;
+    }
+
+    void request(unsigned int texture, GLenum target, const std::vector<std::string>& paths, unsigned int width = 0, unsigned int height = 0)
+    {
+        std::unique_ptr<Request> req(new Request());
+        req->texture = texture;
+        req->target = target;
+        req->paths = paths;
+        req->images.resize(paths.size());
+        req->width = width;
+        req->height = height;
+        unsigned int index = (unsigned int)requests.size();
+        requests.push_back(std::move(req));
+        pending++;
+        imageCount += (unsigned int)paths.size();
+
+        // 2D textures without the cache get their mips from glGenerateMipmap after the upload
+        bool cpuMipmaps = target != GL_TEXTURE_2D;
+        std::string variant = width > 0 ? std::to_string(width) + "x" + std::to_string(height) : "";
+        for (unsigned int face = 0; face < paths.size(); face++)
+        {
+            std::string path = paths[face];
+            TextureCache* textureCache = cache;
+            pool->submit([this, index, face, path, textureCache, cpuMipmaps, width, height, variant]()
+            {
+                auto start = std::chrono::steady_clock::now();
+                Decoded image;
+                image.request = index;
+                image.face = face;
+                if (textureCache)
+                    image.cooked = textureCache->load(path, variant);
+                if (!image.cooked)
+                {
+                    image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+                    if (image.pixels && width > 0 && (image.width != (int)width || image.height != (int)height))
+                    {
+                        image.resized = resizeImage(image.pixels, (unsigned int)image.width, (unsigned int)image.height, image.channels, width, height);
+                        image.width = (int)width;
+                        image.height = (int)height;
+                        stbi_image_free(image.pixels);
+                        image.pixels = NULL;
+                    }
+                    if (image.valid() && textureCache)
+                    {
+                        image.cooked = textureCache->cook(path, image.data(), image.width, image.height, image.channels, variant);
+                        stbi_image_free(image.pixels);
+                        image.pixels = NULL;
+                        image.resized.clear();
+                    }
+                    else if (image.valid() && cpuMipmaps)
+                        image.mips = generateMipChain(image.data(), (unsigned int)image.width, (unsigned int)image.height, image.channels);
+                }
+                if (image.cooked)
+                {
+                    image.width = (int)image.cooked->width;
+                    image.height = (int)image.cooked->height;
+                }
+                std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+                image.milliseconds = time.count();
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_back(std::move(image));
+            });
+        }
+    }
+
+    // copies the pixels into the (orphaned) PBO and lets the driver pull them from there
+    void upload(Request& req)
+    {
+        glBindTexture(req.target, req.texture);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        // cube faces and array layers must all match, otherwise the placeholder stays
+        bool skip = req.target != GL_TEXTURE_2D && !imagesMatch(req);
+        if (!skip && req.target == GL_TEXTURE_2D_ARRAY)
+            allocateArray(req);
+        bool uploaded = false;
+        bool compressed = true;
+        for (unsigned int face = 0; face < req.images.size(); face++)
+        {
+            Decoded& image = req.images[face];
+            if (!image.valid())
+            {
+                std::cout << "Texture failed to load at path: " << req.paths[face] << std::endl;
+                continue;
+            }
+            if (skip)
+                continue;
+            GLenum target = req.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : req.target;
+            uncompressedBytes += (size_t)image.width * image.height * 4 * 4 / 3;
+            if (image.cooked)
+            {
+                uploadCompressed(req, target, face, *image.cooked);
+                uploaded = true;
+                continue;
+            }
+
+            GLenum format = channelFormat(image.channels);
+            for (size_t level = 0; level <= image.mips.size(); level++)
+            {
+                const MipLevel* mip = level == 0 ? NULL : &image.mips[level - 1];
+                int w = mip ? (int)mip->width : image.width, h = mip ? (int)mip->height : image.height;
+                const unsigned char* pixels = mip ? mip->pixels.data() : image.data();
+                size_t size = (size_t)w * h * image.channels;
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+                void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+                const void* source = (const void*)0;
+                if (mapped)
+                {
+                    memcpy(mapped, pixels, size);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                }
+                else
+                {
+                    // mapping failed, hand the pixels over directly
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    source = pixels;
+                }
+                if (req.target == GL_TEXTURE_2D_ARRAY)
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, face, w, h, 1, format, GL_UNSIGNED_BYTE, source);
+                else
+                    glTexImage2D(target, (GLint)level, format, w, h, 0, format, GL_UNSIGNED_BYTE, source);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+                uploadedBytes += size;
+            }
+            if (req.target != GL_TEXTURE_2D)
+                glTexParameteri(req.target, GL_TEXTURE_MAX_LEVEL, (GLint)image.mips.size());
+            vramBytes += (size_t)image.width * image.height * 4 * 4 / 3;
+            uploaded = true;
+            compressed = false;
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (uploaded && !compressed && req.target == GL_TEXTURE_2D)
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+        for (Decoded& image : req.images)
+        {
+            stbi_image_free(image.pixels);
+            image.pixels = NULL;
+            image.resized.clear();
+            image.mips.clear();
+            image.cooked.reset(); // unmaps the cache file
+        }
+    }
+
+    // straight from the cooked (usually memory-mapped) blocks, one call per mip level
+    void uploadCompressed(const Request& req, GLenum target, unsigned int layer, const CookedTexture& texture)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (unsigned int level = 0; level < texture.levels.size(); level++)
+        {
+            GLsizei w = std::max(1u, texture.width >> level), h = std::max(1u, texture.height >> level);
+            if (req.target == GL_TEXTURE_2D_ARRAY)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, texture.format, texture.levelSizes[level], texture.levels[level]);
+            else
+                glCompressedTexImage2D(target, level, texture.format, w, h, 0, texture.levelSizes[level], texture.levels[level]);
+            uploadedBytes += texture.levelSizes[level];
+            vramBytes += texture.levelSizes[level];
+        }
+        glTexParameteri(req.target, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+
+        psnrMin = psnrCount == 0 ? texture.psnr : std::min(psnrMin, (double)texture.psnr);
+        psnrSum += texture.psnr;
+        psnrCount++;
+    }
+
+    // storage for every level and layer of an array, filled in by the per-layer sub-uploads; all
+    // layers match (imagesMatch), so the first one tells the size, format and level count
+    void allocateArray(const Request& req)
+    {
+        const Decoded& first = req.images[0];
+        GLsizei layers = (GLsizei)req.images.size();
+        GLsizei levels = first.cooked ? (GLsizei)first.cooked->levels.size() : (GLsizei)first.mips.size() + 1;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        for (GLsizei level = 0; level < levels; level++)
+        {
+            GLsizei w = std::max(1, first.width >> level), h = std::max(1, first.height >> level);
+            if (first.cooked)
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.cooked->format, w, h, layers, 0,
+                                       first.cooked->levelSizes[level] * layers, NULL);
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+    }
+
+    // same size and same kind (compressed format or plain pixels) on every face or layer
+    static bool imagesMatch(const Request& req)
+    {
+        const Decoded& first = req.images[0];
+        for (const Decoded& image : req.images)
+            if (!image.valid() || image.width != first.width || image.height != first.height ||
+                image.compressedFormat() != first.compressedFormat())
+                return false;
+        return true;
+    }
+};
+
+#endif
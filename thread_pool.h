@@ -0,0 +1,101 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads taking jobs from one FIFO; nothing here touches GL, jobs must not
+// either (the context is only current on the main thread)
+// -----------------------------------------------------------------------------------------------
+class ThreadPool
+{
+public:
+    ~ThreadPool()
+    {
+        stop();
+    }
+
+    // 0 threads picks hardware_concurrency - 1 (the main thread keeps rendering), at least one
+    void start(unsigned int threads = 0)
+    {
+        if (!workers.empty())
+            return;
+        if (threads == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threads = cores > 1 ? cores - 1 : 1;
+        }
+        stopping = false;
+        for (unsigned int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&ThreadPool::run, this));
+    }
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        wake.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return jobs.empty() && busy == 0; });
+    }
+
+    // finishes the queued jobs, then joins the workers
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    unsigned int busy = 0;
+    bool stopping = false;
+
+    void run()
+    {
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+                busy++;
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy--;
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+#endif
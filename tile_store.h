@@ -0,0 +1,308 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <glm/glm.hpp>
+
+#include "dune_field.h"
+#include "file_util.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// terrain on disk, one file per baked field:
+//
+//   TileStoreHeader | leaf bounds (leavesPerSide^2 x { min, max }) | tiles
+//
+// The heights are mip-tiled: level 0 cuts the full-resolution heightmap into tiles of tileQuads x
+// tileQuads quads, every level up takes every other sample of the one below, so a tile always has
+// the same (tileQuads + 1)^2 samples (neighbours share their edge samples) and covers twice the
+// ground of a tile one level down; the last level is one tile for the whole terrain. A tile is its
+// heights (R16, normalised to the terrain's height range) followed by its splat map (R8, weight of
+// the slip-face material), levels stored one after another, tiles row-major within a level.
+//
+// The file is memory-mapped: open() only reads the header and copies the leaf bounds (the node
+// bounds of Terrain's quadtree), tile data is paged in from disk by whoever touches it first (the
+// TileStreamer's thread). A missing or stale file (the header holds a hash of the field and the
+// layout) is baked again, written under a temporary name and renamed, as the texture cache does.
+// ------------------------------------------------------------------------------------------------
+class TileStore
+{
+public:
+    static const unsigned int TILE_QUADS = 64;
+
+    // bakes the field into directory/<hash>.pyts unless an up-to-date file is already there, then
+    // maps it; the terrain is worldSize wide, centred on the origin, texel units between samples
+    // (rounded so the tiles fit), its bounds leaves are leafSize wide. The bake is spread over pool.
+    bool open(const std::string& directory, const DuneField& field, float worldSize, float texel, float leafSize, ThreadPool* pool = NULL)
+    {
+        close();
+        unsigned int quads = std::max(1u, (unsigned int)std::lround(worldSize / texel));
+        unsigned int leaves = std::max(1u, (unsigned int)std::lround(worldSize / leafSize));
+        quads = std::max(quads, leaves);    // at least one sample span per leaf
+        TileStoreHeader expected = {};
+        expected.magic = MAGIC;
+        expected.version = VERSION;
+        expected.worldSize = worldSize;
+        expected.tileQuads = std::min(TILE_QUADS, quads);
+        expected.tilesPerSide = quads / expected.tileQuads;
+        expected.leavesPerSide = leaves;
+        expected.levels = 1;
+        while ((expected.tilesPerSide >> (expected.levels - 1)) > 1)
+            expected.levels++;
+        expected.fieldStamp = hashBytes(&field, sizeof(field), hashBytes(&expected, sizeof(expected)));
+
+        makeDirectory(directory);
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.pyts", (unsigned long long)expected.fieldStamp);
+        path = directory + "/" + name;
+        auto openBegin = std::chrono::steady_clock::now();
+        baked = false;
+        if (!map(expected))
+        {
+            if (!bake(expected, field, pool) || !map(expected))
+            {
+                std::cout << "Tile store: failed to bake " << path << std::endl;
+                close();
+                return false;
+            }
+            baked = true;
+        }
+        std::chrono::duration<double, std::milli> openTime = std::chrono::steady_clock::now() - openBegin;
+        std::cout << "tile store: " << path << (baked ? " baked" : " mapped") << " in " << openTime.count() << " ms, "
+                  << tileCount() << " tiles of " << sampleCount() << "x" << sampleCount() << " in " << header.levels << " levels ("
+                  << file.size() / (1024.0 * 1024.0) << " MB)" << std::endl;
+        return true;
+    }
+
+    void close()
+    {
+        file.close();
+        leafBounds.clear();
+        levelFirstTile.clear();
+        header = TileStoreHeader();
+    }
+
+    bool isOpen() const { return file.data() != NULL; }
+
+    float worldSize() const { return header.worldSize; }
+    float origin() const { return -0.5f * header.worldSize; }
+    float minHeight() const { return header.minHeight; }
+    float maxHeight() const { return header.maxHeight; }
+    unsigned int levels() const { return header.levels; }
+    unsigned int tileQuads() const { return header.tileQuads; }
+    unsigned int sampleCount() const { return header.tileQuads + 1; }
+    unsigned int tilesPerSide(unsigned int level) const { return header.tilesPerSide >> level; }
+    unsigned int tileCount() const { return levelFirstTile.empty() ? 0 : levelFirstTile.back(); }
+    float tileSize(unsigned int level) const { return header.worldSize / tilesPerSide(level); }
+    size_t tileBytes() const { return alignedTileBytes(header); }
+
+    // tiles are numbered level by level, row-major within a level
+    unsigned int tileIndex(unsigned int level, unsigned int x, unsigned int z) const
+    {
+        return levelFirstTile[level] + z * tilesPerSide(level) + x;
+    }
+    void tileCoordinates(unsigned int tile, unsigned int& level, unsigned int& x, unsigned int& z) const
+    {
+        level = 0;
+        while (tile >= levelFirstTile[level + 1])
+            level++;
+        unsigned int local = tile - levelFirstTile[level];
+        x = local % tilesPerSide(level);
+        z = local / tilesPerSide(level);
+    }
+
+    // straight into the mapping: reading them may page the file in, keep off the render thread
+    const uint16_t* tileHeights(unsigned int tile) const
+    {
+        return (const uint16_t*)(file.data() + tilesOffset(header) + (size_t)tile * tileBytes());
+    }
+    const uint8_t* tileSplat(unsigned int tile) const
+    {
+        return (const uint8_t*)(tileHeights(tile) + sampleCount() * sampleCount());
+    }
+
+    // min/max height of every leafSize-wide square, row-major (copied out of the mapping by open())
+    unsigned int leavesPerSide() const { return header.leavesPerSide; }
+    const std::vector<glm::vec2>& leaves() const { return leafBounds; }
+
+    bool bakedThisRun() const { return baked; }
+
+private:
+    static const uint32_t MAGIC = 0x53545950; // "PYTS"
+    static const uint32_t VERSION = 1;
+
+    struct TileStoreHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fieldStamp;
+        float worldSize;
+        float minHeight;
+        float maxHeight;
+        uint32_t tileQuads;
+        uint32_t tilesPerSide;      // at level 0
+        uint32_t levels;
+        uint32_t leavesPerSide;
+        uint32_t reserved;
+    };
+
+    MappedFile file;
+    std::string path;
+    TileStoreHeader header = {};
+    std::vector<glm::vec2> leafBounds;
+    std::vector<unsigned int> levelFirstTile;   // plus one past the last tile
+    bool baked = false;
+
+    static size_t alignedTileBytes(const TileStoreHeader& h)
+    {
+        size_t samples = (size_t)(h.tileQuads + 1) * (h.tileQuads + 1);
+        return (samples * 3 + 15) / 16 * 16;
+    }
+    static size_t tilesOffset(const TileStoreHeader& h)
+    {
+        size_t offset = sizeof(TileStoreHeader) + (size_t)h.leavesPerSide * h.leavesPerSide * sizeof(glm::vec2);
+        return (offset + 15) / 16 * 16;
+    }
+    static unsigned int totalTiles(const TileStoreHeader& h)
+    {
+        unsigned int count = 0;
+        for (unsigned int level = 0; level < h.levels; level++)
+            count += (h.tilesPerSide >> level) * (h.tilesPerSide >> level);
+        return count;
+    }
+
+    // false when the file is missing, stale or cut short
+    bool map(const TileStoreHeader& expected)
+    {
+        if (!file.open(path) || file.size() < sizeof(TileStoreHeader))
+            return false;
+        TileStoreHeader stored;
+        memcpy(&stored, file.data(), sizeof(stored));
+        if (stored.magic != MAGIC || stored.version != VERSION || stored.fieldStamp != expected.fieldStamp ||
+            stored.tileQuads != expected.tileQuads || stored.tilesPerSide != expected.tilesPerSide ||
+            stored.levels != expected.levels || stored.leavesPerSide != expected.leavesPerSide ||
+            file.size() < tilesOffset(stored) + totalTiles(stored) * alignedTileBytes(stored))
+        {
+            file.close();
+            return false;
+        }
+        header = stored;
+        leafBounds.resize((size_t)header.leavesPerSide * header.leavesPerSide);
+        memcpy(leafBounds.data(), file.data() + sizeof(TileStoreHeader), leafBounds.size() * sizeof(glm::vec2));
+        levelFirstTile.assign(1, 0);
+        for (unsigned int level = 0; level < header.levels; level++)
+            levelFirstTile.push_back(levelFirstTile.back() + tilesPerSide(level) * tilesPerSide(level));
+        return true;
+    }
+
+    bool bake(TileStoreHeader h, const DuneField& field, ThreadPool* pool)
+    {
+        unsigned int resolution = h.tilesPerSide * h.tileQuads + 1;
+        float texel = h.worldSize / (resolution - 1), corner = -0.5f * h.worldSize;
+        std::vector<float> heights((size_t)resolution * resolution);
+        unsigned int bands = pool ? std::max(pool->size(), 1u) * 4 : 1;
+        unsigned int rowsPerBand = (resolution + bands - 1) / bands;
+        for (unsigned int band = 0; band < bands; band++)
+        {
+            auto bakeRows = [&, band]()
+            {
+                unsigned int end = std::min((band + 1) * rowsPerBand, resolution);
+                for (unsigned int j = band * rowsPerBand; j < end; j++)
+                    for (unsigned int i = 0; i < resolution; i++)
+                        heights[(size_t)j * resolution + i] = field.height(corner + i * texel, corner + j * texel);
+            };
+            if (pool)
+                pool->submit(bakeRows);
+            else
+                bakeRows();
+        }
+        if (pool)
+            pool->wait();
+        h.minHeight = *std::min_element(heights.begin(), heights.end());
+        h.maxHeight = *std::max_element(heights.begin(), heights.end());
+        float range = std::max(h.maxHeight - h.minHeight, 1e-3f);
+
+        // quantised the way the GPU will see them, so the leaf bounds hold for what is drawn
+        std::vector<uint16_t> samples(heights.size());
+        for (size_t i = 0; i < heights.size(); i++)
+            samples[i] = (uint16_t)std::lround((heights[i] - h.minHeight) / range * 65535.0f);
+        auto decode = [&](uint16_t sample) { return sample / 65535.0f * range + h.minHeight; };
+
+        // slip faces and other steep sand get the second material
+        std::vector<uint8_t> splat(heights.size());
+        for (unsigned int j = 0; j < resolution; j++)
+            for (unsigned int i = 0; i < resolution; i++)
+            {
+                unsigned int i0 = i > 0 ? i - 1 : i, i1 = i + 1 < resolution ? i + 1 : i;
+                unsigned int j0 = j > 0 ? j - 1 : j, j1 = j + 1 < resolution ? j + 1 : j;
+                float dx = (heights[(size_t)j * resolution + i1] - heights[(size_t)j * resolution + i0]) / ((i1 - i0) * texel);
+                float dz = (heights[(size_t)j1 * resolution + i] - heights[(size_t)j0 * resolution + i]) / ((j1 - j0) * texel);
+                float slope = std::sqrt(dx * dx + dz * dz);
+                float t = std::min(std::max((slope - 0.35f) / 0.35f, 0.0f), 1.0f);
+                splat[(size_t)j * resolution + i] = (uint8_t)std::lround(t * t * (3.0f - 2.0f * t) * 255.0f);
+            }
+
+        std::vector<glm::vec2> leaves((size_t)h.leavesPerSide * h.leavesPerSide);
+        unsigned int span = (resolution - 1) / h.leavesPerSide;
+        for (unsigned int z = 0; z < h.leavesPerSide; z++)
+            for (unsigned int x = 0; x < h.leavesPerSide; x++)
+            {
+                uint16_t low = 0xFFFF, high = 0;
+                for (unsigned int j = z * span; j <= (z + 1) * span; j++)
+                    for (unsigned int i = x * span; i <= (x + 1) * span; i++)
+                    {
+                        low = std::min(low, samples[(size_t)j * resolution + i]);
+                        high = std::max(high, samples[(size_t)j * resolution + i]);
+                    }
+                leaves[(size_t)z * h.leavesPerSide + x] = glm::vec2(decode(low), decode(high));
+            }
+
+        // write to a temporary name first so a concurrent or interrupted run never maps half a file
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write((const char*)&h, sizeof(h));
+            out.write((const char*)leaves.data(), leaves.size() * sizeof(glm::vec2));
+            std::vector<char> padding(tilesOffset(h) - sizeof(h) - leaves.size() * sizeof(glm::vec2), 0);
+            out.write(padding.data(), padding.size());
+
+            unsigned int n = h.tileQuads + 1;
+            std::vector<unsigned char> tile(alignedTileBytes(h), 0);
+            uint16_t* tileHeights = (uint16_t*)tile.data();
+            uint8_t* tileSplat = tile.data() + n * n * sizeof(uint16_t);
+            for (unsigned int level = 0; level < h.levels; level++)
+            {
+                unsigned int tiles = h.tilesPerSide >> level, step = 1u << level;
+                for (unsigned int tz = 0; tz < tiles; tz++)
+                    for (unsigned int tx = 0; tx < tiles; tx++)
+                    {
+                        for (unsigned int j = 0; j < n; j++)
+                            for (unsigned int i = 0; i < n; i++)
+                            {
+                                size_t source = (size_t)((tz * h.tileQuads + j) * step) * resolution + (tx * h.tileQuads + i) * step;
+                                tileHeights[j * n + i] = samples[source];
+                                tileSplat[j * n + i] = splat[source];
+                            }
+                        out.write((const char*)tile.data(), tile.size());
+                    }
+            }
+            if (!out)
+                return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+};
+
+#endif
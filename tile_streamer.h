@@ -0,0 +1,438 @@
+#ifndef TILE_STREAMER_H
+#define TILE_STREAMER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "tile_store.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// keeps the tiles of a TileStore the camera needs in a fixed set of GPU slots: one layer each of a
+// height array (R16) and a splat array (R8), as many layers as the VRAM budget pays for.
+//
+// Every frame update() works out the wanted tiles: at each level the tiles within that level's
+// range (twice the range of the level below) of the camera, and of where the camera will be
+// LOOKAHEAD seconds from now at its current velocity, coarse levels first, nearest first. The
+// coarsest level is a single tile, loaded by init() and never evicted, so there is always
+// something to draw. Missing tiles go to the streaming thread, which copies them out of the
+// memory-mapped store (the only place the file's pages are touched) and hands them back; the render
+// thread uploads a few finished tiles per frame from memory, so it never waits on the disk.
+//
+// A tile gets a free slot, or the one least recently wanted; slots wanted this frame are never
+// taken, so when the budget is full the finer tiles simply wait. The page table (one texel per
+// level-0 tile, RG16UI: slot, level) points every part of the terrain at the finest resident tile
+// covering it, which is how missing tiles fall back to coarser resident levels in the shader.
+// ------------------------------------------------------------------------------------------------
+class TileStreamer
+{
+public:
+    static const unsigned int MAX_UPLOADS_PER_FRAME = 8;
+    static constexpr float LOOKAHEAD = 1.0f;           // seconds
+
+    unsigned int heightTexture = 0;
+    unsigned int splatTexture = 0;
+    unsigned int pageTexture = 0;
+
+    // the textures are created on (and stay bound to) the given texture units; levelZeroRange is how
+    // far from the camera level 0 tiles are wanted
+    bool init(const TileStore& tileStore, size_t budgetBytes, float levelZeroRange, unsigned int heightUnit, unsigned int splatUnit,
+              unsigned int pageUnit)
+    {
+        store = &tileStore;
+        range = levelZeroRange;
+        units[0] = heightUnit;
+        units[1] = splatUnit;
+        units[2] = pageUnit;
+        unsigned int samples = store->sampleCount();
+        size_t slotBytes = (size_t)samples * samples * 3;
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        slotCount = (unsigned int)std::min(std::max(budgetBytes / slotBytes, (size_t)store->levels()), (size_t)maxLayers);
+        slots.assign(slotCount, Slot());
+        tileSlot.assign(store->tileCount(), -1);
+        inFlight.assign(store->tileCount(), 0);
+        wantedFrame.assign(store->tileCount(), 0);
+        pageSize = store->tilesPerSide(0);
+        pages.assign((size_t)pageSize * pageSize * 2, 0);
+
+        glGenTextures(1, &heightTexture);
+        glGenTextures(1, &splatTexture);
+        glGenTextures(1, &pageTexture);
+        glActiveTexture(GL_TEXTURE0 + units[0]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heightTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16, samples, samples, slotCount, 0, GL_RED, GL_UNSIGNED_SHORT, NULL);
+        setArrayParameters();
+        glActiveTexture(GL_TEXTURE0 + units[1]);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, splatTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, samples, samples, slotCount, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        setArrayParameters();
+        glActiveTexture(GL_TEXTURE0 + units[2]);
+        glBindTexture(GL_TEXTURE_2D, pageTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16UI, pageSize, pageSize, 0, GL_RG_INTEGER, GL_UNSIGNED_SHORT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+
+        // the one tile of the coarsest level: read here, once, at startup
+        LoadedTile root;
+        root.tile = store->tileIndex(store->levels() - 1, 0, 0);
+        read(root);
+        upload(root, true);
+        updatePageTable();
+
+        stopping = false;
+        thread = std::thread(&TileStreamer::run, this);
+        std::cout << "tile streamer: " << slotCount << " slots of " << samples << "x" << samples << " (" << slotCount * slotBytes / (1024.0 * 1024.0)
+                  << " MB budget)" << std::endl;
+        return true;
+    }
+
+    // once per frame on the render thread: uploads what the streaming thread finished, then asks
+    // it for whatever is wanted and still missing
+    void update(const glm::vec3& position, const glm::vec3& velocity)
+    {
+        auto updateBegin = std::chrono::steady_clock::now();
+        frame++;
+        std::vector<unsigned int> needed;
+        std::vector<unsigned int> wanted = wantedTiles(position, velocity, &needed);
+        for (unsigned int tile : wanted)
+        {
+            wantedFrame[tile] = frame;
+            if (tileSlot[tile] >= 0)
+                slots[tileSlot[tile]].lastWanted = frame;
+        }
+        for (unsigned int tile : needed)
+            if (tileSlot[tile] < 0)
+            {
+                fallbackFrames++;
+                break;
+            }
+
+        bool uploaded = uploadFinished(MAX_UPLOADS_PER_FRAME) > 0;
+        busy = request(wanted) || uploaded;
+        std::chrono::duration<double, std::milli> updateTime = std::chrono::steady_clock::now() - updateBegin;
+        totalUpdateTime += updateTime.count();
+        maxUpdateTime = std::max(maxUpdateTime, updateTime.count());
+    }
+
+    // blocks until every tile wanted from position is resident or the budget is full (the benchmark
+    // calls this before its measured frames, as it does TextureStreamer::finish)
+    void finish(const glm::vec3& position)
+    {
+        for (;;)
+        {
+            frame++;
+            std::vector<unsigned int> wanted = wantedTiles(position, glm::vec3(0.0f));
+            for (unsigned int tile : wanted)
+            {
+                wantedFrame[tile] = frame;
+                if (tileSlot[tile] >= 0)
+                    slots[tileSlot[tile]].lastWanted = frame;
+            }
+            if (!request(wanted))
+                return;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                idle.wait(lock, [this]() { return requests.empty() && !reading; });
+            }
+            if (uploadFinished(~0u) == 0)
+                return;
+        }
+    }
+
+    unsigned int residentCount() const { return resident; }
+
+    // the last update() uploaded tiles or is still waiting for some, so the next frames may look different
+    bool streaming() const { return busy; }
+
+    void report(std::ostream& out) const
+    {
+        if (frame == 0)
+            return;
+        out << "tile streamer: " << resident << "/" << slotCount << " slots used, " << uploads << " tiles uploaded, " << evictions
+            << " evicted, " << dropped << " dropped (budget full), coarser fallback in " << fallbackFrames << " frames; " << readMilliseconds
+            << " ms reading on the streaming thread, " << totalUpdateTime / frame << " ms/frame on the render thread (max "
+            << maxUpdateTime << ")" << std::endl;
+    }
+
+    void destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            requests.clear();
+        }
+        wake.notify_all();
+        if (thread.joinable())
+            thread.join();
+        glDeleteTextures(1, &heightTexture);
+        glDeleteTextures(1, &splatTexture);
+        glDeleteTextures(1, &pageTexture);
+        heightTexture = splatTexture = pageTexture = 0;
+    }
+
+private:
+    struct Slot
+    {
+        int tile = -1;
+        unsigned long long lastWanted = 0;
+        bool pinned = false;
+    };
+
+    struct LoadedTile
+    {
+        unsigned int tile = 0;
+        std::vector<unsigned char> data;    // heights, then splat
+    };
+
+    const TileStore* store = NULL;
+    float range = 0.0f;
+    unsigned int units[3] = {};
+    unsigned int slotCount = 0;
+    std::vector<Slot> slots;
+    std::vector<int> tileSlot;                  // per store tile, -1 when not resident
+    std::vector<unsigned long long> wantedFrame;
+    unsigned int pageSize = 0;
+    std::vector<uint16_t> pages;
+    unsigned long long frame = 0;
+    unsigned int resident = 0;
+    bool busy = false;
+    std::vector<LoadedTile> finished;           // taken from the thread, not uploaded yet
+
+    // shared with the streaming thread
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<unsigned int> requests;          // replaced every frame, most wanted first
+    std::vector<char> inFlight;                 // requested or read, not yet taken back
+    std::vector<LoadedTile> loaded;
+    bool reading = false;
+    bool stopping = false;
+    double readMilliseconds = 0.0;
+
+    unsigned long long uploads = 0;
+    unsigned long long evictions = 0;
+    unsigned long long dropped = 0;
+    unsigned long long fallbackFrames = 0;
+    double totalUpdateTime = 0.0;
+    double maxUpdateTime = 0.0;
+
+    static void setArrayParameters()
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    }
+
+    // coarsest level first, then by distance to the camera; needed gets the ones wanted for where
+    // the camera is now (not just where it is heading)
+    std::vector<unsigned int> wantedTiles(const glm::vec3& position, const glm::vec3& velocity, std::vector<unsigned int>* needed = NULL) const
+    {
+        glm::vec2 now(position.x, position.z);
+        glm::vec2 ahead = now + glm::vec2(velocity.x, velocity.z) * LOOKAHEAD;
+        std::vector<std::pair<float, unsigned int> > order;
+        std::vector<unsigned int> wanted;
+        for (int level = (int)store->levels() - 1; level >= 0; level--)
+        {
+            float size = store->tileSize(level), levelRange = range * (float)(1u << level);
+            int tiles = (int)store->tilesPerSide(level);
+            glm::vec2 low = glm::min(now, ahead) - levelRange, high = glm::max(now, ahead) + levelRange;
+            int x0 = std::max(0, (int)std::floor((low.x - store->origin()) / size)), x1 = std::min(tiles - 1, (int)std::floor((high.x - store->origin()) / size));
+            int z0 = std::max(0, (int)std::floor((low.y - store->origin()) / size)), z1 = std::min(tiles - 1, (int)std::floor((high.y - store->origin()) / size));
+            order.clear();
+            for (int z = z0; z <= z1; z++)
+                for (int x = x0; x <= x1; x++)
+                {
+                    glm::vec2 boxMin(store->origin() + x * size, store->origin() + z * size), boxMax = boxMin + size;
+                    float distanceNow = glm::length(glm::min(glm::max(now, boxMin), boxMax) - now);
+                    float distanceAhead = glm::length(glm::min(glm::max(ahead, boxMin), boxMax) - ahead);
+                    if (std::min(distanceNow, distanceAhead) <= levelRange)
+                        order.push_back(std::make_pair(distanceNow, store->tileIndex(level, x, z)));
+                    if (needed && distanceNow <= levelRange)
+                        needed->push_back(store->tileIndex(level, x, z));
+                }
+            std::sort(order.begin(), order.end());
+            for (const std::pair<float, unsigned int>& entry : order)
+                wanted.push_back(entry.second);
+        }
+        return wanted;
+    }
+
+    // hands the missing wanted tiles to the thread, replacing what it had not started on, no more
+    // than there are slots to take them; false when nothing is missing or on its way
+    bool request(const std::vector<unsigned int>& wanted)
+    {
+        unsigned int available = 0;
+        for (const Slot& slot : slots)
+            if (slot.tile < 0 || (!slot.pinned && slot.lastWanted < frame))
+                available++;
+        bool outstanding = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (unsigned int tile : requests)
+                inFlight[tile] = 0;
+            requests.clear();
+            for (unsigned int tile : wanted)
+            {
+                if (tileSlot[tile] >= 0)
+                    continue;
+                if (available == 0)
+                    break;
+                available--;
+                outstanding = true;
+                if (inFlight[tile])
+                    continue;
+                bool waiting = false;
+                for (const LoadedTile& done : finished)
+                    waiting |= done.tile == tile;
+                if (waiting)
+                    continue;
+                inFlight[tile] = 1;
+                requests.push_back(tile);
+            }
+        }
+        wake.notify_one();
+        return outstanding;
+    }
+
+    // uploads up to limit finished tiles, returns how many
+    unsigned int uploadFinished(unsigned int limit)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (LoadedTile& tile : loaded)
+            {
+                inFlight[tile.tile] = 0;
+                finished.push_back(std::move(tile));
+            }
+            loaded.clear();
+        }
+        unsigned int count = 0;
+        size_t used = 0;
+        for (; used < finished.size() && count < limit; used++)
+        {
+            // no longer wanted by the time it arrived: not worth a slot
+            if (wantedFrame[finished[used].tile] != frame)
+                continue;
+            if (upload(finished[used], false))
+                count++;
+        }
+        finished.erase(finished.begin(), finished.begin() + used);
+        if (count > 0)
+            updatePageTable();
+        return count;
+    }
+
+    bool upload(const LoadedTile& tile, bool pinned)
+    {
+        if (tileSlot[tile.tile] >= 0)
+            return false;
+        int slot = -1;
+        for (unsigned int i = 0; i < slotCount && slot < 0; i++)
+            if (slots[i].tile < 0)
+                slot = (int)i;
+        if (slot < 0)
+        {
+            // least recently wanted, never one wanted this frame
+            for (unsigned int i = 0; i < slotCount; i++)
+                if (!slots[i].pinned && slots[i].lastWanted < frame && (slot < 0 || slots[i].lastWanted < slots[slot].lastWanted))
+                    slot = (int)i;
+            if (slot < 0)
+            {
+                dropped++;
+                return false;
+            }
+            tileSlot[slots[slot].tile] = -1;
+            resident--;
+            evictions++;
+        }
+        unsigned int samples = store->sampleCount();
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glActiveTexture(GL_TEXTURE0 + units[0]);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, samples, samples, 1, GL_RED, GL_UNSIGNED_SHORT, tile.data.data());
+        glActiveTexture(GL_TEXTURE0 + units[1]);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot, samples, samples, 1, GL_RED, GL_UNSIGNED_BYTE,
+                        tile.data.data() + (size_t)samples * samples * sizeof(uint16_t));
+        glActiveTexture(GL_TEXTURE0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        slots[slot].tile = (int)tile.tile;
+        slots[slot].lastWanted = frame;
+        slots[slot].pinned = pinned;
+        tileSlot[tile.tile] = slot;
+        resident++;
+        uploads++;
+        return true;
+    }
+
+    void updatePageTable()
+    {
+        for (unsigned int z = 0; z < pageSize; z++)
+            for (unsigned int x = 0; x < pageSize; x++)
+                for (unsigned int level = 0; level < store->levels(); level++)
+                {
+                    int slot = tileSlot[store->tileIndex(level, x >> level, z >> level)];
+                    if (slot < 0)
+                        continue;
+                    pages[(z * pageSize + x) * 2] = (uint16_t)slot;
+                    pages[(z * pageSize + x) * 2 + 1] = (uint16_t)level;
+                    break;
+                }
+        glActiveTexture(GL_TEXTURE0 + units[2]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pageSize, pageSize, GL_RG_INTEGER, GL_UNSIGNED_SHORT, pages.data());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // copies one tile out of the mapping, paging it in from disk
+    void read(LoadedTile& tile) const
+    {
+        unsigned int samples = store->sampleCount();
+        size_t heightBytes = (size_t)samples * samples * sizeof(uint16_t), splatBytes = (size_t)samples * samples;
+        tile.data.resize(heightBytes + splatBytes);
+        memcpy(tile.data.data(), store->tileHeights(tile.tile), heightBytes);
+        memcpy(tile.data.data() + heightBytes, store->tileSplat(tile.tile), splatBytes);
+    }
+
+    // the streaming thread
+    void run()
+    {
+        for (;;)
+        {
+            LoadedTile tile;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                reading = false;
+                idle.notify_all();
+                wake.wait(lock, [this]() { return stopping || !requests.empty(); });
+                if (stopping)
+                    return;
+                tile.tile = requests.front();
+                requests.pop_front();
+                reading = true;
+            }
+            auto readBegin = std::chrono::steady_clock::now();
+            read(tile);
+            std::chrono::duration<double, std::milli> readTime = std::chrono::steady_clock::now() - readBegin;
+            std::lock_guard<std::mutex> lock(mutex);
+            readMilliseconds += readTime.count();
+            loaded.push_back(std::move(tile));
+        }
+    }
+};
+
+#endif
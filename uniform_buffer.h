@@ -0,0 +1,110 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <vector>
+
+// uniform block binding points shared by every program (see Shader::bindUniformBlock)
+enum UniformBinding
+{
+    UBO_BINDING_CAMERA = 0,
+    UBO_BINDING_DRAW = 1,
+    UBO_BINDING_TERRAIN = 2
+};
+
+// std140 "Camera" block, written once per frame
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+};
+
+// std140 "Draw" block, one record per draw (texCoordScaleOffset: xy = scale, zw = offset)
+struct DrawBlock
+{
+    glm::mat4 model;
+    glm::vec4 positionScale;
+    glm::vec4 positionOffset;
+    glm::vec4 texCoordScaleOffset;
+};
+
+// a GL_UNIFORM_BUFFER holding a single block, bound to one binding point for the whole frame
+// -------------------------------------------------------------------------------------------
+class UniformBuffer
+{
+public:
+    unsigned int UBO = 0;
+
+    void create(GLsizeiptr size, unsigned int binding)
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void update(const void* data, GLsizeiptr size, GLintptr offset = 0) const
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+    }
+};
+
+// static array of DrawBlock records padded to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT; selecting a
+// record is a glBindBufferRange, so per-draw data costs no upload at draw time
+// -------------------------------------------------------------------------------------------
+class DrawBlockBuffer
+{
+public:
+    unsigned int UBO = 0;
+
+    unsigned int add(const DrawBlock& block)
+    {
+        records.push_back(block);
+        return (unsigned int)records.size() - 1;
+    }
+
+    void build()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        stride = ((GLsizeiptr)sizeof(DrawBlock) + alignment - 1) / alignment * alignment;
+
+        std::vector<unsigned char> data(records.size() * stride, 0);
+        for (size_t i = 0; i < records.size(); i++)
+            memcpy(&data[i * stride], &records[i], sizeof(DrawBlock));
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void bind(unsigned int record) const
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, UBO_BINDING_DRAW, UBO, record * stride, sizeof(DrawBlock));
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &UBO);
+        UBO = 0;
+    }
+
+    unsigned int count() const { return (unsigned int)records.size(); }
+
+private:
+    std::vector<DrawBlock> records;
+    GLsizeiptr stride = 0;
+};
+
+#endif
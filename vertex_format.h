@@ -0,0 +1,385 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// storage formats for the position + texcoord vertices of the static scene
+//
+// the source data is always 5 floats (20 bytes) per vertex; the compact formats are
+// dequantized in the vertex shader as  value = stored * scale + offset , with scale/offset
+// taken from the AABB (or UV range) of the meshes that share the format
+// ------------------------------------------------------------------------------------------
+enum PositionFormat
+{
+    POSITION_FLOAT3,  // 12 bytes
+    POSITION_HALF3,   //  8 bytes (3 halfs + padding)
+    POSITION_UNORM16, //  8 bytes (3 normalized ushorts + padding), relative to the AABB
+    POSITION_UNORM10  //  4 bytes (GL_UNSIGNED_INT_2_10_10_10_REV), relative to the AABB
+};
+
+enum TexCoordFormat
+{
+    TEXCOORD_FLOAT2,  // 8 bytes
+    TEXCOORD_HALF2,   // 4 bytes
+    TEXCOORD_UNORM16  // 4 bytes, relative to the UV range
+};
+
+struct VertexFormat
+{
+    PositionFormat position = POSITION_FLOAT3;
+    TexCoordFormat texCoord = TEXCOORD_FLOAT2;
+
+    unsigned int positionSize() const
+    {
+        switch (position)
+        {
+        case POSITION_FLOAT3: return 3 * sizeof(float);
+        case POSITION_UNORM10: return sizeof(uint32_t);
+        default: return 4 * sizeof(uint16_t);
+        }
+    }
+
+    unsigned int texCoordSize() const
+    {
+        return texCoord == TEXCOORD_FLOAT2 ? 2 * sizeof(float) : 2 * sizeof(uint16_t);
+    }
+
+    unsigned int stride() const { return positionSize() + texCoordSize(); }
+
+    bool operator==(const VertexFormat& other) const
+    {
+        return position == other.position && texCoord == other.texCoord;
+    }
+
+    std::string name() const
+    {
+        static const char* positionNames[] = { "float3", "half3", "unorm16", "unorm10" };
+        static const char* texCoordNames[] = { "float2", "half2", "unorm16" };
+        return std::string(positionNames[position]) + "/" + texCoordNames[texCoord];
+    }
+};
+
+// accepts float, half, unorm16, unorm10 (texcoords fall back to unorm16 for unorm10)
+inline bool parseVertexFormat(const std::string& name, VertexFormat& format)
+{
+    if (name == "float")
+        format = { POSITION_FLOAT3, TEXCOORD_FLOAT2 };
+    else if (name == "half")
+        format = { POSITION_HALF3, TEXCOORD_HALF2 };
+    else if (name == "unorm16")
+        format = { POSITION_UNORM16, TEXCOORD_UNORM16 };
+    else if (name == "unorm10")
+        format = { POSITION_UNORM10, TEXCOORD_UNORM16 };
+    else
+        return false;
+    return true;
+}
+
+// dequantization constants for the vertex shader
+struct QuantizationRange
+{
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec2 texCoordScale = glm::vec2(1.0f);
+    glm::vec2 texCoordOffset = glm::vec2(0.0f);
+};
+
+// IEEE half <-> float, round to nearest even, denormals and inf/nan preserved
+// ---------------------------------------------------------------------------
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if (magnitude >= 0x7F800000u)
+        return (uint16_t)(sign | 0x7C00u | (magnitude > 0x7F800000u ? 0x200u : 0u));
+    if (magnitude >= 0x477FF000u)
+        return (uint16_t)(sign | 0x7C00u); // overflows to inf
+    if (magnitude < 0x38800000u)
+    {
+        // half denormal: let the float unit do the rounding
+        float f;
+        uint32_t absBits = magnitude;
+        memcpy(&f, &absBits, sizeof(f));
+        return (uint16_t)(sign | (uint32_t)std::lrint(f * 16777216.0f));
+    }
+    uint32_t rounded = magnitude + 0xC8000FFFu + ((magnitude >> 13) & 1u);
+    return (uint16_t)(sign | (rounded >> 13));
+}
+
+inline float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    float result;
+    if (exponent == 0)
+        result = mantissa / 16777216.0f;
+    else if (exponent == 31)
+        result = mantissa ? NAN : INFINITY;
+    else
+    {
+        uint32_t bits = ((exponent + 112) << 23) | (mantissa << 13);
+        memcpy(&result, &bits, sizeof(result));
+    }
+    return sign ? -result : result;
+}
+
+// ranges used by the normalized formats; float and half formats keep scale 1 / offset 0
+// -------------------------------------------------------------------------------------
+inline QuantizationRange computeQuantizationRange(const VertexFormat& format, const float* vertices, size_t vertexCount, unsigned int floatsPerVertex)
+{
+    QuantizationRange range;
+    if (vertexCount == 0)
+        return range;
+
+    glm::vec3 minPosition(vertices[0], vertices[1], vertices[2]);
+    glm::vec3 maxPosition = minPosition;
+    glm::vec2 minTexCoord(vertices[3], vertices[4]);
+    glm::vec2 maxTexCoord = minTexCoord;
+    for (size_t i = 1; i < vertexCount; i++)
+    {
+        const float* v = vertices + i * floatsPerVertex;
+        minPosition = glm::min(minPosition, glm::vec3(v[0], v[1], v[2]));
+        maxPosition = glm::max(maxPosition, glm::vec3(v[0], v[1], v[2]));
+        minTexCoord = glm::min(minTexCoord, glm::vec2(v[3], v[4]));
+        maxTexCoord = glm::max(maxTexCoord, glm::vec2(v[3], v[4]));
+    }
+
+    if (format.position == POSITION_UNORM16 || format.position == POSITION_UNORM10)
+    {
+        range.positionOffset = minPosition;
+        range.positionScale = maxPosition - minPosition;
+        // a flat axis still needs a non-zero scale so decoding is well defined
+        for (int axis = 0; axis < 3; axis++)
+            if (range.positionScale[axis] <= 0.0f)
+                range.positionScale[axis] = 1.0f;
+    }
+    if (format.texCoord == TEXCOORD_UNORM16)
+    {
+        range.texCoordOffset = minTexCoord;
+        range.texCoordScale = maxTexCoord - minTexCoord;
+        for (int axis = 0; axis < 2; axis++)
+            if (range.texCoordScale[axis] <= 0.0f)
+                range.texCoordScale[axis] = 1.0f;
+    }
+    return range;
+}
+
+inline uint32_t quantizeUnorm(float value, float offset, float scale, uint32_t maxValue)
+{
+    float normalized = std::min(std::max((value - offset) / scale, 0.0f), 1.0f);
+    return (uint32_t)(normalized * maxValue + 0.5f);
+}
+
+// packs one 5-float vertex into format.stride() bytes at out
+inline void encodeVertex(const VertexFormat& format, const QuantizationRange& range, const float* vertex, unsigned char* out)
+{
+    switch (format.position)
+    {
+    case POSITION_FLOAT3:
+        memcpy(out, vertex, 3 * sizeof(float));
+        break;
+    case POSITION_HALF3:
+    {
+        uint16_t half[4] = { floatToHalf(vertex[0]), floatToHalf(vertex[1]), floatToHalf(vertex[2]), 0 };
+        memcpy(out, half, sizeof(half));
+        break;
+    }
+    case POSITION_UNORM16:
+    {
+        uint16_t packed[4];
+        for (int axis = 0; axis < 3; axis++)
+            packed[axis] = (uint16_t)quantizeUnorm(vertex[axis], range.positionOffset[axis], range.positionScale[axis], 0xFFFF);
+        packed[3] = 0;
+        memcpy(out, packed, sizeof(packed));
+        break;
+    }
+    case POSITION_UNORM10:
+    {
+        uint32_t packed = 0;
+        for (int axis = 0; axis < 3; axis++)
+            packed |= quantizeUnorm(vertex[axis], range.positionOffset[axis], range.positionScale[axis], 0x3FF) << (axis * 10);
+        memcpy(out, &packed, sizeof(packed));
+        break;
+    }
+    }
+
+    out += format.positionSize();
+    switch (format.texCoord)
+    {
+    case TEXCOORD_FLOAT2:
+        memcpy(out, vertex + 3, 2 * sizeof(float));
+        break;
+    case TEXCOORD_HALF2:
+    {
+        uint16_t half[2] = { floatToHalf(vertex[3]), floatToHalf(vertex[4]) };
+        memcpy(out, half, sizeof(half));
+        break;
+    }
+    case TEXCOORD_UNORM16:
+    {
+        uint16_t packed[2];
+        for (int axis = 0; axis < 2; axis++)
+            packed[axis] = (uint16_t)quantizeUnorm(vertex[3 + axis], range.texCoordOffset[axis], range.texCoordScale[axis], 0xFFFF);
+        memcpy(out, packed, sizeof(packed));
+        break;
+    }
+    }
+}
+
+// what the vertex shader will see after dequantization, back as 5 floats
+inline void decodeVertex(const VertexFormat& format, const QuantizationRange& range, const unsigned char* in, float* vertex)
+{
+    switch (format.position)
+    {
+    case POSITION_FLOAT3:
+        memcpy(vertex, in, 3 * sizeof(float));
+        break;
+    case POSITION_HALF3:
+    {
+        uint16_t half[3];
+        memcpy(half, in, sizeof(half));
+        for (int axis = 0; axis < 3; axis++)
+            vertex[axis] = halfToFloat(half[axis]);
+        break;
+    }
+    case POSITION_UNORM16:
+    {
+        uint16_t packed[3];
+        memcpy(packed, in, sizeof(packed));
+        for (int axis = 0; axis < 3; axis++)
+            vertex[axis] = packed[axis] / 65535.0f * range.positionScale[axis] + range.positionOffset[axis];
+        break;
+    }
+    case POSITION_UNORM10:
+    {
+        uint32_t packed;
+        memcpy(&packed, in, sizeof(packed));
+        for (int axis = 0; axis < 3; axis++)
+            vertex[axis] = ((packed >> (axis * 10)) & 0x3FF) / 1023.0f * range.positionScale[axis] + range.positionOffset[axis];
+        break;
+    }
+    }
+
+    in += format.positionSize();
+    switch (format.texCoord)
+    {
+    case TEXCOORD_FLOAT2:
+        memcpy(vertex + 3, in, 2 * sizeof(float));
+        break;
+    case TEXCOORD_HALF2:
+    {
+        uint16_t half[2];
+        memcpy(half, in, sizeof(half));
+        vertex[3] = halfToFloat(half[0]);
+        vertex[4] = halfToFloat(half[1]);
+        break;
+    }
+    case TEXCOORD_UNORM16:
+    {
+        uint16_t packed[2];
+        memcpy(packed, in, sizeof(packed));
+        for (int axis = 0; axis < 2; axis++)
+            vertex[3 + axis] = packed[axis] / 65535.0f * range.texCoordScale[axis] + range.texCoordOffset[axis];
+        break;
+    }
+    }
+}
+
+// attribute 0 = position, 1 = texcoord, for a buffer of this format starting at baseOffset
+inline void setupVertexAttributes(const VertexFormat& format, size_t baseOffset)
+{
+    GLsizei stride = format.stride();
+    glEnableVertexAttribArray(0);
+    switch (format.position)
+    {
+    case POSITION_FLOAT3:
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)baseOffset);
+        break;
+    case POSITION_HALF3:
+        glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, (void*)baseOffset);
+        break;
+    case POSITION_UNORM16:
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)baseOffset);
+        break;
+    case POSITION_UNORM10:
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)baseOffset);
+        break;
+    }
+
+    size_t texCoordOffset = baseOffset + format.positionSize();
+    glEnableVertexAttribArray(1);
+    switch (format.texCoord)
+    {
+    case TEXCOORD_FLOAT2:
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)texCoordOffset);
+        break;
+    case TEXCOORD_HALF2:
+        glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)texCoordOffset);
+        break;
+    case TEXCOORD_UNORM16:
+        glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)texCoordOffset);
+        break;
+    }
+}
+
+// largest absolute difference between the source vertices and what the GPU reconstructs
+// -------------------------------------------------------------------------------------
+struct QuantizationError
+{
+    float position = 0.0f;
+    float texCoord = 0.0f;
+};
+
+inline QuantizationError measureQuantizationError(const VertexFormat& format, const QuantizationRange& range,
+                                                  const float* vertices, size_t vertexCount, unsigned int floatsPerVertex)
+{
+    QuantizationError error;
+    std::vector<unsigned char> packed(format.stride());
+    float decoded[5];
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const float* v = vertices + i * floatsPerVertex;
+        encodeVertex(format, range, v, packed.data());
+        decodeVertex(format, range, packed.data(), decoded);
+        for (int axis = 0; axis < 3; axis++)
+            error.position = std::max(error.position, std::fabs(decoded[axis] - v[axis]));
+        for (int axis = 3; axis < 5; axis++)
+            error.texCoord = std::max(error.texCoord, std::fabs(decoded[axis] - v[axis]));
+    }
+    return error;
+}
+
+// validation tool (--quantization-report): max error of one mesh in every position/texcoord format
+// -------------------------------------------------------------------------------------------------
+inline void printQuantizationReport(const std::string& name, const float* vertices, size_t vertexCount, unsigned int floatsPerVertex)
+{
+    std::cout << "quantization " << name << " (" << vertexCount << " vertices):" << std::endl;
+    const PositionFormat positions[] = { POSITION_FLOAT3, POSITION_HALF3, POSITION_UNORM16, POSITION_UNORM10 };
+    const TexCoordFormat texCoords[] = { TEXCOORD_FLOAT2, TEXCOORD_HALF2, TEXCOORD_UNORM16 };
+    for (PositionFormat position : positions)
+    {
+        for (TexCoordFormat texCoord : texCoords)
+        {
+            VertexFormat format = { position, texCoord };
+            QuantizationRange range = computeQuantizationRange(format, vertices, vertexCount, floatsPerVertex);
+            QuantizationError error = measureQuantizationError(format, range, vertices, vertexCount, floatsPerVertex);
+            std::cout << "  " << format.name() << " " << format.stride() << " bytes: position " << error.position
+                      << " texcoord " << error.texCoord << std::endl;
+        }
+    }
+}
+
+#endif